@@ -0,0 +1,92 @@
+#include "acc_controller.hpp"
+#include "acc_pi_step.hpp"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define ACC_BATCH_X86 1
+#endif
+
+// --- Batched PI controller kernels ---
+// The vector kernels mirror acc_pi_step() operation for operation. The
+// min/max operand order matters: on equal inputs (including +0/-0) and NaN,
+// MINPS/MAXPS return their second operand, which is what std::clamp returns.
+// This library is built with -ffp-contract=off so the scalar path never fuses
+// the multiply-adds that the vector path performs separately.
+
+void run_acc_batch_scalar(const AccBatch* batch) {
+    for (size_t i = 0; i < batch->count; ++i) {
+        acc_pi_step(batch->lead_speed[i], batch->own_speed[i], batch->kp[i], batch->ki[i],
+                    batch->integral_error[i], batch->max_accel[i], batch->max_decel[i]);
+    }
+}
+
+#if ACC_BATCH_X86
+static size_t run_acc_batch_sse2(const AccBatch* b) {
+    const __m128 limit = _mm_set1_ps(ACC_INTEGRAL_LIMIT);
+    const __m128 neg_limit = _mm_set1_ps(-ACC_INTEGRAL_LIMIT);
+    const __m128 sign_mask = _mm_set1_ps(-0.0f);
+    const __m128 zero = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= b->count; i += 4) {
+        __m128 own = _mm_loadu_ps(b->own_speed + i);
+        __m128 error = _mm_sub_ps(_mm_loadu_ps(b->lead_speed + i), own);
+
+        __m128 integral = _mm_add_ps(_mm_loadu_ps(b->integral_error + i), error);
+        integral = _mm_max_ps(neg_limit, _mm_min_ps(limit, integral));
+
+        __m128 output = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(b->kp + i), error),
+                                   _mm_mul_ps(_mm_loadu_ps(b->ki + i), integral));
+        __m128 neg_decel = _mm_xor_ps(_mm_loadu_ps(b->max_decel + i), sign_mask);
+        __m128 change = _mm_max_ps(neg_decel, _mm_min_ps(_mm_loadu_ps(b->max_accel + i), output));
+
+        own = _mm_add_ps(own, change);
+        own = _mm_andnot_ps(_mm_cmplt_ps(own, zero), own);
+
+        _mm_storeu_ps(b->own_speed + i, own);
+        _mm_storeu_ps(b->integral_error + i, integral);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t run_acc_batch_avx2(const AccBatch* b) {
+    const __m256 limit = _mm256_set1_ps(ACC_INTEGRAL_LIMIT);
+    const __m256 neg_limit = _mm256_set1_ps(-ACC_INTEGRAL_LIMIT);
+    const __m256 sign_mask = _mm256_set1_ps(-0.0f);
+    const __m256 zero = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= b->count; i += 8) {
+        __m256 own = _mm256_loadu_ps(b->own_speed + i);
+        __m256 error = _mm256_sub_ps(_mm256_loadu_ps(b->lead_speed + i), own);
+
+        __m256 integral = _mm256_add_ps(_mm256_loadu_ps(b->integral_error + i), error);
+        integral = _mm256_max_ps(neg_limit, _mm256_min_ps(limit, integral));
+
+        __m256 output = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(b->kp + i), error),
+                                      _mm256_mul_ps(_mm256_loadu_ps(b->ki + i), integral));
+        __m256 neg_decel = _mm256_xor_ps(_mm256_loadu_ps(b->max_decel + i), sign_mask);
+        __m256 change = _mm256_max_ps(neg_decel, _mm256_min_ps(_mm256_loadu_ps(b->max_accel + i), output));
+
+        own = _mm256_add_ps(own, change);
+        own = _mm256_andnot_ps(_mm256_cmp_ps(own, zero, _CMP_LT_OQ), own);
+
+        _mm256_storeu_ps(b->own_speed + i, own);
+        _mm256_storeu_ps(b->integral_error + i, integral);
+    }
+    return i;
+}
+#endif
+
+void run_acc_batch(const AccBatch* batch) {
+    if (!batch) return;
+    size_t done = 0;
+#if ACC_BATCH_X86
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    done = has_avx2 ? run_acc_batch_avx2(batch) : run_acc_batch_sse2(batch);
+#endif
+    // Remainder (and non-x86 targets) go through the reference step.
+    for (size_t i = done; i < batch->count; ++i) {
+        acc_pi_step(batch->lead_speed[i], batch->own_speed[i], batch->kp[i], batch->ki[i],
+                    batch->integral_error[i], batch->max_accel[i], batch->max_decel[i]);
+    }
+}
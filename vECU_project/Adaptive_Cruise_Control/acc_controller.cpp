@@ -1,65 +1,96 @@
 #include "acc_controller.hpp"
+#include "acc_pi_step.hpp"
 #include "../nvram_manager.hpp"
-#include <iostream>
+#include <cstdarg>
+#include <cstdio>
 #include <string>
-#include <algorithm> // For std::clamp
 
 // --- PI Controller State ---
 // These variables need to persist between runs of the controller.
 // In a real ECU, they would be class members or static variables.
 float integral_error = 0.0f;
 
-// The main function for the advanced ACC application logic.
-void run_acc_application() {
-    std::cout << "----------------------------------------" << std::endl;
-    std::cout << "[ACC] Advanced Controller Cycle Started." << std::endl;
+// Parameter store shared by the platform, or nullptr when running standalone.
+static NVRAMManager* g_attached_nvram = nullptr;
 
-    NVRAMManager nvram("nvram.dat");
-    if (!nvram.load()) {
-        std::cerr << "[ACC] ERROR: Could not load NVRAM data." << std::endl;
-        return;
-    }
+void acc_attach_nvram(NVRAMManager* nvram) {
+    g_attached_nvram = nvram;
+}
 
-    // --- Read Parameters from NVRAM ---
-    float lead_speed = std::stof(nvram.get_string("LEAD_VEHICLE_SPEED").value_or("0.0"));
-    float own_speed = std::stof(nvram.get_string("OWN_VEHICLE_SPEED").value_or("0.0"));
-    int gap_setting = std::stoi(nvram.get_string("ACC_GAP_SETTING").value_or("2"));
-    
-    // Read new PI controller and limit parameters
-    float Kp = std::stof(nvram.get_string("ACC_KP").value_or("0.4"));
-    float Ki = std::stof(nvram.get_string("ACC_KI").value_or("0.1"));
-    float max_accel = std::stof(nvram.get_string("ACC_MAX_ACCEL").value_or("2.0"));
-    float max_decel = std::stof(nvram.get_string("ACC_MAX_DECEL").value_or("3.0"));
+// Platform log sink, or nullptr when running standalone.
+static AccLogFunction g_attached_logger = nullptr;
 
+void acc_attach_logger(AccLogFunction log) {
+    g_attached_logger = log;
+}
 
-    // --- PI Controller Logic ---
-    float error = lead_speed - own_speed;
+// Messages below this level are compiled out. Override with
+// -DVECU_LOG_MIN_LEVEL=<0..4>, shared with the platform.
+#ifndef VECU_LOG_MIN_LEVEL
+#define VECU_LOG_MIN_LEVEL ACC_LOG_INFO
+#endif
 
-    // Update integral error (with anti-windup)
-    integral_error += error;
-    // Simple anti-windup: clamp the integral term to prevent it from growing too large
-    integral_error = std::clamp(integral_error, -20.0f, 20.0f);
+static void acc_log_standalone(int level, const char* tag, const char* format, ...) __attribute__((format(printf, 3, 4)));
+static void acc_log_standalone(int level, const char* tag, const char* format, ...) {
+    FILE* stream = level >= ACC_LOG_WARN ? stderr : stdout;
+    va_list args;
+    va_start(args, format);
+    std::fprintf(stream, "[%s] ", tag);
+    std::vfprintf(stream, format, args);
+    std::fputc('\n', stream);
+    va_end(args);
+}
 
-    // Calculate control output (how much to accelerate/decelerate)
-    float control_output = (Kp * error) + (Ki * integral_error);
+#define ACC_LOG(level, ...)                                                          \
+    do {                                                                             \
+        if constexpr ((level) >= VECU_LOG_MIN_LEVEL) {                               \
+            if (g_attached_logger) g_attached_logger(level, "ACC", __VA_ARGS__);     \
+            else acc_log_standalone(level, "ACC", __VA_ARGS__);                      \
+        }                                                                            \
+    } while (0)
 
-    // Clamp the output to the max acceleration/deceleration rates
-    float speed_change = std::clamp(control_output, -max_decel, max_accel);
+// One cycle of the advanced ACC application logic.
+static void run_cycle(NVRAMManager& nvram, float& integral_error) {
+    ACC_LOG(ACC_LOG_DEBUG, "Advanced Controller Cycle Started.");
 
-    // --- Apply Control Action ---
-    own_speed += speed_change;
+    // --- Read Parameters from NVRAM ---
+    float lead_speed = nvram.get_float(NvramParam::LEAD_VEHICLE_SPEED);
+    float own_speed = nvram.get_float(NvramParam::OWN_VEHICLE_SPEED);
+    int gap_setting = nvram.get_int(NvramParam::ACC_GAP_SETTING);
     
-    // Ensure speed doesn't go below zero
-    if (own_speed < 0) own_speed = 0;
+    // Read new PI controller and limit parameters
+    float Kp = nvram.get_float(NvramParam::ACC_KP);
+    float Ki = nvram.get_float(NvramParam::ACC_KI);
+    float max_accel = nvram.get_float(NvramParam::ACC_MAX_ACCEL);
+    float max_decel = nvram.get_float(NvramParam::ACC_MAX_DECEL);
+
+
+    // --- PI Controller Logic ---
+    AccStepResult step = acc_pi_step(lead_speed, own_speed, Kp, Ki, integral_error, max_accel, max_decel);
 
-    std::cout << "[ACC] Target: " << lead_speed << " mph | Current: " << own_speed << " mph | Gap: " << gap_setting << std::endl;
-    printf("[ACC] Error: %.2f | Control Output: %.2f | Final Speed Change: %.2f\n", error, control_output, speed_change);
+    ACC_LOG(ACC_LOG_DEBUG, "Target: %g mph | Current: %g mph | Gap: %d", lead_speed, own_speed, gap_setting);
+    ACC_LOG(ACC_LOG_DEBUG, "Error: %.2f | Control Output: %.2f | Final Speed Change: %.2f", step.error, step.control_output, step.speed_change);
 
 
     // --- Save State for Next Cycle ---
-    nvram.set_string("OWN_VEHICLE_SPEED", std::to_string(own_speed));
+    nvram.set_float(NvramParam::OWN_VEHICLE_SPEED, own_speed);
     nvram.save();
 
-    std::cout << "[ACC] Advanced Controller Cycle Finished." << std::endl;
-    std::cout << "----------------------------------------" << std::endl;
+    ACC_LOG(ACC_LOG_DEBUG, "Advanced Controller Cycle Finished.");
+}
+
+// The main function for the advanced ACC application logic.
+void run_acc_application() {
+    // Without a platform store, fall back to reading the NVRAM image directly.
+    static NVRAMManager standalone_nvram("nvram.img", "nvram.dat");
+    NVRAMManager& nvram = g_attached_nvram ? *g_attached_nvram : standalone_nvram;
+    if (!g_attached_nvram && !nvram.load()) {
+        ACC_LOG(ACC_LOG_ERROR, "ERROR: Could not load NVRAM data.");
+        return;
+    }
+    run_cycle(nvram, integral_error);
+}
+
+void run_acc_instance(NVRAMManager* nvram, AccInstanceState* state) {
+    run_cycle(*nvram, state->integral_error);
 }
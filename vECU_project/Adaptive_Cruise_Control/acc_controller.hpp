@@ -1,6 +1,9 @@
 #pragma once
 
 #include <iostream>
+#include <cstddef>
+
+class NVRAMManager;
 
 /**
  * @brief The main entry point for the ACC application logic.
@@ -10,3 +13,94 @@
  * it easier to find and load from the shared library.
  */
 extern "C" void run_acc_application();
+
+
+/**
+ * @brief Hands the platform's live parameter store to the ACC application.
+ *
+ * Called by the platform right after the library is loaded. While attached,
+ * each cycle reads and writes parameters in memory instead of rereading
+ * the NVRAM image. Passing nullptr detaches and falls back to the image.
+ */
+extern "C" void acc_attach_nvram(NVRAMManager* nvram);
+
+
+/**
+ * @brief Controller state the platform keeps for one ECU.
+ *
+ * Everything that persists between cycles lives here instead of in the
+ * library's globals, so one loaded image can serve many ECUs.
+ */
+struct AccInstanceState {
+    float integral_error;
+};
+
+/**
+ * @brief Runs one control cycle for the ECU that owns `nvram` and `state`.
+ *
+ * Touches no global state, unlike run_acc_application(), so the platform
+ * can call it for any number of ECUs with a single copy of the library.
+ * `state` must be zero-initialised before the first cycle.
+ */
+extern "C" void run_acc_instance(NVRAMManager* nvram, AccInstanceState* state);
+
+
+/**
+ * @brief Log levels of the C logging interface, lowest first.
+ *
+ * Same numbering as the platform's LogLevel (ecu_log.hpp).
+ */
+enum AccLogLevel {
+    ACC_LOG_TRACE = 0,
+    ACC_LOG_DEBUG = 1,
+    ACC_LOG_INFO = 2,
+    ACC_LOG_WARN = 3,
+    ACC_LOG_ERROR = 4
+};
+
+/**
+ * @brief printf-style sink for one log message. Must not block.
+ */
+typedef void (*AccLogFunction)(int level, const char* tag, const char* format, ...);
+
+/**
+ * @brief Routes the ACC application's log output through the platform.
+ *
+ * Called by the platform right after the library is loaded, so the control
+ * cycle hands its messages to the platform's asynchronous logger instead of
+ * writing to stdout itself. Passing nullptr detaches and falls back to
+ * stdout.
+ */
+extern "C" void acc_attach_logger(AccLogFunction log);
+
+
+/**
+ * @brief Structure-of-arrays state for stepping many vehicles at once.
+ *
+ * Each pointer addresses `count` floats. `own_speed` and `integral_error`
+ * are updated in place; everything else is read-only. 32-byte aligned
+ * buffers are fastest but not required.
+ */
+struct AccBatch {
+    size_t count;
+    const float* lead_speed;
+    float* own_speed;
+    const float* kp;
+    const float* ki;
+    float* integral_error;
+    const float* max_accel;
+    const float* max_decel;
+};
+
+/**
+ * @brief Runs one PI controller step for every vehicle in the batch.
+ *
+ * Uses AVX2 or SSE2 when the CPU supports them. Results are bit-identical
+ * to run_acc_batch_scalar().
+ */
+extern "C" void run_acc_batch(const AccBatch* batch);
+
+/**
+ * @brief Reference implementation of run_acc_batch() without SIMD.
+ */
+extern "C" void run_acc_batch_scalar(const AccBatch* batch);
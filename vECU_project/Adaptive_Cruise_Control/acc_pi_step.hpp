@@ -0,0 +1,43 @@
+#pragma once
+
+#include <algorithm> // For std::clamp
+
+// Limits applied by the PI controller.
+constexpr float ACC_INTEGRAL_LIMIT = 20.0f;
+
+struct AccStepResult {
+    float error;
+    float control_output;
+    float speed_change;
+};
+
+/**
+ * @brief One PI controller step for a single vehicle.
+ *
+ * This is the reference implementation: the single-vehicle cycle and the
+ * scalar batch path both call it, and the SIMD batch kernels must reproduce
+ * its results bit for bit (same operation order, no fused multiply-add).
+ */
+inline AccStepResult acc_pi_step(float lead_speed, float& own_speed, float Kp, float Ki,
+                                 float& integral_error, float max_accel, float max_decel) {
+    float error = lead_speed - own_speed;
+
+    // Update integral error (with anti-windup)
+    integral_error += error;
+    // Simple anti-windup: clamp the integral term to prevent it from growing too large
+    integral_error = std::clamp(integral_error, -ACC_INTEGRAL_LIMIT, ACC_INTEGRAL_LIMIT);
+
+    // Calculate control output (how much to accelerate/decelerate)
+    float control_output = (Kp * error) + (Ki * integral_error);
+
+    // Clamp the output to the max acceleration/deceleration rates
+    float speed_change = std::clamp(control_output, -max_decel, max_accel);
+
+    // --- Apply Control Action ---
+    own_speed += speed_change;
+
+    // Ensure speed doesn't go below zero
+    if (own_speed < 0) own_speed = 0;
+
+    return {error, control_output, speed_change};
+}
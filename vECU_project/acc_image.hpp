@@ -0,0 +1,326 @@
+#pragma once
+
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <thread>
+#include <tuple>
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ecu_log.hpp"
+#include "nvram_manager.hpp"
+#include "sha256_stream.hpp"
+#include "Adaptive_Cruise_Control/acc_controller.hpp"
+
+// One dlopen()ed ACC application image. Closed when the last ECU using it
+// lets go.
+struct AccImage {
+    std::string hash; // SHA-256 of the library file
+    void* handle = nullptr;
+    void (*run_instance)(NVRAMManager*, AccInstanceState*) = nullptr;
+    void (*run)() = nullptr; // Images without run_instance keep their state in globals
+    void (*attach_nvram)(NVRAMManager*) = nullptr;
+    void (*attach_logger)(AccLogFunction) = nullptr;
+
+    AccImage() = default;
+    AccImage(const AccImage&) = delete;
+    AccImage& operator=(const AccImage&) = delete;
+
+    ~AccImage() {
+        if (!handle) return;
+        if (attach_nvram) attach_nvram(nullptr);
+        if (attach_logger) attach_logger(nullptr);
+        dlclose(handle);
+    }
+};
+
+// Loads ACC images by content, so every ECU running the same build shares
+// one mapping of the library however many copies of the file exist. Each
+// ECU keeps its own libacc_app.so (an OTA replaces just that one); the file
+// is hashed, hard-linked to .acc_cache.<pid>/<hash>.so and opened under that
+// name. The directory is per process, so a --probe-acc child tearing down its
+// own cache cannot remove the one the parent is staging into. The content-addressed name also keeps dlopen() from handing back a
+// stale handle when an update renames a new file over an old path.
+//
+// Images that predate run_acc_instance() keep their controller state and
+// parameter store in globals. Those are opened from a private copy per ECU
+// instead, so ECUs never share them.
+//
+// Safe to use from any thread; loading happens under a lock.
+class AccImageCache {
+public:
+    // `logger` is attached to every image that accepts one.
+    explicit AccImageCache(AccLogFunction logger)
+        : m_logger(logger), m_directory(".acc_cache." + std::to_string(::getpid())) {}
+
+    ~AccImageCache() {
+        ::rmdir(m_directory.c_str()); // Only succeeds once nothing is staged there
+    }
+
+    AccImageCache(const AccImageCache&) = delete;
+    AccImageCache& operator=(const AccImageCache&) = delete;
+
+    // Returns the image at `path` for ECU `instance`, loading it if no ECU
+    // has it open yet, or nullptr on failure. `nvram` is attached to images
+    // that need a private copy.
+    std::shared_ptr<AccImage> acquire(const std::string& path, unsigned instance, NVRAMManager* nvram) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto hash = content_hash(path);
+        if (!hash) {
+            ECU_LOG_ERROR("APP", "ERROR: Cannot read shared library %s", path.c_str());
+            return nullptr;
+        }
+
+        bool private_copy = m_private_hashes.count(*hash) > 0;
+        std::string key = private_copy ? *hash + "-" + std::to_string(instance) : *hash;
+        if (auto image = m_images[key].lock()) return image;
+
+        auto image = open(path, key, *hash, private_copy);
+        if (!image) return nullptr;
+        if (!image->run_instance && !private_copy) {
+            // The first ECU keeps this handle; the next one loads its own copy.
+            m_private_hashes.insert(*hash);
+            key = *hash + "-" + std::to_string(instance);
+        }
+        if (image->attach_nvram && !image->run_instance) image->attach_nvram(nvram);
+        m_images[key] = image;
+        return image;
+    }
+
+    // Distinct images currently loaded.
+    size_t loaded() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t count = 0;
+        for (const auto& entry : m_images) count += entry.second.expired() ? 0 : 1;
+        return count;
+    }
+
+private:
+    using FileId = std::tuple<dev_t, ino_t, off_t, int64_t>; // Device, inode, size, mtime
+
+    AccLogFunction m_logger;
+    const std::string m_directory; // Relative to the working directory
+    std::mutex m_mutex;
+    std::map<std::string, std::weak_ptr<AccImage>> m_images;
+    std::set<std::string> m_private_hashes;
+    std::map<FileId, std::string> m_hashes; // Saves rehashing files we have seen
+
+    std::optional<std::string> content_hash(const std::string& path) {
+        struct stat info;
+        if (::stat(path.c_str(), &info) != 0) return std::nullopt;
+        FileId id{info.st_dev, info.st_ino, info.st_size,
+                  static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec};
+        auto it = m_hashes.find(id);
+        if (it != m_hashes.end()) return it->second;
+        auto hash = sha256_file_hex(path);
+        if (hash) m_hashes.emplace(id, *hash);
+        return hash;
+    }
+
+    std::shared_ptr<AccImage> open(const std::string& path, const std::string& key, const std::string& hash, bool private_copy) {
+        ::mkdir(m_directory.c_str(), 0755);
+        std::string cached_path = "./" + m_directory + "/" + key + ".so";
+        ::unlink(cached_path.c_str());
+        // A private copy needs its own inode; dlopen() also matches on that.
+        if (private_copy || ::link(path.c_str(), cached_path.c_str()) != 0) {
+            if (!copy_file(path, cached_path)) {
+                ECU_LOG_ERROR("APP", "ERROR: Cannot stage %s: %s", cached_path.c_str(), std::strerror(errno));
+                return nullptr;
+            }
+        }
+
+        // RTLD_NOW resolves every symbol up front so no lazy binding lands inside a cycle.
+        void* handle = dlopen(cached_path.c_str(), RTLD_NOW);
+        ::unlink(cached_path.c_str()); // The mapping stays valid
+        if (!handle) {
+            ECU_LOG_ERROR("APP", "ERROR: Cannot load shared library: %s", dlerror());
+            return nullptr;
+        }
+
+        auto image = std::make_shared<AccImage>();
+        image->hash = hash;
+        image->handle = handle;
+        image->run_instance = (void (*)(NVRAMManager*, AccInstanceState*))dlsym(handle, "run_acc_instance");
+        if (!image->run_instance) {
+            dlerror(); // Older application images only have the global entry point.
+            image->run = (void (*)())dlsym(handle, "run_acc_application");
+            const char* dlsym_error = dlerror();
+            if (dlsym_error) {
+                ECU_LOG_ERROR("APP", "ERROR: Cannot find symbol 'run_acc_application': %s", dlsym_error);
+                return nullptr; // ~AccImage closes the handle
+            }
+        }
+
+        // Share the platform's parameter store so the application works in memory.
+        image->attach_nvram = (void (*)(NVRAMManager*))dlsym(handle, "acc_attach_nvram");
+        if (!image->attach_nvram) {
+            dlerror(); // Older application images only read the NVRAM image.
+        }
+
+        // Route the application's output through the asynchronous logger.
+        image->attach_logger = (void (*)(AccLogFunction))dlsym(handle, "acc_attach_logger");
+        if (image->attach_logger) {
+            image->attach_logger(m_logger);
+        } else {
+            dlerror(); // Older application images write to stdout themselves.
+        }
+        return image;
+    }
+
+    static bool copy_file(const std::string& from, const std::string& to) {
+        int in = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+        if (in < 0) return false;
+        int out = ::open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0755);
+        if (out < 0) {
+            ::close(in);
+            return false;
+        }
+        char buffer[64 * 1024];
+        bool ok = true;
+        ssize_t length;
+        while ((length = ::read(in, buffer, sizeof(buffer))) > 0) {
+            if (::write(out, buffer, length) != length) {
+                ok = false;
+                break;
+            }
+        }
+        ok = ok && length == 0;
+        ::close(in);
+        return ::close(out) == 0 && ok;
+    }
+};
+
+// --- Pre-activation checks ---
+// An update is only made active after a child process has loaded it. A
+// library that crashes in its constructors, lacks an entry point or blows up
+// in its first control cycle takes down the child, never the ECU.
+const char* const ACC_PROBE_OPTION = "--probe-acc";
+const std::chrono::milliseconds ACC_PROBE_TIMEOUT(5000);
+
+inline void acc_probe_silent_log(int, const char*, const char*, ...) {}
+
+// Body of the probe child, run by TargetECU --probe-acc <library> <nvram image|-> <smoke 0|1>.
+// Loads the library with every symbol resolved, checks the entry points and,
+// with `smoke_cycle`, runs one control cycle against a scratch copy of the
+// ECU's parameters. Exit status 0 means the image may be activated.
+inline int run_acc_probe(const char* library_path, const char* nvram_image, bool smoke_cycle) {
+    void* handle = dlopen(library_path, RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        std::fprintf(stderr, "[PROBE] Cannot load %s: %s\n", library_path, dlerror());
+        return 1;
+    }
+    auto run_instance = (void (*)(NVRAMManager*, AccInstanceState*))dlsym(handle, "run_acc_instance");
+    auto run = (void (*)())dlsym(handle, "run_acc_application");
+    if (!run_instance && !run) {
+        std::fprintf(stderr, "[PROBE] %s has neither run_acc_instance nor run_acc_application.\n", library_path);
+        return 2;
+    }
+    if (!smoke_cycle) return 0;
+
+    auto attach_nvram = (void (*)(NVRAMManager*))dlsym(handle, "acc_attach_nvram");
+    auto attach_logger = (void (*)(AccLogFunction))dlsym(handle, "acc_attach_logger");
+    if (attach_logger) attach_logger(acc_probe_silent_log);
+
+    // Older images read nvram.img from the working directory, so run in the scratch one.
+    // The parameters are copied first, while a relative image path still resolves.
+    char scratch[] = "/tmp/vecu_probe.XXXXXX";
+    if (!::mkdtemp(scratch)) {
+        std::fprintf(stderr, "[PROBE] Cannot create a scratch directory.\n");
+        return 3;
+    }
+    std::error_code ignored;
+    if (std::strcmp(nvram_image, "-") != 0) {
+        std::error_code ec;
+        std::filesystem::copy_file(nvram_image, std::filesystem::path(scratch) / "nvram.img", ec);
+        if (ec) {
+            std::fprintf(stderr, "[PROBE] Cannot copy %s: %s\n", nvram_image, ec.message().c_str());
+            std::filesystem::remove_all(scratch, ignored);
+            return 3;
+        }
+    }
+    if (::chdir(scratch) != 0) {
+        std::fprintf(stderr, "[PROBE] Cannot enter the scratch directory.\n");
+        std::filesystem::remove_all(scratch, ignored);
+        return 3;
+    }
+    int status = 0;
+    {
+        NVRAMManager nvram("nvram.img");
+        if (!nvram.load()) {
+            status = 3;
+        } else {
+            AccInstanceState state{};
+            if (run_instance) {
+                run_instance(&nvram, &state);
+            } else {
+                if (attach_nvram) attach_nvram(&nvram);
+                run();
+            }
+            if (!std::isfinite(nvram.get_float(NvramParam::OWN_VEHICLE_SPEED)) || !std::isfinite(state.integral_error)) {
+                std::fprintf(stderr, "[PROBE] Smoke cycle of %s produced a non-finite result.\n", library_path);
+                status = 4;
+            }
+        }
+    }
+    std::filesystem::remove_all(scratch, ignored);
+    return status;
+}
+
+// Runs run_acc_probe() for `library_path` in a child copy of this executable
+// and waits up to `timeout` for its verdict. `nvram_image` may be empty.
+inline bool probe_acc_library(const std::string& library_path, const std::string& nvram_image, bool smoke_cycle,
+                              std::chrono::milliseconds timeout = ACC_PROBE_TIMEOUT) {
+    // The child changes directory before it runs the smoke cycle.
+    std::error_code image_ec, library_ec;
+    std::string image = nvram_image.empty() ? std::string("-") : std::filesystem::absolute(nvram_image, image_ec).string();
+    std::string library = std::filesystem::absolute(library_path, library_ec).string();
+    if (image_ec || library_ec) {
+        ECU_LOG_ERROR("OTA", "ERROR: Cannot resolve the image probe paths: %s", (image_ec ? image_ec : library_ec).message().c_str());
+        return false;
+    }
+    const char* argv[] = {"TargetECU", ACC_PROBE_OPTION, library.c_str(), image.c_str(), smoke_cycle ? "1" : "0", nullptr};
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0); // The application's chatter
+    pid_t child;
+    int error = posix_spawn(&child, "/proc/self/exe", &actions, nullptr, const_cast<char* const*>(argv), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (error != 0) {
+        ECU_LOG_ERROR("OTA", "ERROR: Cannot start the image probe: %s", std::strerror(error));
+        return false;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    int status = 0;
+    while (::waitpid(child, &status, WNOHANG) == 0) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            ::kill(child, SIGKILL);
+            ::waitpid(child, &status, 0);
+            ECU_LOG_ERROR("OTA", "ERROR: Image probe of %s timed out.", library_path.c_str());
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    if (WIFSIGNALED(status)) {
+        ECU_LOG_ERROR("OTA", "ERROR: Image probe of %s died with signal %d.", library_path.c_str(), WTERMSIG(status));
+        return false;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+// Counting replacement for the global allocation functions. Include from
+// exactly one translation unit of a program: every operator new and delete
+// form is replaced here, as matching pairs on malloc/free, so each heap
+// allocation the program makes, aligned and nothrow ones included, is
+// counted in g_allocations.
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+inline std::atomic<uint64_t> g_allocations{0};
+
+inline void* counted_allocate(std::size_t size, std::size_t alignment) noexcept {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0) size = 1;
+    if (alignment <= alignof(std::max_align_t)) return std::malloc(size);
+    void* pointer = nullptr;
+    return ::posix_memalign(&pointer, alignment, size) == 0 ? pointer : nullptr;
+}
+
+inline void* counted_allocate_or_throw(std::size_t size, std::size_t alignment) {
+    if (void* pointer = counted_allocate(size, alignment)) return pointer;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size) { return counted_allocate_or_throw(size, 0); }
+void* operator new[](std::size_t size) { return counted_allocate_or_throw(size, 0); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return counted_allocate(size, 0); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return counted_allocate(size, 0); }
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return counted_allocate_or_throw(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return counted_allocate_or_throw(size, static_cast<std::size_t>(alignment));
+}
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return counted_allocate(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return counted_allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept { std::free(pointer); }
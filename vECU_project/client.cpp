@@ -4,45 +4,86 @@
 #include <fstream>
 #include <iomanip>
 #include <sstream>
+#include <optional>
+#include <deque>
+#include <chrono>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <cstdio>
+#include <thread>
 #include <boost/asio.hpp>
 #include <arpa/inet.h>
 #include <openssl/evp.h>
 #include <openssl/sha.h>
+#include <sys/stat.h>
+
+#include "doip_protocol.hpp"
+#include "sha256_stream.hpp"
+#include "ota_delta.hpp"
+#include "ota_compression.hpp"
+#include "ota_manifest.hpp"
+#include "did_codec.hpp"
+#include "did_registry.hpp"
 
 using boost::asio::ip::tcp;
 
-#pragma pack(push, 1)
-struct DoIPHeader {
-    uint8_t  protocol_version;
-    uint8_t  inverse_protocol_version;
+// ReadDataByPeriodicIdentifier transmission modes.
+const uint8_t PERIODIC_MODE_SLOW = 0x01;   // Every 100 control cycles
+const uint8_t PERIODIC_MODE_MEDIUM = 0x02; // Every 10 control cycles
+const uint8_t PERIODIC_MODE_FAST = 0x03;   // Every control cycle
+const uint8_t PERIODIC_MODE_STOP = 0x04;
+
+// Blocks kept in flight during --update unless --window overrides it.
+const uint8_t DEFAULT_TRANSFER_WINDOW = 16;
+// Reconnects a --resumable update attempts after losing the connection.
+const unsigned DEFAULT_RESUME_RETRIES = 3;
+// Requests kept in flight during --batch unless --pipeline overrides it.
+const size_t DEFAULT_BATCH_PIPELINE = 16;
+
+// One line of a --batch script, already encoded as a DoIP request.
+struct BatchCommand {
+    enum class Kind { IDENTIFY, ROUTINE, READ, WRITE };
+    size_t line;
+    std::string text;
+    Kind kind;
     uint16_t payload_type;
-    uint32_t payload_length;
+    std::vector<uint8_t> payload;
 };
-#pragma pack(pop)
-
-// UDS Service and Data Identifiers
-const uint8_t UDS_READ_DATA_BY_IDENTIFIER = 0x22;
-const uint8_t UDS_WRITE_DATA_BY_IDENTIFIER = 0x2E;
-const uint8_t UDS_ROUTINE_CONTROL = 0x31;
-const uint8_t UDS_REQUEST_DOWNLOAD = 0x34;
-const uint8_t UDS_TRANSFER_DATA = 0x36;
-const uint8_t UDS_REQUEST_TRANSFER_EXIT = 0x37;
-
-const uint16_t UDS_ENTER_PROGRAMMING_SESSION = 0xFF00;
-const uint16_t DID_LEAD_VEHICLE_SPEED = 0xF101;
-const uint16_t DID_OWN_VEHICLE_SPEED = 0xF103;
-const uint16_t DID_ACC_GAP_SETTING = 0xF102;
-const uint16_t DID_ACC_KP = 0xD101;
-const uint16_t DID_ACC_KI = 0xD102;
-const uint16_t DID_ACC_MAX_ACCEL = 0xD103;
-const uint16_t DID_ACC_MAX_DECEL = 0xD104;
 
 // Function Prototypes
 bool send_and_receive(tcp::socket& socket, uint16_t type, const std::vector<uint8_t>& payload, std::vector<uint8_t>& response_payload);
-std::optional<std::string> calculate_file_hash(const std::string& file_path);
+void send_message(tcp::socket& socket, uint16_t type, const std::vector<uint8_t>& payload);
+uint16_t receive_message(tcp::socket& socket, std::vector<uint8_t>& response_payload);
+bool perform_update(tcp::socket& socket, const std::string& file_path, uint8_t window, const std::string& base_path, bool compress);
+bool perform_resumable_update(const std::string& host, const std::string& port, const std::string& file_path,
+                              uint8_t window, uint32_t chunk_size, unsigned retries);
+bool read_whole_file(const std::string& file_path, std::vector<uint8_t>& contents);
+void send_transfer_block(tcp::socket& socket, uint8_t block_counter, const uint8_t* data, size_t length);
+bool read_dids(tcp::socket& socket, const std::vector<const DidInfo*>& dids, std::vector<std::pair<const DidInfo*, float>>& values);
+bool stream_dids(tcp::socket& socket, const std::vector<const DidInfo*>& dids, uint8_t mode, uint64_t count);
+std::vector<uint8_t> build_read_request(const std::vector<const DidInfo*>& dids);
+bool check_did_write(const DidInfo& entry, float value, std::string& error);
+std::vector<uint8_t> build_write_request(const DidInfo& entry, float value);
+bool decode_read_response(const std::vector<uint8_t>& response_payload, std::vector<std::pair<const DidInfo*, float>>& values);
+bool parse_did_names(const std::string& names, std::vector<const DidInfo*>& dids, std::string& unknown);
+bool parse_batch_command(const std::string& text, BatchCommand& command, std::string& error);
+bool run_batch(tcp::socket& socket, std::istream& input, size_t pipeline, bool json);
 void print_usage();
 
 int main(int argc, char* argv[]) {
+    // --host and --port may appear anywhere; the command sees the rest.
+    std::string host = "localhost";
+    std::string port = "13400";
+    std::vector<char*> arguments = {argv[0]};
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--host") == 0 && i + 1 < argc) host = argv[++i];
+        else if (std::strcmp(argv[i], "--port") == 0 && i + 1 < argc) port = argv[++i];
+        else arguments.push_back(argv[i]);
+    }
+    argc = static_cast<int>(arguments.size());
+    argv = arguments.data();
+
     if (argc < 2) {
         print_usage();
         return 1;
@@ -52,7 +93,8 @@ int main(int argc, char* argv[]) {
         boost::asio::io_context io_context;
         tcp::socket socket(io_context);
         tcp::resolver resolver(io_context);
-        boost::asio::connect(socket, resolver.resolve("localhost", "13400"));
+        boost::asio::connect(socket, resolver.resolve(host, port));
+        socket.set_option(tcp::no_delay(true));
         
         std::string command = argv[1];
         std::vector<uint8_t> response_payload;
@@ -60,87 +102,135 @@ int main(int argc, char* argv[]) {
         if (command == "--identify") {
             if (!send_and_receive(socket, 0x0004, {}, response_payload)) return 1;
             std::cout << "[CLIENT] Vehicle VIN: " << std::string(response_payload.begin(), response_payload.end()) << std::endl;
+        } else if (command == "--metrics") {
+            std::vector<uint8_t> payload = {UDS_ROUTINE_CONTROL, 0x01, UDS_ROUTINE_READ_METRICS >> 8, UDS_ROUTINE_READ_METRICS & 0xFF};
+            send_message(socket, 0x8001, payload);
+            uint16_t type = receive_message(socket, response_payload);
+            if (is_negative_response(type, response_payload) || response_payload.size() < 4) {
+                std::cerr << "--- FAILED: ECU returned a Negative Response. ---" << std::endl;
+                return 1;
+            }
+            std::cout << std::string(response_payload.begin() + 4, response_payload.end());
         } else if (command == "--program") {
             std::vector<uint8_t> payload = {UDS_ROUTINE_CONTROL, 0x01, (UDS_ENTER_PROGRAMMING_SESSION >> 8) & 0xFF, UDS_ENTER_PROGRAMMING_SESSION & 0xFF};
             if (!send_and_receive(socket, 0x8001, payload, response_payload)) return 1;
-        } else if (command.rfind("--get", 0) == 0) { // Check if command starts with --get
+        } else if (command == "--get" || command == "--dashboard") {
+            // Every requested DID is fetched with a single ReadDataByIdentifier.
+            std::vector<const DidInfo*> dids;
+            if (command == "--dashboard") {
+                if (argc != 2) { print_usage(); return 1; }
+                for (const DidInfo& entry : DID_REGISTRY) dids.push_back(&entry);
+            } else {
+                if (argc != 3) { print_usage(); return 1; }
+                std::string unknown;
+                if (!parse_did_names(argv[2], dids, unknown)) {
+                    std::cerr << "[CLIENT] Unknown value: " << unknown << std::endl;
+                    return 1;
+                }
+            }
+            std::vector<std::pair<const DidInfo*, float>> values;
+            if (!read_dids(socket, dids, values)) return 1;
+            for (const auto& [entry, value] : values) {
+                std::cout << "[CLIENT] " << std::left << std::setw(12) << entry->name << std::right << value << std::endl;
+            }
+        } else if (command == "--stream") {
+            if (argc < 3) { print_usage(); return 1; }
+            std::vector<const DidInfo*> dids;
+            std::string unknown;
+            if (!parse_did_names(argv[2], dids, unknown)) {
+                std::cerr << "[CLIENT] Unknown value: " << unknown << std::endl;
+                return 1;
+            }
+            for (const DidInfo* entry : dids) {
+                if (entry->periodic_id == 0) {
+                    std::cerr << "[CLIENT] " << entry->name << " cannot be streamed." << std::endl;
+                    return 1;
+                }
+            }
+            uint8_t mode = PERIODIC_MODE_MEDIUM;
+            uint64_t count = 0; // 0 = until interrupted
+            for (int i = 3; i < argc; ++i) {
+                std::string option = argv[i];
+                if (option == "--rate" && i + 1 < argc) {
+                    std::string rate = argv[++i];
+                    if (rate == "slow") mode = PERIODIC_MODE_SLOW;
+                    else if (rate == "medium") mode = PERIODIC_MODE_MEDIUM;
+                    else if (rate == "fast") mode = PERIODIC_MODE_FAST;
+                    else { print_usage(); return 1; }
+                } else if (option == "--count" && i + 1 < argc) {
+                    count = std::stoull(argv[++i]);
+                } else { print_usage(); return 1; }
+            }
+            if (!stream_dids(socket, dids, mode, count)) return 1;
+        } else if (command.rfind("--get-", 0) == 0) { // Check if command starts with --get-
             if (argc != 2) { print_usage(); return 1; }
-            uint16_t did = 0;
-            bool is_float = false;
-            if (command == "--get-lead-speed") did = DID_LEAD_VEHICLE_SPEED;
-            else if (command == "--get-own-speed") did = DID_OWN_VEHICLE_SPEED;
-            else if (command == "--get-gap") did = DID_ACC_GAP_SETTING;
-            else if (command == "--get-kp") { did = DID_ACC_KP; is_float = true; }
-            else if (command == "--get-ki") { did = DID_ACC_KI; is_float = true; }
-            else { print_usage(); return 1; }
-            
-            std::vector<uint8_t> payload = {UDS_READ_DATA_BY_IDENTIFIER, (uint8_t)(did >> 8), (uint8_t)did};
-            if (!send_and_receive(socket, 0x8001, payload, response_payload) || response_payload.size() < 4) return 1;
-            
-            float value = response_payload[3];
-            if (is_float) {
-                value /= 10.0f;
-            }
-            std::cout << "[CLIENT] Read value for " << command << ": " << value << std::endl;
-
-        } else if (command.rfind("--set", 0) == 0) { // Check if command starts with --set
+            const DidInfo* entry = find_did_info(command.substr(6));
+            if (!entry) { print_usage(); return 1; }
+            std::vector<std::pair<const DidInfo*, float>> values;
+            if (!read_dids(socket, {entry}, values) || values.empty()) return 1;
+            std::cout << "[CLIENT] Read value for " << command << ": " << values.front().second << std::endl;
+
+        } else if (command.rfind("--set-", 0) == 0) { // Check if command starts with --set-
             if (argc != 3) { print_usage(); return 1; }
-            uint16_t did = 0;
-            uint8_t value = 0;
-
-            if (command == "--set-lead-speed") {
-                did = DID_LEAD_VEHICLE_SPEED;
-                value = static_cast<uint8_t>(std::stoi(argv[2]));
-            } else if (command == "--set-gap") {
-                did = DID_ACC_GAP_SETTING;
-                value = static_cast<uint8_t>(std::stoi(argv[2]));
-            } else if (command == "--set-kp") {
-                did = DID_ACC_KP;
-                value = static_cast<uint8_t>(std::stof(argv[2]) * 10.0f);
-            } else if (command == "--set-ki") {
-                did = DID_ACC_KI;
-                value = static_cast<uint8_t>(std::stof(argv[2]) * 10.0f);
-            } else if (command == "--set-max-accel") {
-                did = DID_ACC_MAX_ACCEL;
-                value = static_cast<uint8_t>(std::stof(argv[2]) * 10.0f);
-            } else if (command == "--set-max-decel") {
-                did = DID_ACC_MAX_DECEL;
-                value = static_cast<uint8_t>(std::stof(argv[2]) * 10.0f);
-            } else { 
-                print_usage(); return 1; 
-            }
-            
-            std::vector<uint8_t> payload = {UDS_WRITE_DATA_BY_IDENTIFIER, (uint8_t)(did >> 8), (uint8_t)did, value};
-            if (!send_and_receive(socket, 0x8001, payload, response_payload)) return 1;
+            const DidInfo* entry = find_did_info(command.substr(6));
+            if (!entry) { print_usage(); return 1; }
+            float value = std::stof(argv[2]);
+            std::string error;
+            if (!check_did_write(*entry, value, error)) {
+                std::cerr << "[CLIENT] ERROR: " << error << std::endl;
+                return 1;
+            }
+
+            if (!send_and_receive(socket, 0x8001, build_write_request(*entry, value), response_payload)) return 1;
 
         } else if (command == "--update") {
-             if (argc != 3) { print_usage(); return 1; }
-            std::string file_path = argv[2];
-            auto new_firmware_hash_opt = calculate_file_hash(file_path);
-            if (!new_firmware_hash_opt) return 1;
-            std::ifstream file(file_path, std::ios::binary);
-            if (!file.is_open()) return 1;
-            file.seekg(0, std::ios::end);
-            uint32_t file_size = file.tellg();
-            file.seekg(0, std::ios::beg);
-            std::vector<uint8_t> req_payload = {UDS_REQUEST_DOWNLOAD, 0x00, 0x44, 0x00, 0x00, 0x00, 0x00, (uint8_t)(file_size >> 24), (uint8_t)(file_size >> 16), (uint8_t)(file_size >> 8), (uint8_t)file_size};
-            if (!send_and_receive(socket, 0x8001, req_payload, response_payload)) return 1;
-            const size_t CHUNK_SIZE = 4096;
-            std::vector<char> buffer(CHUNK_SIZE);
-            uint8_t block_counter = 1;
-            while (file.read(buffer.data(), buffer.size())) {
-                std::vector<uint8_t> transfer_payload = {UDS_TRANSFER_DATA, block_counter++};
-                transfer_payload.insert(transfer_payload.end(), buffer.begin(), buffer.end());
-                if (!send_and_receive(socket, 0x8001, transfer_payload, response_payload)) return 1;
+            if (argc < 3) { print_usage(); return 1; }
+            uint8_t window = DEFAULT_TRANSFER_WINDOW;
+            std::string base_path;
+            bool compress = false;
+            bool resumable = false;
+            uint32_t chunk_size = OTA_DEFAULT_CHUNK_SIZE;
+            unsigned retries = DEFAULT_RESUME_RETRIES;
+            for (int i = 3; i < argc; ++i) {
+                std::string option = argv[i];
+                if (option == "--compress") compress = true;
+                else if (option == "--resumable") resumable = true;
+                else if (option == "--window" && i + 1 < argc) window = static_cast<uint8_t>(std::clamp(std::stoi(argv[++i]), 1, 255));
+                else if (option == "--delta" && i + 1 < argc) base_path = argv[++i];
+                else if (option == "--chunk-size" && i + 1 < argc) {
+                    chunk_size = static_cast<uint32_t>(std::clamp<long>(std::stol(argv[++i]), OTA_MIN_CHUNK_SIZE, OTA_MAX_CHUNK_SIZE));
+                } else if (option == "--retries" && i + 1 < argc) retries = static_cast<unsigned>(std::max(0, std::stoi(argv[++i])));
+                else { print_usage(); return 1; }
             }
-            if (file.gcount() > 0) {
-                std::vector<uint8_t> transfer_payload = {UDS_TRANSFER_DATA, block_counter++};
-                transfer_payload.insert(transfer_payload.end(), buffer.begin(), buffer.begin() + file.gcount());
-                if (!send_and_receive(socket, 0x8001, transfer_payload, response_payload)) return 1;
+            if (resumable) {
+                // Manifest downloads send the raw image and manage their own connections.
+                if (compress || !base_path.empty()) { print_usage(); return 1; }
+                socket.close();
+                if (!perform_resumable_update(host, port, argv[2], window, chunk_size, retries)) return 1;
+            } else if (!perform_update(socket, argv[2], window, base_path, compress)) {
+                return 1;
+            }
+        } else if (command == "--batch") {
+            if (argc < 3) { print_usage(); return 1; }
+            size_t pipeline = DEFAULT_BATCH_PIPELINE;
+            bool json = false;
+            for (int i = 3; i < argc; ++i) {
+                std::string option = argv[i];
+                if (option == "--json") json = true;
+                else if (option == "--pipeline" && i + 1 < argc) pipeline = static_cast<size_t>(std::max(1, std::stoi(argv[++i])));
+                else { print_usage(); return 1; }
+            }
+            std::string script_path = argv[2];
+            if (script_path == "-") {
+                if (!run_batch(socket, std::cin, pipeline, json)) return 1;
+            } else {
+                std::ifstream script(script_path);
+                if (!script.is_open()) {
+                    std::cerr << "[CLIENT] ERROR: Could not open file: " << script_path << std::endl;
+                    return 1;
+                }
+                if (!run_batch(socket, script, pipeline, json)) return 1;
             }
-            std::vector<uint8_t> exit_payload = {UDS_REQUEST_TRANSFER_EXIT};
-            exit_payload.insert(exit_payload.end(), new_firmware_hash_opt->begin(), new_firmware_hash_opt->end());
-            if (!send_and_receive(socket, 0x8001, exit_payload, response_payload)) return 1;
         } else {
             print_usage();
             return 1;
@@ -153,30 +243,631 @@ int main(int argc, char* argv[]) {
 }
 
 void print_usage() {
-    std::cerr << "Usage: doip_client <command> [options]" << std::endl;
+    std::cerr << "Usage: doip_client [--host <host>] [--port <port>] <command> [options]" << std::endl;
     std::cerr << "Commands:" << std::endl;
     std::cerr << "  --identify                  Get Vehicle VIN" << std::endl;
     std::cerr << "  --program                   Enter Programming Session for OTA" << std::endl;
-    std::cerr << "  --update <file>             Perform OTA update with a file" << std::endl;
-    std::cerr << "  --get-lead-speed            Read lead vehicle speed" << std::endl;
-    std::cerr << "  --get-own-speed             Read own vehicle speed" << std::endl;
-    std::cerr << "  --set-lead-speed <mph>      Set lead vehicle speed" << std::endl;
-    std::cerr << "  --get-gap                   Read ACC following gap" << std::endl;
-    std::cerr << "  --set-gap <cars>            Set ACC following gap" << std::endl;
-    std::cerr << "  --get-kp                    Read ACC Proportional Gain" << std::endl;
-    std::cerr << "  --set-kp <value>            Set ACC Proportional Gain (e.g., 0.4)" << std::endl;
-    std::cerr << "  --get-ki                    Read ACC Integral Gain" << std::endl;
-    std::cerr << "  --set-ki <value>            Set ACC Integral Gain (e.g., 0.1)" << std::endl;
+    std::cerr << "  --metrics                   Print the ECU's runtime metrics (Prometheus text)" << std::endl;
+    std::cerr << "  --update <file> [--window <n>] [--delta <installed>] [--compress]" << std::endl;
+    std::cerr << "                              Perform OTA update with a file, keeping up to n blocks in flight;" << std::endl;
+    std::cerr << "                              --delta sends only a patch against the installed image," << std::endl;
+    std::cerr << "                              --compress deflates the transfer" << std::endl;
+    std::cerr << "  --update <file> --resumable [--chunk-size <bytes>] [--retries <n>] [--window <n>]" << std::endl;
+    std::cerr << "                              Send the image with a chunk manifest so a broken transfer" << std::endl;
+    std::cerr << "                              resumes where it stopped, reconnecting up to n times (default 3)" << std::endl;
+    std::cerr << "  --get <name>[,<name>...]    Read several values in one request (names as in --get-*)" << std::endl;
+    std::cerr << "  --dashboard                 Read every value in one request" << std::endl;
+    std::cerr << "  --stream <name>[,<name>...] [--rate slow|medium|fast] [--count <n>]" << std::endl;
+    std::cerr << "                              Print values pushed by the ECU every 1 s, 100 ms or cycle;" << std::endl;
+    std::cerr << "                              stops after n samples (default: until interrupted)" << std::endl;
+    std::cerr << "  --batch <file|-> [--pipeline <n>] [--json]" << std::endl;
+    std::cerr << "                              Run one command per line (--identify, --program, --get, --dashboard," << std::endl;
+    std::cerr << "                              --get-*, --set-*) over one connection, n requests in flight;" << std::endl;
+    std::cerr << "                              --json prints one JSON object per command" << std::endl;
+    for (const DidInfo& entry : DID_REGISTRY) {
+        std::string get_option = "--get-" + std::string(entry.name);
+        std::cerr << "  " << std::left << std::setw(28) << get_option << std::right << "Read " << entry.description << std::endl;
+        if (entry.access != DidAccess::READ_WRITE) continue;
+        std::string set_option = "--set-" + std::string(entry.name) + " <" + entry.unit + ">";
+        std::cerr << "  " << std::left << std::setw(28) << set_option << std::right
+                  << "Set " << entry.description << " (" << entry.min << " to " << entry.max << ")" << std::endl;
+    }
 }
 
-bool send_and_receive(tcp::socket& socket, uint16_t type, const std::vector<uint8_t>& payload, std::vector<uint8_t>& response_payload) {
-    DoIPHeader header = {0x02, (uint8_t)~0x02, htons(type), htonl((uint32_t)payload.size())};
+// Streams the file as TransferData blocks with up to `window` of them
+// unacknowledged. The ECU acknowledges cumulatively: a 0x76 carrying block
+// counter N covers every block up to and including N. The file is read once,
+// in large aligned chunks that are hashed and then sent in place, so the
+// digest for TransferExit is ready as soon as the last block goes out.
+// With a base image, a delta patch (see ota_delta.hpp) is sent instead and
+// the ECU rebuilds the file from the image it has installed. With compression
+// the stream is deflated chunk by chunk as it is read.
+bool perform_update(tcp::socket& socket, const std::string& file_path, uint8_t window, const std::string& base_path, bool compress) {
+    int fd = ::open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "[CLIENT] ERROR: Could not open file: " << file_path << std::endl;
+        return false;
+    }
+    struct FdCloser { int fd; ~FdCloser() { ::close(fd); } } fd_closer{fd};
+    struct stat st;
+    if (::fstat(fd, &st) != 0) return false;
+    uint32_t file_size = static_cast<uint32_t>(st.st_size);
+
+    uint8_t data_format = OTA_FORMAT_RAW;
+    std::vector<uint8_t> patch;
+    std::optional<std::string> delta_image_hash;
+    if (!base_path.empty()) {
+        std::vector<uint8_t> base, target;
+        if (!read_whole_file(base_path, base) || !read_whole_file(file_path, target)) return false;
+        Sha256Stream target_digest;
+        target_digest.update(target.data(), target.size());
+        delta_image_hash = target_digest.finish_hex();
+        patch = encode_ota_delta(base, target);
+        data_format = OTA_FORMAT_DELTA;
+        std::cout << "[CLIENT] Delta patch is " << patch.size() << " bytes (" << std::fixed << std::setprecision(1)
+                  << (target.empty() ? 0.0 : 100.0 * patch.size() / target.size()) << "% of the image)."
+                  << std::defaultfloat << std::endl;
+    }
+    const size_t stream_size = data_format == OTA_FORMAT_DELTA ? patch.size() : file_size;
+    if (compress) data_format |= OTA_FORMAT_COMPRESSED;
+
+    std::vector<uint8_t> response_payload;
+    std::vector<uint8_t> req_payload = {UDS_REQUEST_DOWNLOAD, data_format, 0x44, 0x00, 0x00, 0x00, 0x00, (uint8_t)(file_size >> 24), (uint8_t)(file_size >> 16), (uint8_t)(file_size >> 8), (uint8_t)file_size, window};
+    if (!send_and_receive(socket, 0x8001, req_payload, response_payload)) return false;
+
+    // 0x74, lengthFormatIdentifier, maxNumberOfBlockLength[n], then the granted window (vendor extension).
+    size_t chunk_size = DEFAULT_TRANSFER_CHUNK_SIZE;
+    uint8_t granted_window = 1;
+    if (response_payload.size() >= 2) {
+        size_t length_bytes = response_payload[1] >> 4;
+        if (length_bytes > 0 && response_payload.size() >= 2 + length_bytes) {
+            size_t max_block_length = 0;
+            for (size_t i = 0; i < length_bytes; ++i) {
+                max_block_length = (max_block_length << 8) | response_payload[2 + i];
+            }
+            if (max_block_length > 2) chunk_size = max_block_length - 2;
+            if (response_payload.size() > 2 + length_bytes) {
+                granted_window = std::max<uint8_t>(1, response_payload[2 + length_bytes]);
+            }
+        }
+    }
+    std::cout << "[CLIENT] Transferring " << stream_size << (compress ? " bytes (before compression) in " : " bytes in ") << chunk_size << "-byte blocks, window "
+              << (int)granted_window << "." << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+    std::deque<uint8_t> unacked; // Block counters sent but not yet acknowledged
+    auto consume_ack = [&]() {
+        uint16_t type = receive_message(socket, response_payload);
+        if (type != 0x8001 || response_payload.size() < 2 || response_payload[0] != 0x76) {
+            std::cerr << "--- FAILED: ECU rejected a TransferData block. ---" << std::endl;
+            return false;
+        }
+        uint8_t acked = response_payload[1];
+        while (!unacked.empty()) {
+            uint8_t counter = unacked.front();
+            unacked.pop_front();
+            if (counter == acked) break;
+        }
+        return true;
+    };
+
+    uint8_t block_counter = 1;
+    size_t transfer_size = 0;
+    auto send_block = [&](const uint8_t* data, size_t length) {
+        while (unacked.size() >= granted_window) {
+            if (!consume_ack()) return false;
+        }
+        send_transfer_block(socket, block_counter, data, length);
+        unacked.push_back(block_counter++);
+        transfer_size += length;
+        return true;
+    };
+    // Cuts the outgoing stream into blocks. Whole blocks go straight from
+    // `data`; a partial tail waits in `pending` for the next call.
+    std::vector<uint8_t> pending;
+    auto send_stream = [&](const uint8_t* data, size_t length, bool last) {
+        if (!pending.empty()) {
+            size_t n = std::min(length, chunk_size - pending.size());
+            pending.insert(pending.end(), data, data + n);
+            data += n;
+            length -= n;
+            if (pending.size() < chunk_size && !last) return true;
+            if (!send_block(pending.data(), pending.size())) return false;
+            pending.clear();
+        }
+        while (length >= chunk_size || (last && length > 0)) {
+            size_t n = std::min(chunk_size, length);
+            if (!send_block(data, n)) return false;
+            data += n;
+            length -= n;
+        }
+        pending.assign(data, data + length);
+        return true;
+    };
+
+    // Whole blocks per read, so only the final read can yield a short block.
+    const size_t read_size = std::max(chunk_size, SHA256_FILE_BUFFER_SIZE / chunk_size * chunk_size);
+    AlignedBuffer buffer = make_aligned_buffer((read_size + SHA256_FILE_BUFFER_ALIGNMENT - 1) / SHA256_FILE_BUFFER_ALIGNMENT * SHA256_FILE_BUFFER_ALIGNMENT);
+    if (!buffer) return false;
+    Sha256Stream digest;
+    std::unique_ptr<OtaDeflater> deflater;
+    std::vector<uint8_t> compressed;
+    if (compress) deflater = std::make_unique<OtaDeflater>();
+    size_t patch_offset = 0;
+    while (true) {
+        size_t filled = 0;
+        if (data_format & OTA_FORMAT_DELTA) {
+            filled = std::min(read_size, patch.size() - patch_offset);
+            std::memcpy(buffer.get(), patch.data() + patch_offset, filled);
+            patch_offset += filled;
+        }
+        while (!(data_format & OTA_FORMAT_DELTA) && filled < read_size) {
+            ssize_t n = ::read(fd, buffer.get() + filled, read_size - filled);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) {
+                std::cerr << "[CLIENT] ERROR: Could not read file: " << file_path << std::endl;
+                return false;
+            }
+            if (n == 0) break;
+            filled += static_cast<size_t>(n);
+        }
+        bool last = filled < read_size;
+        digest.update(buffer.get(), filled);
+        if (deflater) {
+            compressed.clear();
+            if (!deflater->compress(buffer.get(), filled, last, compressed)) {
+                std::cerr << "[CLIENT] ERROR: Compression failed." << std::endl;
+                return false;
+            }
+            if (!send_stream(compressed.data(), compressed.size(), last)) return false;
+        } else if (!send_stream(buffer.get(), filled, last)) {
+            return false;
+        }
+        if (last) break;
+    }
+    // The ECU verifies the image it ends up with, not the bytes on the wire.
+    auto new_firmware_hash_opt = (data_format & OTA_FORMAT_DELTA) ? delta_image_hash : digest.finish_hex();
+    if (!new_firmware_hash_opt) return false;
+
+    // TransferExit's response also acknowledges whatever is still outstanding.
+    std::vector<uint8_t> exit_payload = {UDS_REQUEST_TRANSFER_EXIT};
+    exit_payload.insert(exit_payload.end(), new_firmware_hash_opt->begin(), new_firmware_hash_opt->end());
+    send_message(socket, 0x8001, exit_payload);
+    while (true) {
+        uint16_t type = receive_message(socket, response_payload);
+        if (type == 0x8001 && !response_payload.empty() && response_payload[0] == 0x76) continue;
+        if (type != 0x8001 || response_payload.empty() || response_payload[0] != 0x77) {
+            std::cerr << "--- FAILED: ECU returned a Negative Response. ---" << std::endl;
+            return false;
+        }
+        break;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "[CLIENT] Transferred " << transfer_size << " bytes in " << std::fixed << std::setprecision(3) << seconds
+              << " s (" << std::setprecision(1) << (seconds > 0 ? transfer_size / seconds / 1024.0 : 0.0) << " KiB/s"
+              << (compress ? ", " + std::to_string(100 * transfer_size / std::max<size_t>(1, stream_size)) + "% of the uncompressed stream" : std::string())
+              << ")."
+              << std::defaultfloat << std::endl;
+    std::cout << "--- SUCCESS ---" << std::endl;
+    return true;
+}
+
+// Sends the image as one chunk per TransferData block behind a chunk
+// manifest (see ota_manifest.hpp). Each attempt opens its own connection and
+// starts at the first chunk the ECU still lacks, so a transfer cut off by a
+// broken link continues instead of starting over. Only connection errors are
+// retried; a negative response ends the update.
+bool perform_resumable_update(const std::string& host, const std::string& port, const std::string& file_path,
+                              uint8_t window, uint32_t chunk_size, unsigned retries) {
+    std::vector<uint8_t> image;
+    if (!read_whole_file(file_path, image)) return false;
+    uint32_t file_size = static_cast<uint32_t>(image.size());
+    while ((file_size + uint64_t(chunk_size) - 1) / chunk_size > OTA_MAX_MANIFEST_CHUNKS && chunk_size < OTA_MAX_CHUNK_SIZE) {
+        chunk_size = std::min(chunk_size * 2, OTA_MAX_CHUNK_SIZE);
+    }
+    if ((file_size + uint64_t(chunk_size) - 1) / chunk_size > OTA_MAX_MANIFEST_CHUNKS) {
+        std::cerr << "[CLIENT] ERROR: Image is too large for a chunk manifest." << std::endl;
+        return false;
+    }
+    OtaManifest manifest = OtaManifest::build(image.data(), file_size, chunk_size);
+    std::string root_hex = sha256_digest_hex(manifest.root());
+
+    std::vector<uint8_t> req_payload = {UDS_REQUEST_DOWNLOAD, OTA_FORMAT_MANIFEST, 0x44, 0x00, 0x00, 0x00, 0x00, (uint8_t)(file_size >> 24), (uint8_t)(file_size >> 16), (uint8_t)(file_size >> 8), (uint8_t)file_size, window};
+    manifest.encode(req_payload);
+    std::cout << "[CLIENT] Manifest lists " << manifest.chunk_count() << " chunks of " << chunk_size << " bytes." << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+    size_t transfer_size = 0;
+    for (unsigned attempt = 0;; ++attempt) {
+        try {
+            boost::asio::io_context io_context;
+            tcp::socket socket(io_context);
+            tcp::resolver resolver(io_context);
+            boost::asio::connect(socket, resolver.resolve(host, port));
+            socket.set_option(tcp::no_delay(true));
+
+            std::vector<uint8_t> response_payload;
+            std::vector<uint8_t> program = {UDS_ROUTINE_CONTROL, 0x01, (UDS_ENTER_PROGRAMMING_SESSION >> 8) & 0xFF, UDS_ENTER_PROGRAMMING_SESSION & 0xFF};
+            if (!send_and_receive(socket, 0x8001, program, response_payload)) return false;
+            if (!send_and_receive(socket, 0x8001, req_payload, response_payload)) return false;
+            // 0x74, 0x40, maxNumberOfBlockLength[4], window, first_missing_chunk[4]
+            if (response_payload.size() < 11 || response_payload[1] != 0x40) {
+                std::cerr << "--- FAILED: ECU does not support resumable downloads. ---" << std::endl;
+                return false;
+            }
+            uint8_t granted_window = std::max<uint8_t>(1, response_payload[6]);
+            size_t first_chunk = (size_t(response_payload[7]) << 24) | (size_t(response_payload[8]) << 16) |
+                                 (size_t(response_payload[9]) << 8) | response_payload[10];
+            if (first_chunk > 0) {
+                std::cout << "[CLIENT] Resuming at chunk " << first_chunk << " of " << manifest.chunk_count() << "." << std::endl;
+            }
+
+            std::deque<uint8_t> unacked; // Block counters sent but not yet acknowledged
+            auto consume_ack = [&]() {
+                uint16_t type = receive_message(socket, response_payload);
+                if (type != 0x8001 || response_payload.size() < 2 || response_payload[0] != 0x76) {
+                    std::cerr << "--- FAILED: ECU rejected a TransferData block. ---" << std::endl;
+                    return false;
+                }
+                uint8_t acked = response_payload[1];
+                while (!unacked.empty()) {
+                    uint8_t counter = unacked.front();
+                    unacked.pop_front();
+                    if (counter == acked) break;
+                }
+                return true;
+            };
+            uint8_t block_counter = 1;
+            for (size_t chunk = first_chunk; chunk < manifest.chunk_count(); ++chunk) {
+                while (unacked.size() >= granted_window) {
+                    if (!consume_ack()) return false;
+                }
+                size_t length = manifest.chunk_length(chunk);
+                send_transfer_block(socket, block_counter, image.data() + manifest.chunk_offset(chunk), length);
+                unacked.push_back(block_counter++);
+                transfer_size += length;
+            }
+
+            // TransferExit's response also acknowledges whatever is still outstanding.
+            std::vector<uint8_t> exit_payload = {UDS_REQUEST_TRANSFER_EXIT};
+            exit_payload.insert(exit_payload.end(), root_hex.begin(), root_hex.end());
+            send_message(socket, 0x8001, exit_payload);
+            while (true) {
+                uint16_t type = receive_message(socket, response_payload);
+                if (type == 0x8001 && !response_payload.empty() && response_payload[0] == 0x76) continue;
+                if (type != 0x8001 || response_payload.empty() || response_payload[0] != 0x77) {
+                    std::cerr << "--- FAILED: ECU returned a Negative Response. ---" << std::endl;
+                    return false;
+                }
+                break;
+            }
+            break;
+        } catch (const boost::system::system_error& e) {
+            if (attempt >= retries) {
+                std::cerr << "Client Error: " << e.what() << std::endl;
+                return false;
+            }
+            std::cerr << "[CLIENT] Connection lost (" << e.what() << "), reconnecting (" << attempt + 1 << "/" << retries << ")..." << std::endl;
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "[CLIENT] Transferred " << transfer_size << " bytes in " << std::fixed << std::setprecision(3) << seconds
+              << " s (" << std::setprecision(1) << (seconds > 0 ? transfer_size / seconds / 1024.0 : 0.0) << " KiB/s)."
+              << std::defaultfloat << std::endl;
+    std::cout << "--- SUCCESS ---" << std::endl;
+    return true;
+}
+
+void send_message(tcp::socket& socket, uint16_t type, const std::vector<uint8_t>& payload) {
+    DoIPHeader header = make_doip_header(type, (uint32_t)payload.size());
     std::vector<boost::asio::const_buffer> request_buffers;
     request_buffers.push_back(boost::asio::buffer(&header, sizeof(header)));
     if (!payload.empty()) {
         request_buffers.push_back(boost::asio::buffer(payload));
     }
     boost::asio::write(socket, request_buffers);
+}
+
+bool read_whole_file(const std::string& file_path, std::vector<uint8_t>& contents) {
+    std::ifstream file(file_path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        std::cerr << "[CLIENT] ERROR: Could not open file: " << file_path << std::endl;
+        return false;
+    }
+    contents.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0, std::ios::beg);
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(contents.data()), contents.size())) || contents.empty();
+}
+
+// Reads `dids` with one multi-DID ReadDataByIdentifier and decodes the
+// values in the order the ECU returned them. DIDs the ECU does not support
+// are simply missing from `values`.
+bool read_dids(tcp::socket& socket, const std::vector<const DidInfo*>& dids, std::vector<std::pair<const DidInfo*, float>>& values) {
+    std::vector<uint8_t> response_payload;
+    if (!send_and_receive(socket, 0x8001, build_read_request(dids), response_payload)) return false;
+    return decode_read_response(response_payload, values);
+}
+
+std::vector<uint8_t> build_read_request(const std::vector<const DidInfo*>& dids) {
+    std::vector<uint8_t> payload = {UDS_READ_DATA_BY_IDENTIFIER};
+    for (const DidInfo* entry : dids) {
+        payload.push_back(static_cast<uint8_t>(entry->did >> 8));
+        payload.push_back(static_cast<uint8_t>(entry->did));
+    }
+    return payload;
+}
+
+// Rejects a write the ECU would refuse: a read-only DID or a value outside
+// the DID's registered range.
+bool check_did_write(const DidInfo& entry, float value, std::string& error) {
+    std::ostringstream message;
+    if (entry.access != DidAccess::READ_WRITE) {
+        message << entry.name << " is read-only";
+    } else if (!did_value_in_range(entry, value)) {
+        message << entry.name << " must be between " << entry.min << " and " << entry.max;
+    } else {
+        return true;
+    }
+    error = message.str();
+    return false;
+}
+
+std::vector<uint8_t> build_write_request(const DidInfo& entry, float value) {
+    std::vector<uint8_t> payload = {UDS_WRITE_DATA_BY_IDENTIFIER, (uint8_t)(entry.did >> 8), (uint8_t)entry.did};
+    payload.resize(3 + did_data_length(entry.format.encoding));
+    encode_did_value(entry.format, value, &payload[3]);
+    return payload;
+}
+
+// Decodes a positive ReadDataByIdentifier response (0x62 ...).
+bool decode_read_response(const std::vector<uint8_t>& response_payload, std::vector<std::pair<const DidInfo*, float>>& values) {
+    if (response_payload.empty() || response_payload[0] != 0x62) return false;
+
+    values.clear();
+    size_t offset = 1;
+    while (offset + 2 <= response_payload.size()) {
+        const DidInfo* entry = find_did_info(static_cast<uint16_t>((response_payload[offset] << 8) | response_payload[offset + 1]));
+        if (!entry) {
+            std::cerr << "[CLIENT] ERROR: Response contains an unknown DID." << std::endl;
+            return false;
+        }
+        size_t length = did_data_length(entry->format.encoding);
+        if (offset + 2 + length > response_payload.size()) {
+            std::cerr << "[CLIENT] ERROR: Truncated ReadDataByIdentifier response." << std::endl;
+            return false;
+        }
+        values.emplace_back(entry, decode_did_value(entry->format, &response_payload[offset + 2]));
+        offset += 2 + length;
+    }
+    return true;
+}
+
+// Subscribes to `dids` with ReadDataByPeriodicIdentifier and prints each
+// sample the ECU pushes, with the time since the subscription. After `count`
+// samples (0 = never) the subscription is stopped and any samples already in
+// flight are drained up to the stop confirmation.
+bool stream_dids(tcp::socket& socket, const std::vector<const DidInfo*>& dids, uint8_t mode, uint64_t count) {
+    std::vector<uint8_t> payload = {UDS_READ_DATA_BY_PERIODIC_IDENTIFIER, mode};
+    for (const DidInfo* entry : dids) payload.push_back(entry->periodic_id);
+    std::vector<uint8_t> response_payload;
+    if (!send_and_receive(socket, 0x8001, payload, response_payload)) return false;
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t received = 0; count == 0 || received < count;) {
+        uint16_t type = receive_message(socket, response_payload);
+        if (type != 0x8001 || response_payload.size() < 2 || response_payload[0] != 0x6A) continue;
+        const DidInfo* entry = nullptr;
+        for (const DidInfo* candidate : dids) {
+            if (candidate->periodic_id == response_payload[1]) entry = candidate;
+        }
+        if (!entry || response_payload.size() != 2 + did_data_length(entry->format.encoding)) continue;
+        double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "[CLIENT] " << std::fixed << std::setprecision(1) << std::setw(10) << elapsed_ms << " ms  "
+                  << std::defaultfloat << std::setprecision(6) << std::left << std::setw(12) << entry->name << std::right
+                  << decode_did_value(entry->format, &response_payload[2]) << std::endl;
+        ++received;
+    }
+
+    send_message(socket, 0x8001, {UDS_READ_DATA_BY_PERIODIC_IDENTIFIER, PERIODIC_MODE_STOP});
+    while (true) {
+        uint16_t type = receive_message(socket, response_payload);
+        if (type == 0x8002) return false;
+        if (response_payload.size() == 1 && response_payload[0] == 0x6A) return true;
+    }
+}
+
+// Parses a comma-separated list of value names as used by --get. On failure
+// `unknown` holds the first name that is not a known value.
+bool parse_did_names(const std::string& names, std::vector<const DidInfo*>& dids, std::string& unknown) {
+    std::stringstream stream(names);
+    std::string name;
+    while (std::getline(stream, name, ',')) {
+        const DidInfo* entry = find_did_info(name);
+        if (!entry) {
+            unknown = name;
+            return false;
+        }
+        dids.push_back(entry);
+    }
+    return true;
+}
+
+// Encodes one --batch line. Only commands that are a single request and a
+// single response can be pipelined; --update, --stream and --metrics are not.
+bool parse_batch_command(const std::string& text, BatchCommand& command, std::string& error) {
+    std::istringstream stream(text);
+    std::vector<std::string> words;
+    for (std::string word; stream >> word;) words.push_back(word);
+    const std::string& name = words.front();
+
+    command.payload_type = 0x8001;
+    if (name == "--identify" && words.size() == 1) {
+        command.kind = BatchCommand::Kind::IDENTIFY;
+        command.payload_type = 0x0004;
+    } else if (name == "--program" && words.size() == 1) {
+        command.kind = BatchCommand::Kind::ROUTINE;
+        command.payload = {UDS_ROUTINE_CONTROL, 0x01, (UDS_ENTER_PROGRAMMING_SESSION >> 8) & 0xFF, UDS_ENTER_PROGRAMMING_SESSION & 0xFF};
+    } else if ((name == "--get" && words.size() == 2) || (name == "--dashboard" && words.size() == 1) ||
+               (name.rfind("--get-", 0) == 0 && words.size() == 1)) {
+        std::vector<const DidInfo*> dids;
+        if (name == "--dashboard") {
+            for (const DidInfo& entry : DID_REGISTRY) dids.push_back(&entry);
+        } else if (name == "--get") {
+            std::string unknown;
+            if (!parse_did_names(words[1], dids, unknown)) {
+                error = "unknown value: " + unknown;
+                return false;
+            }
+        } else if (const DidInfo* entry = find_did_info(name.substr(6))) {
+            dids.push_back(entry);
+        } else {
+            error = "unknown value: " + name.substr(6);
+            return false;
+        }
+        command.kind = BatchCommand::Kind::READ;
+        command.payload = build_read_request(dids);
+    } else if (name.rfind("--set-", 0) == 0 && words.size() == 2) {
+        const DidInfo* entry = find_did_info(name.substr(6));
+        if (!entry) {
+            error = "unknown value: " + name.substr(6);
+            return false;
+        }
+        float value;
+        try {
+            value = std::stof(words[1]);
+        } catch (const std::exception&) {
+            error = "invalid number: " + words[1];
+            return false;
+        }
+        if (!check_did_write(*entry, value, error)) return false;
+        command.kind = BatchCommand::Kind::WRITE;
+        command.payload = build_write_request(*entry, value);
+    } else {
+        error = "unsupported command in batch mode: " + text;
+        return false;
+    }
+    return true;
+}
+
+// Runs a --batch script over one connection. The whole script is parsed
+// first, so a typo aborts it before anything is sent rather than leaving a
+// calibration half applied. Up to `pipeline` requests are then kept in
+// flight; the ECU answers a connection's requests in order, so responses
+// are matched to requests first in, first out. A command's time runs from
+// the write of its request to the arrival of its response. Results go to
+// stdout, one line per command (JSON with --json); a summary goes to stderr.
+// Fails if any command failed.
+bool run_batch(tcp::socket& socket, std::istream& input, size_t pipeline, bool json) {
+    std::vector<BatchCommand> commands;
+    bool parsed = true;
+    std::string text;
+    for (size_t line = 1; std::getline(input, text); ++line) {
+        size_t first = text.find_first_not_of(" \t\r");
+        if (first == std::string::npos || text[first] == '#') continue;
+        BatchCommand command;
+        command.line = line;
+        command.text = text.substr(first, text.find_last_not_of(" \t\r") + 1 - first);
+        std::string error;
+        if (!parse_batch_command(command.text, command, error)) {
+            std::cerr << "[CLIENT] ERROR: Line " << line << ": " << error << std::endl;
+            parsed = false;
+            continue;
+        }
+        commands.push_back(std::move(command));
+    }
+    if (!parsed) return false;
+
+    using Clock = std::chrono::steady_clock;
+    std::vector<Clock::time_point> sent_at(commands.size());
+    std::vector<uint8_t> requests;
+    std::vector<uint8_t> response_payload;
+    std::vector<std::pair<const DidInfo*, float>> values;
+    size_t next_to_send = 0;
+    size_t failed = 0;
+    auto batch_start = Clock::now();
+
+    for (size_t done = 0; done < commands.size(); ++done) {
+        // Top up the pipeline with a single write.
+        requests.clear();
+        size_t first_new = next_to_send;
+        for (; next_to_send < commands.size() && next_to_send - done < pipeline; ++next_to_send) {
+            const BatchCommand& command = commands[next_to_send];
+            DoIPHeader header = make_doip_header(command.payload_type, static_cast<uint32_t>(command.payload.size()));
+            const uint8_t* header_bytes = reinterpret_cast<const uint8_t*>(&header);
+            requests.insert(requests.end(), header_bytes, header_bytes + sizeof(header));
+            requests.insert(requests.end(), command.payload.begin(), command.payload.end());
+        }
+        if (!requests.empty()) {
+            Clock::time_point now = Clock::now();
+            std::fill(sent_at.begin() + first_new, sent_at.begin() + next_to_send, now);
+            boost::asio::write(socket, boost::asio::buffer(requests));
+        }
+
+        const BatchCommand& command = commands[done];
+        uint16_t type = receive_message(socket, response_payload);
+        double elapsed_ms = std::chrono::duration<double, std::milli>(Clock::now() - sent_at[done]).count();
+
+        std::string error;
+        std::string result; // Values or VIN, already formatted for the output mode
+        char field[96];
+        if (type == 0x8002) {
+            error = "DoIP negative acknowledgement";
+        } else if (is_negative_response(type, response_payload)) {
+            std::snprintf(field, sizeof(field), "negative response, NRC 0x%02X", response_payload.size() >= 3 ? response_payload[2] : 0);
+            error = field;
+        } else if (command.kind == BatchCommand::Kind::IDENTIFY) {
+            std::string vin(response_payload.begin(), response_payload.end());
+            result = json ? ",\"vin\":\"" + json_escape(vin) + "\"" : "vin=" + vin;
+        } else if (command.kind == BatchCommand::Kind::READ) {
+            if (!decode_read_response(response_payload, values)) {
+                error = "malformed ReadDataByIdentifier response";
+            } else {
+                result = json ? ",\"values\":{" : "";
+                for (size_t i = 0; i < values.size(); ++i) {
+                    std::snprintf(field, sizeof(field), json ? "%s\"%s\":%.9g" : "%s%s=%g",
+                                  i == 0 ? "" : (json ? "," : " "), values[i].first->name, values[i].second);
+                    result += field;
+                }
+                if (json) result += "}";
+            }
+        }
+
+        if (!error.empty()) ++failed;
+        if (json) {
+            std::snprintf(field, sizeof(field), "{\"line\":%zu,\"ok\":%s,\"ms\":%.3f,", command.line,
+                          error.empty() ? "true" : "false", elapsed_ms);
+            std::cout << field << "\"command\":\"" << json_escape(command.text) << "\""
+                      << (error.empty() ? result : ",\"error\":\"" + json_escape(error) + "\"") << "}\n";
+        } else {
+            std::snprintf(field, sizeof(field), "[CLIENT] %4zu %8.3f ms  ", command.line, elapsed_ms);
+            std::cout << field << command.text << "  " << (error.empty() ? "OK" : "FAILED: " + error)
+                      << (result.empty() ? "" : "  " + result) << "\n";
+        }
+    }
+    std::cout.flush();
+
+    double total_ms = std::chrono::duration<double, std::milli>(Clock::now() - batch_start).count();
+    std::cerr << "[CLIENT] Batch: " << commands.size() << " command(s), " << failed << " failed in "
+              << std::fixed << std::setprecision(1) << total_ms << " ms ("
+              << std::setprecision(0) << (total_ms > 0 ? commands.size() * 1000.0 / total_ms : 0.0) << " commands/s)."
+              << std::defaultfloat << std::setprecision(6) << std::endl;
+    return failed == 0;
+}
+
+// Sends a TransferData request straight from `data` without copying it into a payload vector.
+void send_transfer_block(tcp::socket& socket, uint8_t block_counter, const uint8_t* data, size_t length) {
+    DoIPHeader header = make_doip_header(0x8001, (uint32_t)(length + 2));
+    uint8_t prefix[2] = {UDS_TRANSFER_DATA, block_counter};
+    std::array<boost::asio::const_buffer, 3> request_buffers = {
+        boost::asio::buffer(&header, sizeof(header)), boost::asio::buffer(prefix), boost::asio::buffer(data, length)};
+    boost::asio::write(socket, request_buffers);
+}
+
+// Returns the response's payload type.
+uint16_t receive_message(tcp::socket& socket, std::vector<uint8_t>& response_payload) {
     DoIPHeader response_header;
     boost::asio::read(socket, boost::asio::buffer(&response_header, sizeof(response_header)));
     response_header.payload_type = ntohs(response_header.payload_type);
@@ -185,33 +876,16 @@ bool send_and_receive(tcp::socket& socket, uint16_t type, const std::vector<uint
     if (response_header.payload_length > 0) {
         boost::asio::read(socket, boost::asio::buffer(response_payload));
     }
-    if (response_header.payload_type == 0x8002 || (!response_payload.empty() && response_payload[0] == 0x7F)) {
+    return response_header.payload_type;
+}
+
+bool send_and_receive(tcp::socket& socket, uint16_t type, const std::vector<uint8_t>& payload, std::vector<uint8_t>& response_payload) {
+    send_message(socket, type, payload);
+    uint16_t response_type = receive_message(socket, response_payload);
+    if (is_negative_response(response_type, response_payload)) {
         std::cerr << "--- FAILED: ECU returned a Negative Response. ---" << std::endl;
         return false;
     }
     std::cout << "--- SUCCESS ---" << std::endl;
     return true;
 }
-
-std::optional<std::string> calculate_file_hash(const std::string& file_path) {
-    std::ifstream file(file_path, std::ios::binary);
-    if (!file.is_open()) return std::nullopt;
-    EVP_MD_CTX* md_context = EVP_MD_CTX_new();
-    unsigned char hash[EVP_MAX_MD_SIZE];
-    unsigned int hash_len;
-    EVP_DigestInit_ex(md_context, EVP_sha256(), NULL);
-    char buffer[1024];
-    while (file.read(buffer, sizeof(buffer))) {
-        EVP_DigestUpdate(md_context, buffer, file.gcount());
-    }
-    if(file.gcount() > 0) {
-        EVP_DigestUpdate(md_context, buffer, file.gcount());
-    }
-    EVP_DigestFinal_ex(md_context, hash, &hash_len);
-    EVP_MD_CTX_free(md_context);
-    std::stringstream ss;
-    for (unsigned int i = 0; i < hash_len; i++) {
-        ss << std::hex << std::setw(2) << std::setfill('0') << (int)hash[i];
-    }
-    return ss.str();
-}
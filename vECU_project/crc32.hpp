@@ -0,0 +1,33 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Standard CRC-32 (IEEE 802.3, reflected polynomial 0xEDB88320) used to
+// detect torn or corrupted NVRAM records.
+namespace crc32_detail {
+constexpr std::array<uint32_t, 256> make_table() {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) {
+            c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+        }
+        table[i] = c;
+    }
+    return table;
+}
+
+inline constexpr std::array<uint32_t, 256> TABLE = make_table();
+} // namespace crc32_detail
+
+// Pass the previous result as `crc` to checksum data in several pieces.
+inline uint32_t crc32(const void* data, size_t length, uint32_t crc = 0) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < length; ++i) {
+        crc = crc32_detail::TABLE[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <iostream>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+// Settings for the fixed-rate control loop.
+struct CycleSchedulerConfig {
+    std::chrono::nanoseconds period = std::chrono::milliseconds(10);
+    int fifo_priority = 0; // > 0 switches the loop thread to SCHED_FIFO at this priority
+    int cpu = -1;          // >= 0 pins the loop thread to this CPU
+};
+
+// Snapshot of the scheduler's timing statistics. All times in nanoseconds.
+struct CycleStats {
+    uint64_t cycles = 0;
+    uint64_t overruns = 0;       // Cycles whose work finished after the next deadline
+    uint64_t missed_periods = 0; // Deadlines skipped to get back in phase after overruns
+    int64_t last_jitter = 0;     // Wake-up latency past the deadline
+    int64_t max_jitter = 0;
+    int64_t mean_jitter = 0;
+    int64_t last_work = 0;       // Time spent between wake-up and the next wait
+    int64_t max_work = 0;
+};
+
+// Paces a loop at a fixed period using absolute deadlines, so the period does
+// not drift by however long each cycle took. Deadlines that are already in the
+// past when a cycle finishes count as overruns and are skipped rather than
+// replayed back-to-back.
+class CycleScheduler {
+public:
+    explicit CycleScheduler(const CycleSchedulerConfig& config) : m_config(config) {}
+
+    // Applies the real-time settings to the calling thread and arms the first deadline.
+    void start() {
+        apply_thread_settings();
+        m_deadline = now_ns();
+        m_cycle_start = m_deadline;
+    }
+
+    // Sleeps until the next deadline and records this cycle's timing.
+    // Returns true if the cycle's work ran past its deadline.
+    bool wait_next_cycle() {
+        const int64_t period = m_config.period.count();
+        int64_t finished = now_ns();
+        record_max(m_max_work, finished - m_cycle_start);
+        m_last_work.store(finished - m_cycle_start, std::memory_order_relaxed);
+
+        m_deadline += period;
+        bool overran = finished > m_deadline;
+        if (overran) {
+            int64_t behind = (finished - m_deadline) / period + 1;
+            m_deadline += behind * period;
+            m_overruns.fetch_add(1, std::memory_order_relaxed);
+            m_missed_periods.fetch_add(static_cast<uint64_t>(behind), std::memory_order_relaxed);
+        }
+
+        sleep_until_ns(m_deadline);
+
+        m_cycle_start = now_ns();
+        int64_t jitter = m_cycle_start - m_deadline;
+        m_last_jitter.store(jitter, std::memory_order_relaxed);
+        record_max(m_max_jitter, jitter);
+        m_total_jitter.fetch_add(jitter, std::memory_order_relaxed);
+        m_cycles.fetch_add(1, std::memory_order_relaxed);
+        return overran;
+    }
+
+    // Safe to call from any thread.
+    CycleStats stats() const {
+        CycleStats s;
+        s.cycles = m_cycles.load(std::memory_order_relaxed);
+        s.overruns = m_overruns.load(std::memory_order_relaxed);
+        s.missed_periods = m_missed_periods.load(std::memory_order_relaxed);
+        s.last_jitter = m_last_jitter.load(std::memory_order_relaxed);
+        s.max_jitter = m_max_jitter.load(std::memory_order_relaxed);
+        s.mean_jitter = s.cycles ? m_total_jitter.load(std::memory_order_relaxed) / static_cast<int64_t>(s.cycles) : 0;
+        s.last_work = m_last_work.load(std::memory_order_relaxed);
+        s.max_work = m_max_work.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    const CycleSchedulerConfig& config() const { return m_config; }
+
+private:
+    CycleSchedulerConfig m_config;
+    int64_t m_deadline = 0;
+    int64_t m_cycle_start = 0;
+
+    std::atomic<uint64_t> m_cycles{0};
+    std::atomic<uint64_t> m_overruns{0};
+    std::atomic<uint64_t> m_missed_periods{0};
+    std::atomic<int64_t> m_last_jitter{0};
+    std::atomic<int64_t> m_max_jitter{0};
+    std::atomic<int64_t> m_total_jitter{0};
+    std::atomic<int64_t> m_last_work{0};
+    std::atomic<int64_t> m_max_work{0};
+
+    // Only the loop thread writes the maxima, so a plain compare is enough.
+    static void record_max(std::atomic<int64_t>& target, int64_t value) {
+        if (value > target.load(std::memory_order_relaxed)) {
+            target.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    static int64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static void sleep_until_ns(int64_t deadline) {
+#if defined(__linux__)
+        // steady_clock is CLOCK_MONOTONIC on Linux, so its epoch matches here.
+        struct timespec ts;
+        ts.tv_sec = static_cast<time_t>(deadline / 1000000000);
+        ts.tv_nsec = static_cast<long>(deadline % 1000000000);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+        }
+#else
+        std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::nanoseconds(deadline)));
+#endif
+    }
+
+    void apply_thread_settings() {
+#if defined(__linux__)
+        if (m_config.cpu >= 0) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(m_config.cpu, &cpus);
+            int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+            if (rc != 0) {
+                std::cerr << "[SCHED] WARNING: Could not pin to CPU " << m_config.cpu << ": " << std::strerror(rc) << std::endl;
+            }
+        }
+#endif
+        if (m_config.fifo_priority > 0) {
+            sched_param param{};
+            param.sched_priority = m_config.fifo_priority;
+            int rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+            if (rc != 0) {
+                std::cerr << "[SCHED] WARNING: Could not enable SCHED_FIFO: " << std::strerror(rc) << std::endl;
+            }
+        }
+    }
+};
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "nvram_manager.hpp"
+#include "did_codec.hpp"
+#include "did_registry.hpp"
+
+// Maps a registered DID (did_registry.hpp) onto its NVRAM slot, its wire
+// encoding (see did_codec.hpp) and the values a write may store.
+struct DidBinding {
+    uint16_t did;
+    NvramParam param;
+    DidFormat format;
+    float min;
+    float max;
+    bool writable; // Accepted by WriteDataByIdentifier
+};
+
+constexpr bool did_registry_keys_are_numeric() {
+    for (const DidInfo& info : DID_REGISTRY) {
+        auto param = nvram_param_from_key(info.nvram_key);
+        if (!param || NVRAM_PARAMS[static_cast<size_t>(*param)].type == NvramType::STRING) return false;
+    }
+    return true;
+}
+static_assert(did_registry_keys_are_numeric(), "Every DID must name a numeric NVRAM parameter");
+
+constexpr std::array<DidBinding, DID_COUNT> make_did_bindings() {
+    std::array<DidBinding, DID_COUNT> bindings{};
+    for (size_t i = 0; i < DID_COUNT; ++i) {
+        const DidInfo& info = DID_REGISTRY[i];
+        bindings[i] = {info.did, *nvram_param_from_key(info.nvram_key), info.format,
+                       info.min, info.max, info.access == DidAccess::READ_WRITE};
+    }
+    return bindings;
+}
+
+// Indexed like DID_REGISTRY.
+inline constexpr std::array<DidBinding, DID_COUNT> DID_BINDINGS = make_did_bindings();
+
+// Perfect-hash lookup (see find_did_index); nullptr for an unsupported DID.
+inline const DidBinding* find_did_binding(uint16_t data_id) {
+    size_t index = find_did_index(data_id);
+    return index < DID_COUNT ? &DID_BINDINGS[index] : nullptr;
+}
+
+inline float read_did_value(const NVRAMManager& nvram, const DidBinding& binding) {
+    return nvram_param_info(binding.param).type == NvramType::INT
+        ? static_cast<float>(nvram.get_int(binding.param))
+        : nvram.get_float(binding.param);
+}
+
+// Most DIDs accepted in a single ReadDataByIdentifier request.
+const size_t MAX_DIDS_PER_READ = 64;
+
+// Builds the positive response to a ReadDataByIdentifier (0x22) request for
+// any number of DIDs, each answered as DID followed by its encoded value.
+// Unsupported DIDs are left out of the reply; returns false (negative
+// response) only for a malformed request or one with none supported.
+inline bool read_data_by_identifier(const NVRAMManager& nvram, const std::vector<uint8_t>& request, std::vector<uint8_t>& response) {
+    if (request.size() < 3 || (request.size() - 1) % 2 != 0) return false;
+    size_t did_count = (request.size() - 1) / 2;
+    if (did_count > MAX_DIDS_PER_READ) return false;
+
+    response.clear();
+    response.push_back(0x62); // Positive response for 0x22
+    for (size_t i = 0; i < did_count; ++i) {
+        const uint8_t* did_bytes = &request[1 + 2 * i];
+        const DidBinding* binding = find_did_binding((did_bytes[0] << 8) | did_bytes[1]);
+        if (!binding) continue;
+        size_t offset = response.size();
+        response.resize(offset + 2 + did_data_length(binding->format.encoding));
+        response[offset] = did_bytes[0];
+        response[offset + 1] = did_bytes[1];
+        encode_did_value(binding->format, read_did_value(nvram, *binding), &response[offset + 2]);
+    }
+    return response.size() > 1;
+}
+
+// Applies a WriteDataByIdentifier (0x2E) request and builds its positive
+// response. The data record uses the same encoding as the DID's read
+// response and must lie within the DID's registered range. The value is
+// stored in memory only; the caller persists it.
+inline bool write_data_by_identifier(NVRAMManager& nvram, const std::vector<uint8_t>& request, std::vector<uint8_t>& response) {
+    if (request.size() < 3) return false;
+    const DidBinding* binding = find_did_binding(static_cast<uint16_t>((request[1] << 8) | request[2]));
+    if (!binding || !binding->writable || request.size() != 3 + did_data_length(binding->format.encoding)) return false;
+    float value = decode_did_value(binding->format, &request[3]);
+    if (!std::isfinite(value) || value < binding->min || value > binding->max) return false;
+    if (nvram_param_info(binding->param).type == NvramType::INT) {
+        nvram.set_int(binding->param, static_cast<int32_t>(std::lround(value)));
+    } else {
+        nvram.set_float(binding->param, value);
+    }
+
+    response.clear();
+    response.push_back(0x6E);
+    response.push_back(request[1]);
+    response.push_back(request[2]);
+    return true;
+}
+
+// --- Periodic identifiers (ReadDataByPeriodicIdentifier, 0x2A) ---
+// A periodic identifier is the low byte of DID 0xF2xx. Each one streams the
+// value of the registered DID that claims it, encoded the same way.
+struct PeriodicDid {
+    uint8_t periodic_id;
+    uint16_t data_id;
+};
+
+constexpr size_t count_periodic_dids() {
+    size_t count = 0;
+    for (const DidInfo& info : DID_REGISTRY) count += info.periodic_id != 0;
+    return count;
+}
+
+constexpr size_t PERIODIC_DID_COUNT = count_periodic_dids();
+
+constexpr std::array<PeriodicDid, PERIODIC_DID_COUNT> make_periodic_dids() {
+    std::array<PeriodicDid, PERIODIC_DID_COUNT> periodic{};
+    size_t next = 0;
+    for (const DidInfo& info : DID_REGISTRY) {
+        if (info.periodic_id != 0) periodic[next++] = {info.periodic_id, info.did};
+    }
+    return periodic;
+}
+
+inline constexpr std::array<PeriodicDid, PERIODIC_DID_COUNT> PERIODIC_DIDS = make_periodic_dids();
+
+// Periodic identifier -> index into PERIODIC_DIDS + 1; 0 = unknown.
+constexpr std::array<uint8_t, 256> make_periodic_did_index() {
+    std::array<uint8_t, 256> index{};
+    for (size_t i = 0; i < PERIODIC_DID_COUNT; ++i) index[PERIODIC_DIDS[i].periodic_id] = static_cast<uint8_t>(i + 1);
+    return index;
+}
+
+inline constexpr std::array<uint8_t, 256> PERIODIC_DID_INDEX = make_periodic_did_index();
+
+// Index into PERIODIC_DIDS, or nullopt for an unknown periodic identifier.
+inline std::optional<size_t> find_periodic_did(uint8_t periodic_id) {
+    uint8_t slot = PERIODIC_DID_INDEX[periodic_id];
+    if (slot == 0) return std::nullopt;
+    return slot - 1;
+}
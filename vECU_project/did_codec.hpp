@@ -0,0 +1,77 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+// --- DID value encodings ---
+// How a data identifier's value is laid out in ReadDataByIdentifier
+// responses and WriteDataByIdentifier requests. All encodings are
+// big-endian, as is usual for UDS.
+enum class DidEncoding : uint8_t {
+    FLOAT32,      // IEEE 754 single precision
+    INT16_SCALED, // Signed 16-bit, wire = round(value * scale)
+    INT32_SCALED  // Signed 32-bit, wire = round(value * scale)
+};
+
+struct DidFormat {
+    DidEncoding encoding;
+    float scale; // Ignored for FLOAT32
+};
+
+constexpr size_t did_data_length(DidEncoding encoding) {
+    return encoding == DidEncoding::INT16_SCALED ? 2 : 4;
+}
+
+// Rounds value * scale into T's range; NaN encodes as 0.
+template <typename T>
+inline T scale_did_value(float value, float scale) {
+    double scaled = std::round(static_cast<double>(value) * scale);
+    if (std::isnan(scaled)) return 0;
+    return static_cast<T>(std::clamp<double>(scaled, std::numeric_limits<T>::min(), std::numeric_limits<T>::max()));
+}
+
+// Writes the encoded value to `out` and returns the number of bytes written.
+// Scaled values outside the encoding's range saturate instead of wrapping.
+inline size_t encode_did_value(const DidFormat& format, float value, uint8_t* out) {
+    uint32_t bits = 0;
+    switch (format.encoding) {
+        case DidEncoding::FLOAT32:
+            std::memcpy(&bits, &value, sizeof(bits));
+            break;
+        case DidEncoding::INT16_SCALED: {
+            uint16_t raw = static_cast<uint16_t>(scale_did_value<int16_t>(value, format.scale));
+            out[0] = static_cast<uint8_t>(raw >> 8);
+            out[1] = static_cast<uint8_t>(raw);
+            return 2;
+        }
+        case DidEncoding::INT32_SCALED: {
+            bits = static_cast<uint32_t>(scale_did_value<int32_t>(value, format.scale));
+            break;
+        }
+    }
+    out[0] = static_cast<uint8_t>(bits >> 24);
+    out[1] = static_cast<uint8_t>(bits >> 16);
+    out[2] = static_cast<uint8_t>(bits >> 8);
+    out[3] = static_cast<uint8_t>(bits);
+    return 4;
+}
+
+// Reads a value encoded as `format` from `in`, which must hold
+// did_data_length(format.encoding) bytes.
+inline float decode_did_value(const DidFormat& format, const uint8_t* in) {
+    if (format.encoding == DidEncoding::INT16_SCALED) {
+        int16_t raw = static_cast<int16_t>((in[0] << 8) | in[1]);
+        return static_cast<float>(raw / static_cast<double>(format.scale));
+    }
+    uint32_t bits = (static_cast<uint32_t>(in[0]) << 24) | (in[1] << 16) | (in[2] << 8) | in[3];
+    if (format.encoding == DidEncoding::FLOAT32) {
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+    return static_cast<float>(static_cast<int32_t>(bits) / static_cast<double>(format.scale));
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+
+#include "did_codec.hpp"
+
+// --- DID registry ---
+// The single list of data identifiers. The ECU binds each one to its NVRAM
+// parameter (did_bindings.hpp); doip_client derives its --get-*/--set-*
+// options, value names and help text from it; doip_bench takes its DIDs from
+// it. Adding a DID is one line in DID_REGISTRY (plus the NVRAM parameter it
+// stores, if new), and both sides pick it up on the next build.
+// Inconsistent entries fail to compile.
+
+// Data Identifiers (DIDs)
+constexpr uint16_t DID_LEAD_VEHICLE_SPEED = 0xF101;
+constexpr uint16_t DID_OWN_VEHICLE_SPEED = 0xF103;
+constexpr uint16_t DID_ACC_GAP_SETTING = 0xF102;
+constexpr uint16_t DID_ACC_KP = 0xD101;
+constexpr uint16_t DID_ACC_KI = 0xD102;
+constexpr uint16_t DID_ACC_MAX_ACCEL = 0xD103;
+constexpr uint16_t DID_ACC_MAX_DECEL = 0xD104;
+
+enum class DidAccess : uint8_t {
+    READ,      // ReadDataByIdentifier and periodic reads only
+    READ_WRITE // Also accepted by WriteDataByIdentifier
+};
+
+struct DidInfo {
+    uint16_t did;
+    const char* name;      // Used by --get-<name>, --set-<name>, --get and --stream
+    const char* nvram_key; // NVRAM_PARAMS key the ECU stores the value under
+    DidFormat format;      // Wire encoding (see did_codec.hpp)
+    float min;             // Values WriteDataByIdentifier accepts
+    float max;
+    DidAccess access;
+    uint8_t periodic_id;     // ReadDataByPeriodicIdentifier id (DID 0xF2xx); 0 = none
+    const char* unit;        // Placeholder in the --set-<name> help
+    const char* description; // Help text
+};
+
+// Order is the order of --dashboard.
+inline constexpr DidInfo DID_REGISTRY[] = {
+    // DID                    name          NVRAM key             encoding                              min    max     access                  periodic unit     description
+    {DID_LEAD_VEHICLE_SPEED, "lead-speed", "LEAD_VEHICLE_SPEED", {DidEncoding::INT16_SCALED, 100.0f},  0.0f, 200.0f, DidAccess::READ_WRITE, 0x01, "mph",   "lead vehicle speed"},
+    {DID_OWN_VEHICLE_SPEED,  "own-speed",  "OWN_VEHICLE_SPEED",  {DidEncoding::INT16_SCALED, 100.0f},  0.0f, 200.0f, DidAccess::READ,       0x03, "mph",   "own vehicle speed"},
+    {DID_ACC_GAP_SETTING,    "gap",        "ACC_GAP_SETTING",    {DidEncoding::INT16_SCALED, 1.0f},    1.0f, 4.0f,   DidAccess::READ_WRITE, 0x02, "cars",  "ACC following gap"},
+    {DID_ACC_KP,             "kp",         "ACC_KP",             {DidEncoding::FLOAT32, 1.0f},         0.0f, 10.0f,  DidAccess::READ_WRITE, 0x11, "value", "ACC proportional gain"},
+    {DID_ACC_KI,             "ki",         "ACC_KI",             {DidEncoding::FLOAT32, 1.0f},         0.0f, 10.0f,  DidAccess::READ_WRITE, 0x12, "value", "ACC integral gain"},
+    {DID_ACC_MAX_ACCEL,      "max-accel",  "ACC_MAX_ACCEL",      {DidEncoding::INT32_SCALED, 1000.0f}, 0.0f, 20.0f,  DidAccess::READ_WRITE, 0x13, "mph",   "ACC max speed increase per cycle"},
+    {DID_ACC_MAX_DECEL,      "max-decel",  "ACC_MAX_DECEL",      {DidEncoding::INT32_SCALED, 1000.0f}, 0.0f, 20.0f,  DidAccess::READ_WRITE, 0x14, "mph",   "ACC max speed decrease per cycle"},
+};
+
+constexpr size_t DID_COUNT = std::size(DID_REGISTRY);
+
+// --- Compile-time validation ---
+constexpr bool did_names_equal(const char* a, const char* b) {
+    return std::string_view(a) == std::string_view(b);
+}
+
+constexpr bool did_registry_is_unique() {
+    for (size_t i = 0; i < DID_COUNT; ++i) {
+        for (size_t j = i + 1; j < DID_COUNT; ++j) {
+            const DidInfo& a = DID_REGISTRY[i];
+            const DidInfo& b = DID_REGISTRY[j];
+            if (a.did == b.did || did_names_equal(a.name, b.name) || did_names_equal(a.nvram_key, b.nvram_key)) return false;
+            if (a.periodic_id != 0 && a.periodic_id == b.periodic_id) return false;
+        }
+    }
+    return true;
+}
+
+// Names end up in comma-separated lists and in option names.
+constexpr bool did_name_is_valid(std::string_view name) {
+    if (name.empty()) return false;
+    for (char c : name) {
+        if (!((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-')) return false;
+    }
+    return true;
+}
+
+// The whole range must survive the wire encoding without saturating.
+constexpr bool did_range_is_encodable(const DidInfo& info) {
+    if (!(info.min <= info.max)) return false;
+    double limit = info.format.encoding == DidEncoding::INT16_SCALED ? std::numeric_limits<int16_t>::max()
+                 : info.format.encoding == DidEncoding::INT32_SCALED ? std::numeric_limits<int32_t>::max()
+                 : std::numeric_limits<float>::max();
+    double scale = info.format.encoding == DidEncoding::FLOAT32 ? 1.0 : info.format.scale;
+    return scale > 0 && info.max * scale <= limit && -info.min * scale <= limit;
+}
+
+constexpr bool did_registry_is_valid() {
+    for (const DidInfo& info : DID_REGISTRY) {
+        if (!did_name_is_valid(info.name) || !did_range_is_encodable(info)) return false;
+    }
+    return true;
+}
+
+static_assert(DID_COUNT > 0 && DID_COUNT < 255, "Slots in the DID hash table are one byte");
+static_assert(did_registry_is_unique(), "Every DID, name, NVRAM key and periodic id must be unique");
+static_assert(did_registry_is_valid(), "DID names must be [a-z0-9-]+ and ranges must fit their encoding");
+
+// --- Lookup ---
+// A multiplicative perfect hash found at compile time: every registered DID
+// lands in its own slot, so a lookup is one multiply, one table load and one
+// compare, whatever the DID. Empty slots point at entry 0, whose DID then
+// fails the compare.
+constexpr unsigned did_hash_bits() {
+    unsigned bits = 1;
+    while ((size_t(1) << bits) < 2 * DID_COUNT) ++bits;
+    return bits;
+}
+
+constexpr unsigned DID_HASH_BITS = did_hash_bits();
+constexpr size_t DID_HASH_SIZE = size_t(1) << DID_HASH_BITS;
+
+constexpr size_t did_hash_slot(uint16_t did, uint32_t multiplier) {
+    return static_cast<uint32_t>(did * multiplier) >> (32 - DID_HASH_BITS);
+}
+
+constexpr uint32_t find_did_hash_multiplier() {
+    uint32_t multiplier = 0x9E3779B1u;
+    for (int attempt = 0; attempt < 100000; ++attempt, multiplier += 2) {
+        std::array<bool, DID_HASH_SIZE> used{};
+        bool collision = false;
+        for (size_t i = 0; i < DID_COUNT && !collision; ++i) {
+            size_t slot = did_hash_slot(DID_REGISTRY[i].did, multiplier);
+            collision = used[slot];
+            used[slot] = true;
+        }
+        if (!collision) return multiplier;
+    }
+    return 0;
+}
+
+constexpr uint32_t DID_HASH_MULTIPLIER = find_did_hash_multiplier();
+static_assert(DID_HASH_MULTIPLIER != 0, "No perfect hash found for DID_REGISTRY; raise DID_HASH_BITS");
+
+constexpr std::array<uint8_t, DID_HASH_SIZE> make_did_hash_table() {
+    std::array<uint8_t, DID_HASH_SIZE> slots{};
+    for (size_t i = 0; i < DID_COUNT; ++i) slots[did_hash_slot(DID_REGISTRY[i].did, DID_HASH_MULTIPLIER)] = static_cast<uint8_t>(i);
+    return slots;
+}
+
+inline constexpr std::array<uint8_t, DID_HASH_SIZE> DID_HASH_TABLE = make_did_hash_table();
+
+// Index into DID_REGISTRY, or DID_COUNT for an unknown DID.
+constexpr size_t find_did_index(uint16_t did) {
+    size_t index = DID_HASH_TABLE[did_hash_slot(did, DID_HASH_MULTIPLIER)];
+    return DID_REGISTRY[index].did == did ? index : DID_COUNT;
+}
+
+constexpr const DidInfo* find_did_info(uint16_t did) {
+    size_t index = find_did_index(did);
+    return index < DID_COUNT ? &DID_REGISTRY[index] : nullptr;
+}
+
+constexpr const DidInfo* find_did_info(std::string_view name) {
+    for (const DidInfo& info : DID_REGISTRY) {
+        if (name == info.name) return &info;
+    }
+    return nullptr;
+}
+
+constexpr bool did_lookup_is_exact() {
+    for (size_t i = 0; i < DID_COUNT; ++i) {
+        if (find_did_index(DID_REGISTRY[i].did) != i) return false;
+    }
+    return true;
+}
+static_assert(did_lookup_is_exact(), "DID hash table is inconsistent");
+
+// True if `value` may be written to the DID.
+constexpr bool did_value_in_range(const DidInfo& info, float value) {
+    return value >= info.min && value <= info.max;
+}
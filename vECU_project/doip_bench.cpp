@@ -0,0 +1,457 @@
+// doip_bench: load generator for the ECU's DoIP server. Opens a number of
+// concurrent connections and drives a weighted mix of vehicle identification,
+// ReadDataByIdentifier, WriteDataByIdentifier and complete OTA transfers,
+// either as fast as the ECU answers or at a fixed aggregate request rate.
+// Reports throughput and latency percentiles per operation as text and,
+// optionally, JSON.
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <optional>
+#include <cstring>
+#include <array>
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <boost/asio.hpp>
+
+#include "doip_protocol.hpp"
+#include "did_codec.hpp"
+#include "did_registry.hpp"
+#include "latency_histogram.hpp"
+#include "sha256_stream.hpp"
+
+using boost::asio::ip::tcp;
+using BenchClock = std::chrono::steady_clock;
+
+// DIDs exercised by the read and write operations (see did_registry.hpp).
+constexpr uint16_t BENCH_READ_DID = DID_OWN_VEHICLE_SPEED;
+constexpr uint16_t BENCH_WRITE_DID = DID_ACC_KP; // Rewritten with its current value
+constexpr DidFormat BENCH_WRITE_FORMAT = find_did_info(BENCH_WRITE_DID)->format;
+static_assert(find_did_info(BENCH_WRITE_DID)->access == DidAccess::READ_WRITE, "The write benchmark needs a writable DID");
+
+enum BenchOp { OP_IDENTIFY, OP_READ, OP_WRITE, OP_OTA, OP_COUNT };
+const char* const BENCH_OP_NAMES[OP_COUNT] = {"identify", "read", "write", "ota"};
+
+struct BenchOptions {
+    std::string host = "localhost";
+    std::string port = "13400";
+    unsigned connections = 8;
+    double rate = 0;         // Aggregate requests per second; 0 = closed loop
+    double duration_s = 10;
+    unsigned mix[OP_COUNT] = {1, 8, 1, 0};
+    std::string ota_image;
+    std::string json_path;   // "-" = stdout
+};
+
+struct BenchStats {
+    LatencyHistogram latency; // Successful operations only
+    uint64_t errors = 0;
+};
+
+// State shared by every connection. Everything runs on one io_context thread.
+struct Bench {
+    boost::asio::io_context io_context;
+    BenchOptions options;
+    tcp::resolver::results_type endpoints;
+    BenchClock::time_point start;
+    BenchClock::time_point stop;
+    BenchClock::time_point last_completion;
+    BenchStats stats[OP_COUNT];
+    std::mt19937 rng{12345};
+    std::discrete_distribution<int> op_distribution;
+    std::vector<uint8_t> write_payload;
+    std::vector<uint8_t> ota_image;
+    std::string ota_image_hash;
+    bool ota_busy = false; // The ECU stages one download at a time
+    uint64_t ota_substituted = 0;
+};
+
+// One tester connection. Issues one operation at a time; with a target rate
+// each operation has an intended start time and its latency is measured from
+// then, so time spent queued behind a slow response is not hidden.
+class BenchConnection : public std::enable_shared_from_this<BenchConnection> {
+public:
+    BenchConnection(Bench& bench, unsigned index)
+        : m_bench(bench), m_socket(bench.io_context), m_timer(bench.io_context) {
+        if (bench.options.rate > 0) {
+            m_interval = std::chrono::duration_cast<BenchClock::duration>(
+                std::chrono::duration<double>(bench.options.connections / bench.options.rate));
+            // Spread the connections' schedules evenly over one interval.
+            m_intended = bench.start + m_interval * index / bench.options.connections;
+        }
+    }
+
+    void start() {
+        auto self = shared_from_this();
+        boost::asio::async_connect(m_socket, m_bench.endpoints,
+            [this, self](const boost::system::error_code& ec, const tcp::endpoint&) {
+                if (ec) {
+                    std::cerr << "[BENCH] Connect failed: " << ec.message() << std::endl;
+                    return;
+                }
+                m_socket.set_option(tcp::no_delay(true));
+                schedule_next();
+            });
+    }
+
+private:
+    void schedule_next() {
+        auto now = BenchClock::now();
+        if (now >= m_bench.stop) {
+            boost::system::error_code ignored;
+            m_socket.close(ignored);
+            return;
+        }
+        if (m_bench.options.rate <= 0) {
+            m_intended = now;
+            begin_operation();
+            return;
+        }
+        auto self = shared_from_this();
+        m_timer.expires_at(m_intended);
+        m_timer.async_wait([this, self](const boost::system::error_code& ec) {
+            if (!ec) begin_operation();
+        });
+    }
+
+    void begin_operation() {
+        m_op = static_cast<BenchOp>(m_bench.op_distribution(m_bench.rng));
+        if (m_op == OP_OTA && m_bench.ota_busy) {
+            m_op = OP_READ;
+            ++m_bench.ota_substituted;
+        }
+        switch (m_op) {
+            case OP_IDENTIFY:
+                exchange(0x0004, {}, [this](bool ok) { finish_operation(ok); });
+                break;
+            case OP_READ:
+                exchange(0x8001, {UDS_READ_DATA_BY_IDENTIFIER, BENCH_READ_DID >> 8, BENCH_READ_DID & 0xFF},
+                         [this](bool ok) { finish_operation(ok && m_response[0] == 0x62); });
+                break;
+            case OP_WRITE:
+                exchange(0x8001, m_bench.write_payload, [this](bool ok) { finish_operation(ok && m_response[0] == 0x6E); });
+                break;
+            default:
+                begin_ota();
+                break;
+        }
+    }
+
+    void finish_operation(bool ok) {
+        auto now = BenchClock::now();
+        BenchStats& stats = m_bench.stats[m_op];
+        if (ok) {
+            stats.latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - m_intended).count());
+        } else {
+            ++stats.errors;
+        }
+        m_bench.last_completion = now;
+        m_intended += m_interval;
+        schedule_next();
+    }
+
+    // --- OTA: programming session, RequestDownload, stop-and-wait TransferData, TransferExit ---
+    void begin_ota() {
+        m_bench.ota_busy = true;
+        exchange(0x8001, {UDS_ROUTINE_CONTROL, 0x01, UDS_ENTER_PROGRAMMING_SESSION >> 8, UDS_ENTER_PROGRAMMING_SESSION & 0xFF},
+            [this](bool ok) {
+                if (!ok) return finish_ota(false);
+                uint32_t size = static_cast<uint32_t>(m_bench.ota_image.size());
+                exchange(0x8001, {UDS_REQUEST_DOWNLOAD, 0x00, 0x44, 0x00, 0x00, 0x00, 0x00,
+                                  static_cast<uint8_t>(size >> 24), static_cast<uint8_t>(size >> 16),
+                                  static_cast<uint8_t>(size >> 8), static_cast<uint8_t>(size)},
+                    [this](bool ok) {
+                        if (!ok || m_response.size() < 6 || m_response[0] != 0x74) return finish_ota(false);
+                        uint32_t max_block_length = (uint32_t(m_response[2]) << 24) | (m_response[3] << 16) |
+                                                    (m_response[4] << 8) | m_response[5];
+                        m_ota_chunk = max_block_length > 2 ? max_block_length - 2 : 4096;
+                        m_ota_offset = 0;
+                        m_ota_block_counter = 1;
+                        send_ota_block();
+                    });
+            });
+    }
+
+    void send_ota_block() {
+        if (m_ota_offset >= m_bench.ota_image.size()) {
+            std::vector<uint8_t> exit_payload = {UDS_REQUEST_TRANSFER_EXIT};
+            exit_payload.insert(exit_payload.end(), m_bench.ota_image_hash.begin(), m_bench.ota_image_hash.end());
+            exchange(0x8001, exit_payload, [this](bool ok) { finish_ota(ok && m_response[0] == 0x77); });
+            return;
+        }
+        size_t length = std::min(m_ota_chunk, m_bench.ota_image.size() - m_ota_offset);
+        m_request.assign({UDS_TRANSFER_DATA, m_ota_block_counter++});
+        m_request.insert(m_request.end(), m_bench.ota_image.begin() + m_ota_offset,
+                         m_bench.ota_image.begin() + m_ota_offset + length);
+        m_ota_offset += length;
+        send_request(0x8001, [this](bool ok) {
+            if (!ok || m_response[0] != 0x76) return finish_ota(false);
+            send_ota_block();
+        });
+    }
+
+    void finish_ota(bool ok) {
+        m_bench.ota_busy = false;
+        finish_operation(ok);
+    }
+
+    // --- Request/response plumbing ---
+    template <typename Done>
+    void exchange(uint16_t payload_type, std::vector<uint8_t> payload, Done done) {
+        m_request = std::move(payload);
+        send_request(payload_type, std::move(done));
+    }
+
+    // Sends m_request and reads one response into m_response. `done(false)`
+    // means a negative response; transport errors end the connection.
+    template <typename Done>
+    void send_request(uint16_t payload_type, Done done) {
+        auto self = shared_from_this();
+        m_request_header = make_doip_header(payload_type, static_cast<uint32_t>(m_request.size()));
+        std::array<boost::asio::const_buffer, 2> buffers = {
+            boost::asio::buffer(&m_request_header, sizeof(DoIPHeader)), boost::asio::buffer(m_request)};
+        boost::asio::async_write(m_socket, buffers, [this, self, done](const boost::system::error_code& ec, std::size_t) {
+            if (ec) return fail(ec);
+            boost::asio::async_read(m_socket, boost::asio::buffer(&m_response_header, sizeof(DoIPHeader)),
+                [this, self, done](const boost::system::error_code& ec, std::size_t) {
+                    if (ec) return fail(ec);
+                    m_response.resize(ntohl(m_response_header.payload_length));
+                    boost::asio::async_read(m_socket, boost::asio::buffer(m_response),
+                        [this, self, done](const boost::system::error_code& ec, std::size_t) mutable {
+                            if (ec) return fail(ec);
+                            uint16_t type = ntohs(m_response_header.payload_type);
+                            // Keep m_response[0] valid for the callers' checks.
+                            if (m_response.empty()) m_response.push_back(0);
+                            done(!is_negative_response(type, m_response));
+                        });
+                });
+        });
+    }
+
+    void fail(const boost::system::error_code& ec) {
+        std::cerr << "[BENCH] Connection lost during " << BENCH_OP_NAMES[m_op] << ": " << ec.message() << std::endl;
+        ++m_bench.stats[m_op].errors;
+        if (m_op == OP_OTA) m_bench.ota_busy = false;
+        boost::system::error_code ignored;
+        m_socket.close(ignored);
+        m_timer.cancel();
+    }
+
+    Bench& m_bench;
+    tcp::socket m_socket;
+    boost::asio::steady_timer m_timer;
+    BenchClock::duration m_interval{0};
+    BenchClock::time_point m_intended;
+    BenchOp m_op = OP_IDENTIFY;
+    DoIPHeader m_request_header;
+    DoIPHeader m_response_header;
+    std::vector<uint8_t> m_request;
+    std::vector<uint8_t> m_response;
+    size_t m_ota_offset = 0;
+    size_t m_ota_chunk = 0;
+    uint8_t m_ota_block_counter = 1;
+};
+
+void print_usage() {
+    std::cerr << "Usage: doip_bench [options]" << std::endl;
+    std::cerr << "  --host <name>               ECU address (default localhost)" << std::endl;
+    std::cerr << "  --port <port>               DoIP port (default 13400)" << std::endl;
+    std::cerr << "  --connections <n>           Concurrent tester connections (default 8)" << std::endl;
+    std::cerr << "  --rate <req/s>              Aggregate target rate; 0 = as fast as possible (default 0)" << std::endl;
+    std::cerr << "  --duration <s>              Length of the run (default 10)" << std::endl;
+    std::cerr << "  --mix identify=1,read=8,write=1,ota=0" << std::endl;
+    std::cerr << "                              Relative weights of each operation; OTA needs --ota-image," << std::endl;
+    std::cerr << "                              and only one OTA runs at a time (others become reads)" << std::endl;
+    std::cerr << "  --ota-image <file>          Image sent by OTA operations; it is installed on the ECU," << std::endl;
+    std::cerr << "                              so pass the library the ECU already runs" << std::endl;
+    std::cerr << "  --json <file|->             Also write the results as JSON" << std::endl;
+}
+
+bool parse_mix(const std::string& text, unsigned (&mix)[OP_COUNT]) {
+    std::fill(std::begin(mix), std::end(mix), 0u);
+    std::stringstream entries(text);
+    std::string entry;
+    while (std::getline(entries, entry, ',')) {
+        size_t equals = entry.find('=');
+        if (equals == std::string::npos) return false;
+        std::string name = entry.substr(0, equals);
+        auto op = std::find(std::begin(BENCH_OP_NAMES), std::end(BENCH_OP_NAMES), name);
+        if (op == std::end(BENCH_OP_NAMES)) return false;
+        // Digits only: std::stoul would accept "-1" and wrap it to a huge weight.
+        std::string weight = entry.substr(equals + 1);
+        auto is_digit = [](char c) { return c >= '0' && c <= '9'; };
+        if (weight.empty() || !std::all_of(weight.begin(), weight.end(), is_digit)) return false;
+        unsigned long value = std::stoul(weight);
+        if (value > std::numeric_limits<unsigned>::max()) return false;
+        mix[op - std::begin(BENCH_OP_NAMES)] = static_cast<unsigned>(value);
+    }
+    return std::any_of(std::begin(mix), std::end(mix), [](unsigned weight) { return weight > 0; });
+}
+
+bool parse_command_line(int argc, char* argv[], BenchOptions& options) {
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string option = argv[i];
+            if (i + 1 >= argc) { print_usage(); return false; }
+            std::string value = argv[++i];
+            if (option == "--host") options.host = value;
+            else if (option == "--port") options.port = value;
+            else if (option == "--connections") options.connections = std::max(1, std::stoi(value));
+            else if (option == "--rate") options.rate = std::max(0.0, std::stod(value));
+            else if (option == "--duration") options.duration_s = std::max(0.1, std::stod(value));
+            else if (option == "--ota-image") options.ota_image = value;
+            else if (option == "--json") options.json_path = value;
+            else if (option == "--mix") {
+                if (!parse_mix(value, options.mix)) {
+                    std::cerr << "[BENCH] Invalid --mix: " << value << std::endl;
+                    return false;
+                }
+            } else { print_usage(); return false; }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "[BENCH] Invalid argument: " << e.what() << std::endl;
+        return false;
+    }
+    if (options.mix[OP_OTA] > 0 && options.ota_image.empty()) {
+        std::cerr << "[BENCH] An OTA weight needs --ota-image." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Reads the current Kp over a blocking connection so write operations can
+// store it back unchanged and leave the ECU's behaviour as it was.
+bool prepare_write_payload(Bench& bench) {
+    tcp::socket socket(bench.io_context);
+    boost::asio::connect(socket, bench.endpoints);
+    std::vector<uint8_t> request = {UDS_READ_DATA_BY_IDENTIFIER, BENCH_WRITE_DID >> 8, BENCH_WRITE_DID & 0xFF};
+    DoIPHeader header = make_doip_header(0x8001, static_cast<uint32_t>(request.size()));
+    std::array<boost::asio::const_buffer, 2> buffers = {boost::asio::buffer(&header, sizeof(header)), boost::asio::buffer(request)};
+    boost::asio::write(socket, buffers);
+    boost::asio::read(socket, boost::asio::buffer(&header, sizeof(header)));
+    std::vector<uint8_t> response(ntohl(header.payload_length));
+    boost::asio::read(socket, boost::asio::buffer(response));
+    size_t length = did_data_length(BENCH_WRITE_FORMAT.encoding);
+    if (is_negative_response(ntohs(header.payload_type), response) || response.size() != 3 + length) {
+        std::cerr << "[BENCH] Could not read the current value of DID 0x" << std::hex << BENCH_WRITE_DID << std::dec << std::endl;
+        return false;
+    }
+    bench.write_payload = {UDS_WRITE_DATA_BY_IDENTIFIER, BENCH_WRITE_DID >> 8, BENCH_WRITE_DID & 0xFF};
+    bench.write_payload.insert(bench.write_payload.end(), response.begin() + 3, response.end());
+    return true;
+}
+
+double to_us(uint64_t ns) { return ns / 1000.0; }
+
+void print_text_report(const Bench& bench, const LatencyHistogram& total, uint64_t total_errors, double elapsed_s) {
+    const BenchOptions& options = bench.options;
+    std::cout << "[BENCH] " << options.connections << " connection(s), " << elapsed_s << " s, ";
+    if (options.rate > 0) std::cout << "target " << options.rate << " req/s" << std::endl;
+    else std::cout << "closed loop" << std::endl;
+    std::cout << std::left << std::setw(10) << "op" << std::right << std::setw(10) << "count" << std::setw(8) << "errors"
+              << std::setw(11) << "req/s" << std::setw(11) << "mean_us" << std::setw(11) << "p50_us" << std::setw(11) << "p99_us"
+              << std::setw(11) << "p999_us" << std::setw(11) << "max_us" << std::endl;
+    auto row = [&](const char* name, const LatencyHistogram& latency, uint64_t errors) {
+        std::cout << std::left << std::setw(10) << name << std::right << std::setw(10) << latency.count() << std::setw(8) << errors
+                  << std::fixed << std::setprecision(1) << std::setw(11) << latency.count() / elapsed_s
+                  << std::setw(11) << to_us(static_cast<uint64_t>(latency.mean())) << std::setw(11) << to_us(latency.percentile(50))
+                  << std::setw(11) << to_us(latency.percentile(99)) << std::setw(11) << to_us(latency.percentile(99.9))
+                  << std::setw(11) << to_us(latency.max()) << std::defaultfloat << std::setprecision(6) << std::endl;
+    };
+    for (int op = 0; op < OP_COUNT; ++op) {
+        if (options.mix[op] > 0 || bench.stats[op].latency.count() > 0) row(BENCH_OP_NAMES[op], bench.stats[op].latency, bench.stats[op].errors);
+    }
+    row("total", total, total_errors);
+    if (bench.ota_substituted > 0) {
+        std::cout << "[BENCH] " << bench.ota_substituted << " OTA operation(s) ran as reads while another OTA was in progress." << std::endl;
+    }
+}
+
+void write_json_report(std::ostream& out, const Bench& bench, const LatencyHistogram& total, uint64_t total_errors, double elapsed_s) {
+    const BenchOptions& options = bench.options;
+    auto entry = [&](const char* name, const LatencyHistogram& latency, uint64_t errors) {
+        out << "    \"" << name << "\": {\"count\": " << latency.count() << ", \"errors\": " << errors
+            << ", \"throughput\": " << latency.count() / elapsed_s
+            << ", \"latency_us\": {\"mean\": " << latency.mean() / 1000.0 << ", \"p50\": " << to_us(latency.percentile(50))
+            << ", \"p99\": " << to_us(latency.percentile(99)) << ", \"p999\": " << to_us(latency.percentile(99.9))
+            << ", \"max\": " << to_us(latency.max()) << "}}";
+    };
+    out << std::defaultfloat << std::setprecision(9);
+    out << "{\n  \"config\": {\"host\": \"" << json_escape(options.host) << "\", \"port\": \"" << json_escape(options.port)
+        << "\", \"connections\": " << options.connections << ", \"rate\": " << options.rate
+        << ", \"duration_s\": " << options.duration_s << ", \"mix\": {";
+    for (int op = 0; op < OP_COUNT; ++op) {
+        out << (op ? ", " : "") << "\"" << BENCH_OP_NAMES[op] << "\": " << options.mix[op];
+    }
+    out << "}},\n  \"elapsed_s\": " << elapsed_s << ",\n  \"ota_substituted\": " << bench.ota_substituted
+        << ",\n  \"operations\": {\n";
+    for (int op = 0; op < OP_COUNT; ++op) {
+        entry(BENCH_OP_NAMES[op], bench.stats[op].latency, bench.stats[op].errors);
+        out << ",\n";
+    }
+    entry("total", total, total_errors);
+    out << "\n  }\n}" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    Bench bench;
+    if (!parse_command_line(argc, argv, bench.options)) return 1;
+    const BenchOptions& options = bench.options;
+    bench.op_distribution = std::discrete_distribution<int>(std::begin(options.mix), std::end(options.mix));
+
+    try {
+        tcp::resolver resolver(bench.io_context);
+        bench.endpoints = resolver.resolve(options.host, options.port);
+        if (options.mix[OP_WRITE] > 0 && !prepare_write_payload(bench)) return 1;
+        if (options.mix[OP_OTA] > 0) {
+            std::ifstream file(options.ota_image, std::ios::binary);
+            auto hash = sha256_file_hex(options.ota_image);
+            if (!file.is_open() || !hash) {
+                std::cerr << "[BENCH] Could not read OTA image: " << options.ota_image << std::endl;
+                return 1;
+            }
+            bench.ota_image.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            bench.ota_image_hash = *hash;
+        }
+
+        bench.start = BenchClock::now();
+        bench.stop = bench.start + std::chrono::duration_cast<BenchClock::duration>(std::chrono::duration<double>(options.duration_s));
+        bench.last_completion = bench.start;
+        for (unsigned i = 0; i < options.connections; ++i) {
+            std::make_shared<BenchConnection>(bench, i)->start();
+        }
+        bench.io_context.run();
+    } catch (const std::exception& e) {
+        std::cerr << "[BENCH] Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    double elapsed_s = std::chrono::duration<double>(bench.last_completion - bench.start).count();
+    if (elapsed_s <= 0) elapsed_s = options.duration_s;
+    LatencyHistogram total;
+    uint64_t total_errors = 0;
+    for (const BenchStats& stats : bench.stats) {
+        total.merge(stats.latency);
+        total_errors += stats.errors;
+    }
+
+    print_text_report(bench, total, total_errors, elapsed_s);
+    if (options.json_path == "-") {
+        write_json_report(std::cout, bench, total, total_errors, elapsed_s);
+    } else if (!options.json_path.empty()) {
+        std::ofstream json(options.json_path);
+        write_json_report(json, bench, total, total_errors, elapsed_s);
+        if (!json) {
+            std::cerr << "[BENCH] Could not write " << options.json_path << std::endl;
+            return 1;
+        }
+    }
+    return total_errors == 0 ? 0 : 2;
+}
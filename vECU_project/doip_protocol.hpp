@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+
+// Wire definitions shared by the ECU, the diagnostic client and the load
+// generator.
+
+#pragma pack(push, 1)
+struct DoIPHeader {
+    uint8_t  protocol_version;
+    uint8_t  inverse_protocol_version;
+    uint16_t payload_type;
+    uint32_t payload_length;
+};
+#pragma pack(pop)
+
+// Header for an outgoing message, with the fields already in network order.
+inline DoIPHeader make_doip_header(uint16_t payload_type, uint32_t payload_length) {
+    return DoIPHeader{0x02, static_cast<uint8_t>(~0x02), htons(payload_type), htonl(payload_length)};
+}
+
+// --- UDS Service Identifiers ---
+const uint8_t UDS_READ_DATA_BY_IDENTIFIER = 0x22;
+const uint8_t UDS_READ_DATA_BY_PERIODIC_IDENTIFIER = 0x2A;
+const uint8_t UDS_WRITE_DATA_BY_IDENTIFIER = 0x2E;
+const uint8_t UDS_ROUTINE_CONTROL = 0x31;
+const uint8_t UDS_REQUEST_DOWNLOAD = 0x34;
+const uint8_t UDS_TRANSFER_DATA = 0x36;
+const uint8_t UDS_REQUEST_TRANSFER_EXIT = 0x37;
+
+// --- RoutineControl routine identifiers ---
+const uint16_t UDS_ENTER_PROGRAMMING_SESSION = 0xFF00;
+const uint16_t UDS_ROUTINE_READ_METRICS = 0xF0A0; // Returns the ECU's metrics as Prometheus text
+
+// A DoIP negative acknowledgement or a UDS negative response (SID 0x7F).
+inline bool is_negative_response(uint16_t payload_type, const std::vector<uint8_t>& payload) {
+    return payload_type == 0x8002 || (!payload.empty() && payload[0] == 0x7F);
+}
+
+// --- Tester-side helpers ---
+// TransferData block size used when the ECU does not report
+// maxNumberOfBlockLength in its RequestDownload response.
+const size_t DEFAULT_TRANSFER_CHUNK_SIZE = 4096;
+
+// Escapes `text` for use inside a JSON string in the tools' --json reports.
+inline std::string json_escape(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char code[8];
+            std::snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <iostream>
+#include <memory>
 #include <vector>
 #include <thread>
 #include <boost/asio.hpp>
@@ -8,40 +9,95 @@
 
 using boost::asio::ip::tcp;
 
+// Serves every ECU hosted by the process: one listening endpoint per ECU,
+// all driven by the same io_context threads and sharing one blocking pool.
 class DoIPServer {
 public:
-    DoIPServer(boost::asio::io_context& io_context, short port)
+    // `worker_threads` threads run the io_context; `blocking_threads` threads
+    // take file I/O, hashing and update installation off them.
+    DoIPServer(boost::asio::io_context& io_context, unsigned worker_threads = 1, unsigned blocking_threads = 2)
         : m_io_context(io_context),
-          m_acceptor(io_context, tcp::endpoint(tcp::v4(), port)) {
-        std::cout << "[DoIP] Server starting on port " << port << "..." << std::endl;
+          m_worker_threads(worker_threads > 0 ? worker_threads : 1),
+          m_blocking_pool(blocking_threads > 0 ? blocking_threads : 1) {}
+
+    ~DoIPServer() {
+        m_blocking_pool.join();
+    }
+
+    // Opens an endpoint for `ecu` on `port`, or a free port when it is 0, and
+    // returns the bound port. Throws boost::system::system_error if the port
+    // cannot be bound. Call before run().
+    unsigned short listen(EcuInstance& ecu, unsigned short port) {
+        m_endpoints.push_back(std::make_unique<Endpoint>(ecu, tcp::acceptor(m_io_context, tcp::endpoint(tcp::v4(), port))));
+        return this->port(m_endpoints.size() - 1);
     }
 
+    // Blocks until stop(); the calling thread is one of the workers.
     void run() {
-        try {
-            start_accept();
-            m_io_context.run();
-        } catch (const std::exception& e) {
-            std::cerr << "[DoIP] Server exception: " << e.what() << std::endl;
+        if (m_endpoints.size() == 1) {
+            ECU_LOG_INFO("DoIP", "Server starting on port %u with %u worker thread(s)...", port(0), m_worker_threads);
+        } else if (!m_endpoints.empty()) {
+            ECU_LOG_INFO("DoIP", "Server starting %zu endpoints on ports %u-%u with %u worker thread(s)...",
+                         m_endpoints.size(), port(0), port(m_endpoints.size() - 1), m_worker_threads);
+        }
+        for (auto& endpoint : m_endpoints) {
+            start_accept(*endpoint);
+        }
+        std::vector<std::thread> workers;
+        for (unsigned i = 1; i < m_worker_threads; ++i) {
+            workers.emplace_back([this]() { run_worker(); });
         }
-        std::cout << "[DoIP] Server has stopped." << std::endl;
+        run_worker();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        ECU_LOG_INFO("DoIP", "Server has stopped.");
     }
 
     void stop() {
         m_io_context.stop();
     }
 
+    // The bound port of an endpoint; useful when it was opened on port 0.
+    unsigned short port(size_t endpoint = 0) const {
+        return m_endpoints[endpoint]->acceptor.local_endpoint().port();
+    }
+
+    size_t endpoints() const {
+        return m_endpoints.size();
+    }
+
 private:
-    void start_accept() {
-        m_acceptor.async_accept([this](const boost::system::error_code& error, tcp::socket socket) {
-            if (!error) {
-                std::make_shared<DoIPSession>(std::move(socket))->start();
-            } else {
-                std::cerr << "[DoIP] Error accepting connection: " << error.message() << std::endl;
-            }
-            start_accept();
-        });
+    struct Endpoint {
+        Endpoint(EcuInstance& ecu, tcp::acceptor acceptor) : ecu(ecu), acceptor(std::move(acceptor)) {}
+        EcuInstance& ecu;
+        tcp::acceptor acceptor;
+    };
+
+    void run_worker() {
+        try {
+            m_io_context.run();
+        } catch (const std::exception& e) {
+            ECU_LOG_ERROR("DoIP", "Server exception: %s", e.what());
+            m_io_context.stop();
+        }
+    }
+
+    void start_accept(Endpoint& endpoint) {
+        // Each accepted socket gets its own strand to serialize its session.
+        endpoint.acceptor.async_accept(boost::asio::make_strand(m_io_context),
+            [this, &endpoint](const boost::system::error_code& error, SessionSocket socket) {
+                if (!error) {
+                    std::make_shared<DoIPSession>(std::move(socket), m_blocking_pool.get_executor(), endpoint.ecu)->start();
+                } else {
+                    ECU_LOG_WARN("DoIP", "Error accepting connection: %s", error.message().c_str());
+                }
+                start_accept(endpoint);
+            });
     }
 
     boost::asio::io_context& m_io_context;
-    tcp::acceptor m_acceptor;
+    std::vector<std::unique_ptr<Endpoint>> m_endpoints;
+    unsigned m_worker_threads;
+    boost::asio::thread_pool m_blocking_pool;
 };
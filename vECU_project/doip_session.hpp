@@ -5,77 +5,129 @@
 #include <memory>
 #include <vector>
 #include <string>
+#include <array>
+#include <initializer_list>
+#include <algorithm>
 #include <atomic>
 #include <cstdio>
+#include <filesystem>
+#include <optional>
 #include <boost/asio.hpp>
 #include <charconv> // For string to number conversion
 
+#include "ecu_log.hpp"
 #include "ecu_state.hpp"
+#include "doip_protocol.hpp"
 #include "nvram_manager.hpp"
+#include "sha256_stream.hpp"
+#include "ota_delta.hpp"
+#include "ota_compression.hpp"
+#include "ota_manifest.hpp"
+#include "handler_allocator.hpp"
+#include "did_bindings.hpp"
+#include "periodic_publisher.hpp"
+#include "metrics.hpp"
+#include "ecu_instance.hpp"
 
-// Forward declare global state variables and functions from main.cpp
-extern std::atomic<EcuState> g_ecu_state;
-extern std::string g_executable_path;
-extern NVRAMManager g_nvram; // Access the global NVRAM object
-extern std::optional<std::string> calculate_file_hash(const std::string& file_path);
-extern void apply_update(const std::string& current_executable_path);
+extern EcuMetrics g_metrics;
 
 using boost::asio::ip::tcp;
 
-#pragma pack(push, 1)
-struct DoIPHeader {
-    uint8_t  protocol_version;
-    uint8_t  inverse_protocol_version;
-    uint16_t payload_type;
-    uint32_t payload_length;
-};
-#pragma pack(pop)
-
-// --- UDS Service and Data Identifiers ---
-const uint8_t UDS_READ_DATA_BY_IDENTIFIER = 0x22;
-const uint8_t UDS_WRITE_DATA_BY_IDENTIFIER = 0x2E;
-const uint8_t UDS_ROUTINE_CONTROL = 0x31;
-const uint8_t UDS_REQUEST_DOWNLOAD = 0x34;
-const uint8_t UDS_TRANSFER_DATA = 0x36;
-const uint8_t UDS_REQUEST_TRANSFER_EXIT = 0x37;
-
-// Data Identifiers (DIDs)
-const uint16_t DID_LEAD_VEHICLE_SPEED = 0xF101;
-const uint16_t DID_OWN_VEHICLE_SPEED = 0xF103;
-const uint16_t DID_ACC_GAP_SETTING = 0xF102;
-const uint16_t DID_ACC_KP = 0xD101;
-const uint16_t DID_ACC_KI = 0xD102;
-const uint16_t DID_ACC_MAX_ACCEL = 0xD103;
-const uint16_t DID_ACC_MAX_DECEL = 0xD104;
-
-
-class DoIPSession : public std::enable_shared_from_this<DoIPSession> {
+// --- OTA transfer limits ---
+// Largest TransferData request accepted (SID + block counter + data); returned
+// to the client as maxNumberOfBlockLength in the RequestDownload response.
+const uint32_t MAX_TRANSFER_BLOCK_LENGTH = 0x10000 + 2;
+// Upper bound on TransferData blocks a client may have unacknowledged.
+const uint8_t MAX_TRANSFER_WINDOW = 64;
+// Any DoIP message larger than this closes the connection.
+const uint32_t MAX_DOIP_PAYLOAD_LENGTH = 1024 * 1024;
+// Periodic samples are dropped while more than this many messages wait to be
+// written, so a slow tester cannot make the session buffer without bound.
+const size_t MAX_PERIODIC_BACKLOG = 32;
+// Payload capacity reserved in each outgoing-message slot: the largest
+// ReadDataByIdentifier reply. Which slot a reply lands in depends on how many
+// are queued, so without it a slot that has only carried short replies would
+// allocate the first time a long one reaches it.
+const size_t WRITE_SLOT_CAPACITY = 1 + MAX_DIDS_PER_READ * (2 + 4);
+
+
+// Executor for work that may block (file I/O, hashing, installing updates).
+using BlockingExecutor = boost::asio::thread_pool::executor_type;
+// A session's socket is bound to its strand by concrete type. With the
+// type-erased default executor every operation would copy (and allocate)
+// the strand wrapper.
+using SessionStrand = boost::asio::strand<boost::asio::io_context::executor_type>;
+using SessionSocket = tcp::socket::rebind_executor<SessionStrand>::other;
+
+// One tester connection to one ECU. The socket is bound to its own strand, so all of a
+// session's handlers run serialized even when the server's io_context is
+// driven by several threads. Blocking work is handed to a separate executor
+// (serialized per session by m_file_strand) and its results are posted back
+// to the socket's strand.
+//
+// Once warmed up, a request/response exchange does not touch the heap: the
+// payload and response buffers are reused, outgoing messages come from a
+// ring whose slots keep their capacity, and asio's operations are allocated
+// from the session's HandlerMemory.
+//
+// A session that has periodic identifiers active (service 0x2A) subscribes to
+// the ECU's PeriodicPublisher and pushes samples between its regular responses.
+class DoIPSession : public std::enable_shared_from_this<DoIPSession>, public PeriodicSubscriber {
 public:
-    DoIPSession(tcp::socket socket)
-        : m_socket(std::move(socket)), m_firmware_file_size(0), m_bytes_received(0) {}
+    // `ecu` must outlive the session.
+    DoIPSession(SessionSocket socket, BlockingExecutor blocking_executor, EcuInstance& ecu)
+        : m_ecu(ecu), m_socket(std::move(socket)), m_file_strand(boost::asio::make_strand(blocking_executor)),
+          m_firmware_file_size(0), m_bytes_received(0) {
+        grow_write_ring();
+    }
 
     void start() {
+        // Replies are small; without this, Nagle holds back the answers to
+        // pipelined requests until the tester acknowledges the first one.
+        boost::system::error_code ignored;
+        m_socket.set_option(tcp::no_delay(true), ignored);
         do_read_header();
     }
 
+    // Called on the control loop thread after each cycle. At most one tick is
+    // queued at a time; it always sends the newest snapshot.
+    void on_periodic_snapshot(uint64_t) override {
+        if (m_periodic_tick_pending.exchange(true, std::memory_order_acq_rel)) return;
+        auto self = shared_from_this();
+        boost::asio::post(m_socket.get_executor(), make_custom_alloc_handler(m_handler_memory, [this, self]() {
+            m_periodic_tick_pending.store(false, std::memory_order_release);
+            send_periodic_samples();
+        }));
+    }
+
 private:
     void do_read_header() {
         auto self = shared_from_this();
         boost::asio::async_read(m_socket,
             boost::asio::buffer(&m_received_header, sizeof(DoIPHeader)),
-            [this, self](const boost::system::error_code& ec, std::size_t length) {
+            make_custom_alloc_handler(m_handler_memory, [this, self](const boost::system::error_code& ec, std::size_t /*length*/) {
                 if (!ec) {
                     m_received_header.payload_type = ntohs(m_received_header.payload_type);
                     m_received_header.payload_length = ntohl(m_received_header.payload_length);
                     do_read_payload();
-                } else if (ec != boost::asio::error::eof) {
-                    std::cerr << "[SESSION] Error reading header: " << ec.message() << std::endl;
+                } else {
+                    stop_periodic();
+                    if (ec != boost::asio::error::eof) {
+                        ECU_LOG_WARN("SESSION", "Error reading header: %s", ec.message().c_str());
+                    }
                 }
-            });
+            }));
     }
 
     void do_read_payload() {
         auto self = shared_from_this();
+        if (m_received_header.payload_length > MAX_DOIP_PAYLOAD_LENGTH) {
+            ECU_LOG_WARN("SESSION", "Payload of %u bytes exceeds limit. Closing.", m_received_header.payload_length);
+            stop_periodic();
+            boost::system::error_code ignored;
+            m_socket.close(ignored);
+            return;
+        }
         m_payload.resize(m_received_header.payload_length);
         if (m_received_header.payload_length == 0) {
             process_message();
@@ -83,18 +135,26 @@ private:
         }
         boost::asio::async_read(m_socket,
             boost::asio::buffer(m_payload.data(), m_received_header.payload_length),
-            [this, self](const boost::system::error_code& ec, std::size_t length) {
+            make_custom_alloc_handler(m_handler_memory, [this, self](const boost::system::error_code& ec, std::size_t /*length*/) {
                 if (!ec) {
                     process_message();
-                } else if (ec != boost::asio::error::eof) {
-                    std::cerr << "[SESSION] Error reading payload: " << ec.message() << std::endl;
+                } else {
+                    stop_periodic();
+                    if (ec != boost::asio::error::eof) {
+                        ECU_LOG_WARN("SESSION", "Error reading payload: %s", ec.message().c_str());
+                    }
                 }
-            });
+            }));
     }
 
     void process_message() {
+        m_request_started = metric_now_ns();
+        g_metrics.doip_bytes_received.add(0, sizeof(DoIPHeader) + m_received_header.payload_length);
         switch (m_received_header.payload_type) {
-            case 0x0004: do_write_vehicle_announcement(); break;
+            case 0x0004:
+                m_request_metric = METRIC_VEHICLE_IDENTIFICATION;
+                do_write_vehicle_announcement();
+                break;
             case 0x8001: handle_uds_message(); break;
             default: do_read_header(); break;
         }
@@ -106,101 +166,211 @@ private:
             return;
         }
         uint8_t service_id = m_payload[0];
-        std::vector<uint8_t> response_payload;
+        m_request_sid = service_id;
+        m_request_metric = metric_service_index(service_id);
+        g_metrics.uds_requests.add(service_id);
+        std::vector<uint8_t>& response_payload = m_response; // Reused; keeps its capacity
+        response_payload.clear();
 
         switch (service_id) {
             case UDS_READ_DATA_BY_IDENTIFIER: {
-                if (m_payload.size() < 3) break;
-                uint16_t data_id = (m_payload[1] << 8) | m_payload[2];
-                
-                g_nvram.load();
-                std::optional<std::string> val_str;
-                bool is_float = false;
-                
-                if (data_id == DID_LEAD_VEHICLE_SPEED) val_str = g_nvram.get_string("LEAD_VEHICLE_SPEED");
-                else if (data_id == DID_OWN_VEHICLE_SPEED) val_str = g_nvram.get_string("OWN_VEHICLE_SPEED");
-                else if (data_id == DID_ACC_GAP_SETTING) val_str = g_nvram.get_string("ACC_GAP_SETTING");
-                else if (data_id == DID_ACC_KP) { val_str = g_nvram.get_string("ACC_KP"); is_float = true; }
-                else if (data_id == DID_ACC_KI) { val_str = g_nvram.get_string("ACC_KI"); is_float = true; }
-                else if (data_id == DID_ACC_MAX_ACCEL) { val_str = g_nvram.get_string("ACC_MAX_ACCEL"); is_float = true; }
-                else if (data_id == DID_ACC_MAX_DECEL) { val_str = g_nvram.get_string("ACC_MAX_DECEL"); is_float = true; }
-
-                if (val_str) {
-                    response_payload.push_back(0x62); // Positive response for 0x22
-                    response_payload.push_back(m_payload[1]);
-                    response_payload.push_back(m_payload[2]);
-                    
-                    float f_val = std::stof(*val_str);
-                    uint8_t byte_val = is_float ? static_cast<uint8_t>(f_val * 10.0f) : static_cast<uint8_t>(f_val);
-                    response_payload.push_back(byte_val);
-                    do_write_generic_response(0x8001, response_payload);
-                } else {
-                    do_write_generic_response(0x8002, {}); // Negative response
+                // Served straight from the in-memory store; no file access on reads.
+                if (!read_data_by_identifier(m_ecu.nvram(), m_payload, response_payload)) break;
+                do_write_generic_response(0x8001, response_payload);
+                return;
+            }
+            case UDS_READ_DATA_BY_PERIODIC_IDENTIFIER: {
+                if (m_payload.size() < 2) break;
+                uint8_t mode = m_payload[1];
+                if (mode == PERIODIC_MODE_STOP) {
+                    // No identifiers listed stops all of them.
+                    if (m_payload.size() == 2) m_periodic_rate.fill(0);
+                    for (size_t i = 2; i < m_payload.size(); ++i) {
+                        if (auto index = find_periodic_did(m_payload[i])) m_periodic_rate[*index] = 0;
+                    }
+                    if (std::all_of(m_periodic_rate.begin(), m_periodic_rate.end(), [](uint64_t rate) { return rate == 0; })) {
+                        stop_periodic();
+                    }
+                    do_write_generic_response(0x8001, {0x6A});
+                    return;
+                }
+                uint64_t rate = periodic_mode_cycles(mode);
+                if (rate == 0 || m_payload.size() < 3) break;
+                bool all_known = std::all_of(m_payload.begin() + 2, m_payload.end(),
+                                             [](uint8_t periodic_id) { return find_periodic_did(periodic_id).has_value(); });
+                if (!all_known) break;
+                for (size_t i = 2; i < m_payload.size(); ++i) {
+                    size_t index = *find_periodic_did(m_payload[i]);
+                    m_periodic_rate[index] = rate;
+                    m_periodic_last[index] = 0; // Due on the next cycle
                 }
+                if (!m_periodic_subscribed) {
+                    m_periodic_subscribed = true;
+                    m_ecu.periodic_publisher().subscribe(shared_from_this());
+                }
+                do_write_generic_response(0x8001, {0x6A});
                 return;
             }
             case UDS_WRITE_DATA_BY_IDENTIFIER: {
-                if (m_payload.size() < 4) break;
-                uint16_t data_id = (m_payload[1] << 8) | m_payload[2];
-                uint8_t value = m_payload[3];
-
-                if (data_id == DID_LEAD_VEHICLE_SPEED) g_nvram.set_string("LEAD_VEHICLE_SPEED", std::to_string(value));
-                else if (data_id == DID_ACC_GAP_SETTING) g_nvram.set_string("ACC_GAP_SETTING", std::to_string(value));
-                else if (data_id == DID_ACC_KP) g_nvram.set_string("ACC_KP", std::to_string(value / 10.0f));
-                else if (data_id == DID_ACC_KI) g_nvram.set_string("ACC_KI", std::to_string(value / 10.0f));
-                else if (data_id == DID_ACC_MAX_ACCEL) g_nvram.set_string("ACC_MAX_ACCEL", std::to_string(value / 10.0f));
-                else if (data_id == DID_ACC_MAX_DECEL) g_nvram.set_string("ACC_MAX_DECEL", std::to_string(value / 10.0f));
-                
-                g_nvram.save();
-                
-                response_payload.push_back(0x6E);
-                response_payload.push_back(m_payload[1]);
-                response_payload.push_back(m_payload[2]);
+                if (!write_data_by_identifier(m_ecu.nvram(), m_payload, response_payload)) break;
+                m_ecu.nvram().save();
                 do_write_generic_response(0x8001, response_payload);
                 return;
             }
             case UDS_ROUTINE_CONTROL: {
                 if (m_payload.size() < 4) break;
                 uint16_t routine_id = (m_payload[2] << 8) | m_payload[3];
-                if (routine_id == 0xFF00) {
-                    g_ecu_state = EcuState::UPDATE_PENDING;
+                if (routine_id == UDS_ENTER_PROGRAMMING_SESSION) {
+                    m_ecu.state() = EcuState::UPDATE_PENDING;
                     response_payload.push_back(0x71);
                     response_payload.insert(response_payload.end(), m_payload.begin() + 1, m_payload.end());
                     do_write_generic_response(0x8001, response_payload);
                     return;
                 }
+                if (routine_id == UDS_ROUTINE_READ_METRICS) {
+                    // Prometheus text after the usual routine echo; see metrics.hpp.
+                    std::string text = metrics_prometheus_text(g_metrics);
+                    response_payload.assign(m_payload.begin(), m_payload.begin() + 4);
+                    response_payload[0] = 0x71;
+                    response_payload.insert(response_payload.end(), text.begin(), text.end());
+                    do_write_generic_response(0x8001, response_payload);
+                    return;
+                }
                 break;
             }
             case UDS_REQUEST_DOWNLOAD: {
-                if (g_ecu_state != EcuState::UPDATE_PENDING || m_payload.size() < 10) break;
-                m_firmware_file_size = (m_payload[6] << 24) | (m_payload[7] << 16) | (m_payload[8] << 8) | m_payload[9];
-                m_update_file.open("update.bin", std::ios::binary | std::ios::trunc);
-                if (!m_update_file.is_open()) break;
-                m_bytes_received = 0;
-                response_payload = {0x74, 0x20, 0x10, 0x00};
-                do_write_generic_response(0x8001, response_payload);
+                if (m_ecu.state() != EcuState::UPDATE_PENDING || m_payload.size() < 10) break;
+                uint8_t data_format = m_payload[1];
+                if ((data_format & ~(OTA_FORMAT_DELTA | OTA_FORMAT_COMPRESSED | OTA_FORMAT_MANIFEST)) != 0) break;
+                if ((data_format & OTA_FORMAT_MANIFEST) && data_format != OTA_FORMAT_MANIFEST) break;
+                // addressAndLengthFormatIdentifier: high nibble = size bytes, low nibble = address bytes.
+                size_t address_bytes = m_payload[2] & 0x0F;
+                size_t size_bytes = m_payload[2] >> 4;
+                size_t size_offset = 3 + address_bytes;
+                if (size_bytes == 0 || size_bytes > 4 || m_payload.size() < size_offset + size_bytes) break;
+                m_firmware_file_size = 0;
+                for (size_t i = 0; i < size_bytes; ++i) {
+                    m_firmware_file_size = (m_firmware_file_size << 8) | m_payload[size_offset + i];
+                }
+                // Optional trailing byte: the number of blocks the client wants in flight.
+                size_t window_offset = size_offset + size_bytes;
+                uint8_t requested_window = m_payload.size() > window_offset ? m_payload[window_offset] : 1;
+                // A manifest download lists its chunk hashes after the window (see ota_manifest.hpp).
+                std::shared_ptr<OtaManifest> manifest;
+                if (data_format & OTA_FORMAT_MANIFEST) {
+                    if (m_payload.size() <= window_offset) break;
+                    auto decoded = OtaManifest::decode(m_firmware_file_size, m_payload.data() + window_offset + 1,
+                                                       m_payload.size() - window_offset - 1);
+                    if (!decoded || decoded->chunk_size > MAX_TRANSFER_BLOCK_LENGTH - 2) break;
+                    manifest = std::make_shared<OtaManifest>(std::move(*decoded));
+                }
+                m_download_active = false;
+                m_manifest_download = manifest != nullptr;
+                run_blocking(
+                    [this, data_format, manifest, image_size = m_firmware_file_size]() -> std::optional<size_t> {
+                        if (m_update_file.is_open()) m_update_file.close();
+                        m_update_digest.reset();
+                        m_image_size = image_size;
+                        m_image_bytes_written = 0;
+                        m_inflater.reset();
+                        m_delta_decoder.reset();
+                        m_delta_base.reset();
+                        std::string progress_path = m_ecu.update_path() + ".progress";
+                        if (manifest) {
+                            // Chunks already in update.bin and still matching are kept.
+                            m_progress = std::make_unique<OtaDownloadProgress>();
+                            if (!m_progress->open(progress_path, m_ecu.update_path(), *manifest)) return std::nullopt;
+                            std::ofstream(m_ecu.update_path(), std::ios::binary | std::ios::app); // Create it if missing
+                            m_update_file.open(m_ecu.update_path(), std::ios::binary | std::ios::in | std::ios::out);
+                            if (!m_update_file.is_open()) return std::nullopt;
+                            return m_progress->first_missing();
+                        }
+                        // Truncating update.bin below invalidates any interrupted manifest download.
+                        m_progress.reset();
+                        std::remove(progress_path.c_str());
+                        m_update_file.open(m_ecu.update_path(), std::ios::binary | std::ios::trunc);
+                        if (data_format & OTA_FORMAT_DELTA) {
+                            // The patch is applied as it arrives, so update.bin holds the rebuilt image.
+                            if (!m_delta_base.open(m_ecu.acc_library_path())) {
+                                ECU_LOG_ERROR("OTA", "ERROR: Cannot open installed image for delta update.");
+                                return std::nullopt;
+                            }
+                            m_delta_decoder = std::make_unique<OtaDeltaDecoder>(m_delta_base.data(), m_delta_base.size(),
+                                [this](const uint8_t* data, size_t length) { return write_image_data(data, length); });
+                        }
+                        if (data_format & OTA_FORMAT_COMPRESSED) {
+                            // Inflated straight into the next stage; the compressed stream is never stored.
+                            m_inflater = std::make_unique<OtaInflater>(
+                                [this](const uint8_t* data, size_t length) { return write_decoded_data(data, length); });
+                        }
+                        if (!m_update_file.is_open()) return std::nullopt;
+                        return 0;
+                    },
+                    [this, requested_window, chunk_count = manifest ? manifest->chunk_count() : 0](std::optional<size_t> first_chunk) {
+                        if (!first_chunk) {
+                            do_write_generic_response(0x8002, {});
+                            return;
+                        }
+                        if (m_manifest_download && *first_chunk > 0) {
+                            ECU_LOG_INFO("OTA", "Resuming download at chunk %zu of %zu.", *first_chunk, chunk_count);
+                        }
+                        m_next_chunk = *first_chunk;
+                        m_download_active = true;
+                        m_bytes_received = 0;
+                        m_transfer_window = std::clamp<uint8_t>(requested_window, 1, MAX_TRANSFER_WINDOW);
+                        m_ack_interval = std::max<uint8_t>(1, m_transfer_window / 2);
+                        m_blocks_in_flight = 0;
+                        m_blocks_unacked = 0;
+                        // lengthFormatIdentifier 0x40: maxNumberOfBlockLength is 4 bytes, then the granted
+                        // window and, for a manifest download, the first chunk the ECU still needs.
+                        std::vector<uint8_t> response({0x74, 0x40,
+                            static_cast<uint8_t>(MAX_TRANSFER_BLOCK_LENGTH >> 24), static_cast<uint8_t>(MAX_TRANSFER_BLOCK_LENGTH >> 16),
+                            static_cast<uint8_t>(MAX_TRANSFER_BLOCK_LENGTH >> 8), static_cast<uint8_t>(MAX_TRANSFER_BLOCK_LENGTH),
+                            m_transfer_window});
+                        if (m_manifest_download) {
+                            for (int shift = 24; shift >= 0; shift -= 8) response.push_back(static_cast<uint8_t>(m_next_chunk >> shift));
+                        }
+                        do_write_generic_response(0x8001, response);
+                    });
                 return;
             }
             case UDS_TRANSFER_DATA: {
-                if (g_ecu_state != EcuState::UPDATE_PENDING || !m_update_file.is_open()) break;
-                m_update_file.write(reinterpret_cast<const char*>(m_payload.data() + 2), m_payload.size() - 2);
-                response_payload = {0x76, m_payload[1]};
-                do_write_generic_response(0x8001, response_payload);
+                if (m_ecu.state() != EcuState::UPDATE_PENDING || !m_download_active || m_payload.size() < 2 ||
+                    m_payload.size() > MAX_TRANSFER_BLOCK_LENGTH) break;
+                handle_transfer_data();
                 return;
             }
             case UDS_REQUEST_TRANSFER_EXIT: {
-                if (g_ecu_state != EcuState::UPDATE_PENDING || !m_update_file.is_open()) break;
-                m_update_file.close();
-                auto calculated_hash_opt = calculate_file_hash("update.bin");
-                if (!calculated_hash_opt) break;
+                if (m_ecu.state() != EcuState::UPDATE_PENDING || !m_download_active) break;
+                m_download_active = false;
+                m_blocks_unacked = 0; // The 0x77 response acknowledges every remaining block.
                 std::string expected_hash_hex(m_payload.begin() + 1, m_payload.end());
-                if (*calculated_hash_opt == expected_hash_hex) {
-                    response_payload.push_back(0x77);
-                    do_write_generic_response(0x8001, response_payload);
-                    apply_update(g_executable_path);
-                } else {
-                    do_write_generic_response(0x8002, {});
+                if (m_manifest_download) {
+                    finish_manifest_download(std::move(expected_hash_hex));
+                    return;
                 }
+                run_blocking(
+                    [this, expected_hash_hex]() {
+                        // Every block was hashed as it was written, so this is O(1).
+                        m_update_file.close();
+                        bool patch_complete = (!m_inflater || m_inflater->finished()) &&
+                                              (!m_delta_decoder || m_delta_decoder->finished()) &&
+                                              m_image_bytes_written == m_image_size;
+                        m_inflater.reset();
+                        m_delta_decoder.reset();
+                        m_delta_base.reset();
+                        auto calculated_hash_opt = m_update_digest.finish_hex();
+                        if (m_update_file.fail() || !patch_complete || !calculated_hash_opt || *calculated_hash_opt != expected_hash_hex) return false;
+                        // Vetted and staged before replying, so a rejected image is reported to the tester.
+                        return m_ecu.apply_update(expected_hash_hex);
+                    },
+                    [this](bool verified) {
+                        if (verified) {
+                            do_write_generic_response(0x8001, {0x77});
+                        } else {
+                            do_write_generic_response(0x8002, {});
+                        }
+                    });
                 return;
             }
             default: break;
@@ -208,38 +378,287 @@ private:
         do_write_generic_response(0x8002, {});
     }
 
-    void do_write_generic_response(uint16_t payload_type, const std::vector<uint8_t>& payload) {
+    // Each chunk was checked against its leaf as it landed, so only the
+    // root remains to compare before the installed slot is re-verified.
+    void finish_manifest_download(std::string expected_root_hex) {
+        run_blocking(
+            [this, expected_root_hex = std::move(expected_root_hex)]() {
+                m_update_file.close();
+                bool complete = m_progress && m_progress->complete() && !m_update_file.fail() &&
+                                sha256_digest_hex(m_progress->root()) == expected_root_hex;
+                if (!complete) return false;
+                OtaManifest manifest = m_progress->manifest();
+                std::error_code ec;
+                std::filesystem::resize_file(m_ecu.update_path(), manifest.image_size, ec);
+                bool installed = !ec && m_ecu.apply_update(expected_root_hex, &manifest);
+                // A rejected image cannot be completed by resuming, so start over next time.
+                m_progress->remove();
+                m_progress.reset();
+                return installed;
+            },
+            [this](bool installed) {
+                if (installed) {
+                    do_write_generic_response(0x8001, {0x77});
+                } else {
+                    do_write_generic_response(0x8002, {});
+                }
+            });
+    }
+
+    // Queues the block for an asynchronous disk write and, while the client's
+    // window allows, goes straight back to reading the next one. Writes are
+    // acknowledged cumulatively every m_ack_interval blocks; TransferExit's
+    // response covers any remainder.
+    void handle_transfer_data() {
+        uint8_t block_counter = m_payload[1];
+        uint64_t started = m_request_started;
+        std::vector<uint8_t> block = std::move(m_payload);
+        m_payload = take_spare_buffer();
+        ++m_blocks_in_flight;
+
+        auto written = std::make_shared<std::vector<uint8_t>>(std::move(block));
+        run_blocking(
+            [this, written, chunk = m_manifest_download ? m_next_chunk++ : 0]() {
+                if (m_manifest_download) return write_manifest_chunk(chunk, written->data() + 2, written->size() - 2);
+                return write_update_data(written->data() + 2, written->size() - 2);
+            },
+            [this, written, block_counter, started](bool ok) {
+                --m_blocks_in_flight;
+                g_metrics.request_duration.record(metric_service_index(UDS_TRANSFER_DATA), metric_now_ns() - started);
+                if (!ok) {
+                    g_metrics.uds_negative_responses.add(UDS_TRANSFER_DATA);
+                    m_download_active = false;
+                    queue_response(0x8002, {}, false);
+                } else {
+                    m_bytes_received += static_cast<uint32_t>(written->size() - 2);
+                    if (++m_blocks_unacked >= m_ack_interval) {
+                        m_blocks_unacked = 0;
+                        queue_response(0x8001, {0x76, block_counter}, false);
+                    }
+                }
+                m_spare_buffers.push_back(std::move(*written));
+                if (m_read_paused) {
+                    m_read_paused = false;
+                    do_read_header();
+                }
+            });
+
+        if (m_blocks_in_flight < m_transfer_window) {
+            do_read_header();
+        } else {
+            m_read_paused = true; // Resumed by the next completed write.
+        }
+    }
+
+    // Runs on m_file_strand. Received data passes through the inflater and
+    // the delta decoder, whichever the download's data format enables, and
+    // the resulting image ends up in write_image_data().
+    bool write_update_data(const uint8_t* data, size_t length) {
+        if (m_inflater) return m_inflater->feed(data, length);
+        return write_decoded_data(data, length);
+    }
+
+    bool write_decoded_data(const uint8_t* data, size_t length) {
+        if (m_delta_decoder) return m_delta_decoder->feed(data, length);
+        return write_image_data(data, length);
+    }
+
+    bool write_image_data(const uint8_t* data, size_t length) {
+        // memorySize from RequestDownload bounds the image, however it is encoded.
+        if (m_image_bytes_written + length > m_image_size) {
+            ECU_LOG_ERROR("OTA", "ERROR: Image exceeds the size announced in RequestDownload.");
+            return false;
+        }
+        m_image_bytes_written += length;
+        m_update_file.write(reinterpret_cast<const char*>(data), length);
+        m_update_digest.update(data, length);
+        return m_update_file.good();
+    }
+
+    // Runs on m_file_strand. A manifest download carries exactly one chunk
+    // per block, which is rejected unless it hashes to its leaf.
+    bool write_manifest_chunk(size_t chunk, const uint8_t* data, size_t length) {
+        const OtaManifest& manifest = m_progress->manifest();
+        if (chunk >= manifest.chunk_count() || length != manifest.chunk_length(chunk) ||
+            sha256_digest(data, length) != manifest.leaves[chunk]) {
+            ECU_LOG_ERROR("OTA", "ERROR: Chunk %zu does not match the download manifest.", chunk);
+            return false;
+        }
+        m_update_file.seekp(static_cast<std::streamoff>(manifest.chunk_offset(chunk)));
+        m_update_file.write(reinterpret_cast<const char*>(data), length);
+        m_update_file.flush(); // On disk before the progress file claims it
+        if (!m_update_file.good()) return false;
+        m_progress->mark_done(chunk);
+        return true;
+    }
+
+    // Sends each active periodic identifier whose rate has elapsed, as
+    // [0x6A, periodic id, value]. Samples are skipped, not queued, while the
+    // write backlog is long.
+    void send_periodic_samples() {
+        if (!m_periodic_subscribed || m_write_count > MAX_PERIODIC_BACKLOG) return;
+        m_ecu.periodic_publisher().read(m_periodic_snapshot);
+        for (size_t i = 0; i < PERIODIC_DIDS.size(); ++i) {
+            if (m_periodic_rate[i] == 0 || m_periodic_snapshot.cycle - m_periodic_last[i] < m_periodic_rate[i]) continue;
+            m_periodic_last[i] = m_periodic_snapshot.cycle;
+            uint8_t sample[2 + 4] = {0x6A, PERIODIC_DIDS[i].periodic_id};
+            std::copy_n(m_periodic_snapshot.values[i].begin(), m_periodic_snapshot.lengths[i], sample + 2);
+            queue_response(0x8001, sample, 2 + m_periodic_snapshot.lengths[i], false);
+        }
+    }
+
+    void stop_periodic() {
+        if (!m_periodic_subscribed) return;
+        m_periodic_subscribed = false;
+        m_periodic_rate.fill(0);
+        m_ecu.periodic_publisher().unsubscribe(this);
+    }
+
+    std::vector<uint8_t> take_spare_buffer() {
+        if (m_spare_buffers.empty()) return {};
+        std::vector<uint8_t> buffer = std::move(m_spare_buffers.back());
+        m_spare_buffers.pop_back();
+        return buffer;
+    }
+
+    // Runs `work` on the blocking executor, then calls `done(result)` back on
+    // the session's strand.
+    template <typename Work, typename Done>
+    void run_blocking(Work work, Done done) {
         auto self = shared_from_this();
-        auto response_header = std::make_shared<DoIPHeader>();
-        response_header->protocol_version = 0x02;
-        response_header->inverse_protocol_version = ~response_header->protocol_version;
-        response_header->payload_type = htons(payload_type);
-        response_header->payload_length = htonl(payload.size());
-        std::vector<boost::asio::const_buffer> buffers;
-        buffers.push_back(boost::asio::buffer(response_header.get(), sizeof(DoIPHeader)));
-        if (!payload.empty()) {
-            buffers.push_back(boost::asio::buffer(payload));
+        boost::asio::post(m_file_strand, make_custom_alloc_handler(m_handler_memory,
+            [this, self, work = std::move(work), done = std::move(done)]() mutable {
+                auto result = work();
+                boost::asio::post(m_socket.get_executor(), make_custom_alloc_handler(m_handler_memory,
+                    [self, done = std::move(done), result = std::move(result)]() mutable { done(result); }));
+            }));
+    }
+
+    // Replies to the request being handled and resumes reading.
+    void do_write_generic_response(uint16_t payload_type, const std::vector<uint8_t>& payload) {
+        record_request_metrics(payload_type);
+        queue_response(payload_type, payload.data(), payload.size(), true);
+    }
+
+    void do_write_generic_response(uint16_t payload_type, std::initializer_list<uint8_t> payload) {
+        record_request_metrics(payload_type);
+        queue_response(payload_type, payload.begin(), payload.size(), true);
+    }
+
+    void record_request_metrics(uint16_t payload_type) {
+        g_metrics.request_duration.record(m_request_metric, metric_now_ns() - m_request_started);
+        if (payload_type == 0x8002) g_metrics.uds_negative_responses.add(m_request_sid);
+    }
+
+    void queue_response(uint16_t payload_type, std::initializer_list<uint8_t> payload, bool resume_reading) {
+        queue_response(payload_type, payload.begin(), payload.size(), resume_reading);
+    }
+
+    // Responses are written one at a time in order. `resume_reading` is set for
+    // replies to a request whose handler left reading stopped; unsolicited
+    // acknowledgements during a windowed transfer leave it clear.
+    void queue_response(uint16_t payload_type, const uint8_t* payload, size_t length, bool resume_reading) {
+        if (m_write_count == m_write_ring.size()) {
+            grow_write_ring();
+        }
+        OutgoingMessage& message = *m_write_ring[(m_write_head + m_write_count) % m_write_ring.size()];
+        ++m_write_count;
+        message.header = make_doip_header(payload_type, static_cast<uint32_t>(length));
+        message.payload.assign(payload, payload + length);
+        message.resume_reading = resume_reading;
+        if (m_write_count == 1) {
+            do_write_next();
+        }
+    }
+
+    // Adds ring slots. Queued messages are rotated to the front first so they
+    // stay in order; slots are heap objects, so one being written never moves.
+    void grow_write_ring() {
+        std::rotate(m_write_ring.begin(), m_write_ring.begin() + m_write_head, m_write_ring.end());
+        m_write_head = 0;
+        size_t added = std::max<size_t>(4, m_write_ring.size());
+        for (size_t i = 0; i < added; ++i) {
+            m_write_ring.push_back(std::make_unique<OutgoingMessage>());
+            m_write_ring.back()->payload.reserve(WRITE_SLOT_CAPACITY);
         }
+    }
+
+    void do_write_next() {
+        auto self = shared_from_this();
+        const OutgoingMessage& message = *m_write_ring[m_write_head];
+        std::array<boost::asio::const_buffer, 2> buffers = {
+            boost::asio::buffer(&message.header, sizeof(DoIPHeader)), boost::asio::buffer(message.payload)};
         boost::asio::async_write(m_socket, buffers,
-            [this, self, response_header](const boost::system::error_code& ec, std::size_t) {
-                if (!ec) {
+            make_custom_alloc_handler(m_handler_memory, [this, self](const boost::system::error_code& ec, std::size_t length) {
+                g_metrics.doip_bytes_sent.add(0, length);
+                if (ec) {
+                    stop_periodic();
+                    ECU_LOG_WARN("SESSION", "Error on write: %s", ec.message().c_str());
+                    return;
+                }
+                bool resume_reading = m_write_ring[m_write_head]->resume_reading;
+                m_write_head = (m_write_head + 1) % m_write_ring.size();
+                --m_write_count;
+                if (m_write_count > 0) {
+                    do_write_next();
+                }
+                if (resume_reading) {
                     do_read_header();
-                } else {
-                    std::cerr << "[SESSION] Error on write: " << ec.message() << std::endl;
                 }
-            });
+            }));
     }
 
     void do_write_vehicle_announcement() {
-        std::string vin = "VECU-SIM-1234567";
-        std::vector<uint8_t> payload(vin.begin(), vin.end());
-        do_write_generic_response(0x0005, payload);
+        const std::string& vin = m_ecu.vin();
+        record_request_metrics(0x0005);
+        queue_response(0x0005, reinterpret_cast<const uint8_t*>(vin.data()), vin.size(), true);
     }
 
-    tcp::socket m_socket;
+    EcuInstance& m_ecu;
+    SessionSocket m_socket;
+    boost::asio::strand<BlockingExecutor> m_file_strand;
     DoIPHeader m_received_header;
     std::vector<uint8_t> m_payload;
-    std::ofstream m_update_file;
+    std::vector<uint8_t> m_response; // Scratch buffer for building a reply
+    uint64_t m_request_started = 0;  // metric_now_ns() when the current request arrived
+    size_t m_request_metric = METRIC_SERVICE_OTHER; // request_duration slot of the current request
+    uint8_t m_request_sid = 0;
+    HandlerMemory m_handler_memory;
+    struct OutgoingMessage {
+        DoIPHeader header;
+        std::vector<uint8_t> payload;
+        bool resume_reading;
+    };
+    // Ring of queued responses; m_write_ring[m_write_head] is being written.
+    std::vector<std::unique_ptr<OutgoingMessage>> m_write_ring;
+    size_t m_write_head = 0;
+    size_t m_write_count = 0;
+    std::ofstream m_update_file; // Only touched on m_file_strand
+    Sha256Stream m_update_digest; // Running hash of update.bin; only touched on m_file_strand
+    uint64_t m_image_size = 0;          // memorySize of the current download; m_file_strand only
+    uint64_t m_image_bytes_written = 0; // Decoded image bytes in update.bin; m_file_strand only
+    std::unique_ptr<OtaInflater> m_inflater; // Set for OTA_FORMAT_COMPRESSED; m_file_strand only
+    ReadOnlyMapping m_delta_base;  // Installed image during a delta download; m_file_strand only
+    std::unique_ptr<OtaDeltaDecoder> m_delta_decoder; // Set for OTA_FORMAT_DELTA; m_file_strand only
+    std::unique_ptr<OtaDownloadProgress> m_progress; // Set for OTA_FORMAT_MANIFEST; m_file_strand only
+    bool m_manifest_download = false;
+    size_t m_next_chunk = 0; // Chunk carried by the next TransferData block of a manifest download
+    bool m_download_active = false;
+
+    // --- Periodic identifier state (socket strand only, except the tick flag) ---
+    std::array<uint64_t, PERIODIC_DIDS.size()> m_periodic_rate{}; // Cycles between samples; 0 = inactive
+    std::array<uint64_t, PERIODIC_DIDS.size()> m_periodic_last{}; // Cycle of the last sample sent
+    PeriodicSnapshot m_periodic_snapshot;
+    bool m_periodic_subscribed = false;
+    std::atomic<bool> m_periodic_tick_pending{false};
+
+    // --- Windowed TransferData state ---
+    uint8_t m_transfer_window = 1;   // Blocks the client may have unacknowledged
+    uint8_t m_ack_interval = 1;      // Completed writes per cumulative 0x76
+    uint32_t m_blocks_in_flight = 0; // Received but not yet written to disk
+    uint32_t m_blocks_unacked = 0;   // Written but not yet acknowledged
+    bool m_read_paused = false;      // Reading stopped because the window is full
+    std::vector<std::vector<uint8_t>> m_spare_buffers;
     uint32_t m_firmware_file_size;
     uint32_t m_bytes_received;
 };
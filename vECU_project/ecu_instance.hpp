@@ -0,0 +1,393 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ecu_log.hpp"
+#include "ecu_state.hpp"
+#include "nvram_manager.hpp"
+#include "periodic_publisher.hpp"
+#include "metrics.hpp"
+#include "acc_image.hpp"
+#include "ota_manifest.hpp"
+
+extern EcuMetrics g_metrics;
+
+// This uses preprocessor directives to set the correct library name based on the OS
+// Slot A keeps the historical name, so existing installs boot from it.
+#if defined(__APPLE__)
+    const std::string ACC_LIBRARY_NAME = "libacc_app.dylib";
+    const std::string ACC_LIBRARY_NAME_B = "libacc_app.b.dylib";
+#else
+    const std::string ACC_LIBRARY_NAME = "libacc_app.so";
+    const std::string ACC_LIBRARY_NAME_B = "libacc_app.b.so";
+#endif
+const char* const ACC_SLOT_MARKER_NAME = "acc_slot"; // Holds "A" or "B"
+
+// How updates are vetted and backed out.
+struct AccSlotPolicy {
+    bool smoke_cycle = true;     // Run one cycle in the probe child before activating
+    unsigned rollback_after = 3; // Consecutive failed cycles before reverting; 0 never reverts
+};
+
+// One simulated ECU: its state machine, parameter store, ACC application and
+// periodic data. A process hosts any number of them; the control loop steps
+// each once per cycle and every DoIP endpoint serves exactly one.
+//
+// An ECU's files (nvram.img and its journal, update.bin, the ACC library)
+// live in its own directory, or the working directory when it has none, so
+// ECUs can be updated and reflashed independently.
+//
+// The ACC application has two slots. An update is vetted on a DoIP blocking
+// thread (hash, a load probe and smoke cycle in a child process, then loading
+// it here) while the active image keeps running, and only then replaces the
+// inactive slot; a rejected update leaves both slots untouched. The control loop swaps the images between two cycles and
+// keeps the old one loaded; if the new one fails `rollback_after` cycles in
+// a row it swaps straight back.
+class EcuInstance {
+public:
+    // `directory` is created and seeded from the working directory's
+    // nvram.img and ACC library if it lacks its own. An empty directory
+    // means the working directory itself, as for a single ECU.
+    EcuInstance(unsigned index, const std::string& directory, AccImageCache& images, NvramFlusher* flusher = nullptr,
+                const AccSlotPolicy& slot_policy = {})
+        : m_index(index),
+          m_directory(directory.empty() ? std::string() : directory + "/"),
+          m_name(directory.empty() ? std::string("ECU") : directory),
+          m_log_prefix(directory.empty() ? std::string() : directory + ": "),
+          m_vin(make_vin(index)),
+          m_update_path(m_directory + "update.bin"),
+          m_slot_paths{(m_directory.empty() ? "./" : m_directory) + ACC_LIBRARY_NAME,
+                       (m_directory.empty() ? "./" : m_directory) + ACC_LIBRARY_NAME_B},
+          m_slot_marker_path(m_directory + ACC_SLOT_MARKER_NAME),
+          m_images(images),
+          m_flusher(flusher),
+          m_slot_policy(slot_policy),
+          m_nvram(m_directory + "nvram.img", m_directory + "nvram.dat") {
+        if (!m_directory.empty()) seed_directory();
+        std::ifstream marker(m_slot_marker_path);
+        if (marker.get() == 'B') m_active_slot = 1;
+    }
+
+    EcuInstance(const EcuInstance&) = delete;
+    EcuInstance& operator=(const EcuInstance&) = delete;
+
+    unsigned index() const { return m_index; }
+    const std::string& name() const { return m_name; }
+    const std::string& vin() const { return m_vin; }
+    const std::string& update_path() const { return m_update_path; }
+    // The active slot's library, which delta updates are built against.
+    const std::string& acc_library_path() const { return m_slot_paths[m_active_slot.load(std::memory_order_acquire)]; }
+
+    std::atomic<EcuState>& state() { return m_state; }
+    NVRAMManager& nvram() { return m_nvram; }
+    PeriodicPublisher& periodic_publisher() { return m_periodic_publisher; }
+
+    // One control cycle. Control loop thread only.
+    void step() {
+        EcuState state = m_state;
+        switch (state) {
+            case EcuState::BOOT:
+                run_boot_sequence();
+                break;
+            case EcuState::APPLICATION:
+                run_application_mode();
+                break;
+            case EcuState::UPDATE_PENDING:
+                if (m_previous_state != EcuState::UPDATE_PENDING) {
+                    ECU_LOG_INFO("STATE", "%sIn UPDATE_PENDING. Waiting for commands...", m_log_prefix.c_str());
+                }
+                // Updates go to the inactive slot, so the active image keeps control.
+                run_application_mode();
+                break;
+            case EcuState::BRICKED:
+                if (m_previous_state != EcuState::BRICKED) {
+                    ECU_LOG_ERROR("STATE", "%sECU is BRICKED. Halting operations.", m_log_prefix.c_str());
+                    unload_acc_application();
+                }
+                break;
+        }
+        m_previous_state = state;
+    }
+
+    // Installs the transferred update.bin in the inactive slot and vets it.
+    // Runs on a DoIP blocking thread while the control loop keeps running the
+    // active image; on success the control loop switches at its next cycle
+    // boundary. Returns false, leaving the active image in charge, if the
+    // image is rejected. With a manifest, `expected_hash_hex` is its Merkle
+    // root and the slot is re-verified chunk by chunk across threads.
+    bool apply_update(const std::string& expected_hash_hex, const OtaManifest* manifest = nullptr) {
+        ECU_LOG_INFO("OTA", "%sApplying update to ACC application...", m_log_prefix.c_str());
+        uint64_t started = metric_now_ns();
+        bool installed = install_in_inactive_slot(expected_hash_hex, manifest);
+        if (installed) g_metrics.ota_apply_duration.record(0, metric_now_ns() - started);
+        m_state = EcuState::APPLICATION;
+        return installed;
+    }
+
+    // Releases the ACC image. Control loop thread only.
+    void unload_acc_application() {
+        if (!m_acc) return;
+        m_acc.reset();
+        m_fallback.reset();
+        ECU_LOG_INFO("APP", "%sUnloaded ACC application library.", m_log_prefix.c_str());
+    }
+
+private:
+    static std::string make_vin(unsigned index) {
+        char vin[18];
+        std::snprintf(vin, sizeof(vin), "VECU-SIM-%07u", 1234567 + index);
+        return vin;
+    }
+
+    // Gives a new ECU directory the working directory's parameters and ACC
+    // library. The library is hard-linked where possible; an update replaces
+    // the link, never the file it points to.
+    void seed_directory() {
+        ::mkdir(m_directory.c_str(), 0755);
+        std::string nvram_path = m_directory + "nvram.img";
+        if (::access(nvram_path.c_str(), F_OK) != 0) {
+            if (::access("nvram.img", F_OK) == 0) copy_into("nvram.img", nvram_path);
+            else if (::access("nvram.dat", F_OK) == 0) copy_into("nvram.dat", m_directory + "nvram.dat");
+        }
+        if (::access(m_slot_paths[0].c_str(), F_OK) != 0 &&
+            ::link(ACC_LIBRARY_NAME.c_str(), m_slot_paths[0].c_str()) != 0) {
+            copy_into(ACC_LIBRARY_NAME, m_slot_paths[0]);
+        }
+    }
+
+    void copy_into(const std::string& from, const std::string& to) {
+        std::ifstream in(from, std::ios::binary);
+        std::ofstream out(to, std::ios::binary | std::ios::trunc);
+        out << in.rdbuf();
+        if (!out) ECU_LOG_WARN("BOOT", "%sCould not copy %s to %s", m_log_prefix.c_str(), from.c_str(), to.c_str());
+    }
+
+    void run_boot_sequence() {
+        ECU_LOG_INFO("STATE", "%sEntering BOOT...", m_log_prefix.c_str());
+
+        // Parameter writes go to an append-only journal; fsyncs are batched by
+        // the background flusher rather than paid on every commit.
+        NvramJournalConfig journal_config;
+        journal_config.fsync_every_commits = 0;
+        journal_config.fsync_interval = std::chrono::milliseconds(100);
+        journal_config.compact_threshold_bytes = 64 * 1024;
+        m_nvram.enable_journal(journal_config);
+        if (m_flusher) m_nvram.use_flusher(*m_flusher);
+
+        if (!m_nvram.load()) {
+            ECU_LOG_ERROR("BOOT", "%sCRITICAL: Failed to load NVRAM. Entering BRICKED state.", m_log_prefix.c_str());
+            m_state = EcuState::BRICKED;
+            return;
+        }
+
+        ECU_LOG_INFO("BOOT", "%sBoot sequence complete. Transitioning to APPLICATION state.", m_log_prefix.c_str());
+        m_state = EcuState::APPLICATION;
+    }
+
+    void run_application_mode() {
+        activate_staged_image();
+        // The environment is now stable and only changes via client commands.
+        if (load_acc_application()) {
+            // A cycle that leaves a non-finite speed or controller state has
+            // failed; its output is discarded.
+            float own_speed = m_nvram.get_float(NvramParam::OWN_VEHICLE_SPEED);
+            uint64_t started = metric_now_ns();
+            if (m_acc->run_instance) m_acc->run_instance(&m_nvram, &m_acc_state);
+            else m_acc->run();
+            g_metrics.acc_cycle_duration.record(0, metric_now_ns() - started);
+            if (!std::isfinite(m_nvram.get_float(NvramParam::OWN_VEHICLE_SPEED)) || !std::isfinite(m_acc_state.integral_error)) {
+                m_nvram.set_float(NvramParam::OWN_VEHICLE_SPEED, own_speed);
+                m_acc_state = AccInstanceState{};
+                handle_failed_cycle();
+            } else {
+                m_failed_cycles = 0;
+            }
+            // One encode per cycle, shared by every tester streaming periodic data.
+            m_periodic_publisher.publish(m_nvram);
+        } else {
+            ECU_LOG_ERROR("APP", "%sFailed to run application logic.", m_log_prefix.c_str());
+        }
+    }
+
+    // Makes sure an ACC image is loaded, normally just a pointer check. At
+    // boot the active slot is tried first and the other one if that fails.
+    bool load_acc_application() {
+        if (m_acc) return true;
+        int slot = m_active_slot.load(std::memory_order_relaxed);
+        for (int attempt = 0; attempt < 2; ++attempt, slot ^= 1) {
+            if (::access(m_slot_paths[slot].c_str(), F_OK) != 0) continue;
+            uint64_t started = metric_now_ns();
+            m_acc = m_images.acquire(m_slot_paths[slot], m_index, &m_nvram);
+            if (!m_acc) continue;
+            g_metrics.acc_load_duration.record(0, metric_now_ns() - started);
+            m_acc_state = AccInstanceState{}; // A new image starts from rest, as a fresh load always has
+            if (slot != m_active_slot.load(std::memory_order_relaxed)) {
+                ECU_LOG_WARN("APP", "%sSlot %c does not load; falling back to slot %c.", m_log_prefix.c_str(),
+                             slot_name(slot ^ 1), slot_name(slot));
+                set_active_slot(slot);
+            }
+            ECU_LOG_INFO("APP", "%sLoaded ACC application image from slot %c.", m_log_prefix.c_str(), slot_name(slot));
+            return true;
+        }
+        return false;
+    }
+
+    // Switches to an image vetted by apply_update(). One relaxed load per
+    // cycle when there is none.
+    void activate_staged_image() {
+        if (!m_staged_ready.load(std::memory_order_acquire)) return;
+        std::shared_ptr<AccImage> staged;
+        int slot;
+        {
+            std::lock_guard<std::mutex> lock(m_staged_mutex);
+            staged = std::move(m_staged);
+            slot = m_staged_slot;
+            m_staged_ready.store(false, std::memory_order_release);
+        }
+        if (!staged) return;
+        // A rollback since the install began made the target slot the active one.
+        if (m_active_slot.load(std::memory_order_relaxed) != (slot ^ 1)) {
+            ECU_LOG_ERROR("OTA", "%sERROR: Active slot changed during the install; discarding the image staged in slot %c.",
+                          m_log_prefix.c_str(), slot_name(slot));
+            return;
+        }
+        m_fallback = std::move(m_acc); // Stays loaded for an instant rollback
+        m_acc = std::move(staged);
+        m_acc_state = AccInstanceState{};
+        m_failed_cycles = 0;
+        set_active_slot(slot);
+        ECU_LOG_INFO("APP", "%sSwitched to ACC application image in slot %c.", m_log_prefix.c_str(), slot_name(slot));
+    }
+
+    void handle_failed_cycle() {
+        ++m_failed_cycles;
+        int slot = m_active_slot.load(std::memory_order_relaxed);
+        ECU_LOG_WARN("APP", "%sACC cycle in slot %c failed (%u in a row).", m_log_prefix.c_str(), slot_name(slot), m_failed_cycles);
+        if (m_slot_policy.rollback_after == 0 || m_failed_cycles < m_slot_policy.rollback_after || !m_fallback) return;
+        m_acc = std::move(m_fallback);
+        m_failed_cycles = 0;
+        set_active_slot(slot ^ 1);
+        ECU_LOG_ERROR("APP", "%sRolled back to ACC application image in slot %c.", m_log_prefix.c_str(), slot_name(slot ^ 1));
+    }
+
+    bool install_in_inactive_slot(const std::string& expected_hash_hex, const OtaManifest* manifest) {
+        if (m_staged_ready.load(std::memory_order_acquire)) {
+            ECU_LOG_ERROR("OTA", "%sERROR: The previous update has not been activated yet.", m_log_prefix.c_str());
+            return false;
+        }
+        int slot = m_active_slot.load(std::memory_order_acquire) ^ 1;
+        const std::string& path = m_slot_paths[slot];
+        // The inactive slot holds the last known-good image, which a restart
+        // falls back to. The update is vetted under a temporary name next to
+        // it and only renamed over it once every check has passed.
+        std::string incoming = path + ".incoming";
+        if (std::rename(m_update_path.c_str(), incoming.c_str()) != 0) {
+            ECU_LOG_ERROR("OTA", "%sCRITICAL: Failed to apply update to library: %s", m_log_prefix.c_str(), std::strerror(errno));
+            return false;
+        }
+        auto reject = [&]() {
+            ::unlink(incoming.c_str());
+            return false;
+        };
+        bool intact;
+        if (manifest) {
+            std::vector<uint8_t> valid = verify_ota_chunks(incoming, *manifest);
+            intact = sha256_digest_hex(manifest->root()) == expected_hash_hex &&
+                     std::all_of(valid.begin(), valid.end(), [](uint8_t ok) { return ok != 0; });
+        } else {
+            auto hash = sha256_file_hex(incoming);
+            intact = hash && *hash == expected_hash_hex;
+        }
+        if (!intact) {
+            ECU_LOG_ERROR("OTA", "%sERROR: The update does not match the transferred image; slot %c is unchanged.",
+                          m_log_prefix.c_str(), slot_name(slot));
+            return reject();
+        }
+        std::string nvram_image = m_directory + "nvram.img";
+        if (!probe_acc_library(incoming, ::access(nvram_image.c_str(), F_OK) == 0 ? nvram_image : std::string(), m_slot_policy.smoke_cycle)) {
+            ECU_LOG_ERROR("OTA", "%sERROR: The update failed validation; slot %c is unchanged and slot %c stays active.",
+                          m_log_prefix.c_str(), slot_name(slot), slot_name(slot ^ 1));
+            return reject();
+        }
+        uint64_t started = metric_now_ns();
+        auto image = m_images.acquire(incoming, m_index, &m_nvram);
+        if (!image) return reject();
+        g_metrics.acc_load_duration.record(0, metric_now_ns() - started);
+        {
+            std::lock_guard<std::mutex> lock(m_staged_mutex);
+            if (m_active_slot.load(std::memory_order_acquire) != (slot ^ 1)) {
+                ECU_LOG_ERROR("OTA", "%sERROR: Active slot changed during the install; discarding the update for slot %c.",
+                              m_log_prefix.c_str(), slot_name(slot));
+                return reject();
+            }
+            if (std::rename(incoming.c_str(), path.c_str()) != 0) {
+                ECU_LOG_ERROR("OTA", "%sCRITICAL: Failed to install the update in slot %c: %s", m_log_prefix.c_str(),
+                              slot_name(slot), std::strerror(errno));
+                return reject();
+            }
+            m_staged = std::move(image);
+            m_staged_slot = slot;
+            m_staged_ready.store(true, std::memory_order_release);
+        }
+        ECU_LOG_INFO("OTA", "%sUpdate validated in slot %c. ECU will switch to it at the next cycle.", m_log_prefix.c_str(), slot_name(slot));
+        return true;
+    }
+
+    // Records the active slot so the next start boots from it.
+    void set_active_slot(int slot) {
+        m_active_slot.store(slot, std::memory_order_release);
+        std::string temp_path = m_slot_marker_path + ".tmp";
+        {
+            std::ofstream marker(temp_path, std::ios::trunc);
+            marker << slot_name(slot) << '\n';
+            if (!marker) return;
+        }
+        if (std::rename(temp_path.c_str(), m_slot_marker_path.c_str()) != 0) {
+            ECU_LOG_WARN("APP", "%sCould not record the active slot: %s", m_log_prefix.c_str(), std::strerror(errno));
+        }
+    }
+
+    static char slot_name(int slot) { return slot == 0 ? 'A' : 'B'; }
+
+    const unsigned m_index;
+    const std::string m_directory; // Empty or ending in '/'
+    const std::string m_name;
+    const std::string m_log_prefix; // Empty for a single ECU, so its output reads as before
+    const std::string m_vin;
+    const std::string m_update_path;
+    const std::array<std::string, 2> m_slot_paths; // A, B
+    const std::string m_slot_marker_path;
+    AccImageCache& m_images;
+    NvramFlusher* m_flusher;
+    const AccSlotPolicy m_slot_policy;
+
+    std::atomic<EcuState> m_state{EcuState::BOOT};
+    EcuState m_previous_state = EcuState::BOOT; // Control loop thread only
+    NVRAMManager m_nvram;
+    PeriodicPublisher m_periodic_publisher; // Feeds ReadDataByPeriodicIdentifier subscribers
+
+    // --- ACC application (control loop thread only, except as noted) ---
+    std::atomic<int> m_active_slot{0};   // Read by DoIP threads
+    std::shared_ptr<AccImage> m_acc;      // Image in the active slot
+    std::shared_ptr<AccImage> m_fallback; // Previously active image, until the next update
+    AccInstanceState m_acc_state{};
+    unsigned m_failed_cycles = 0;
+    std::mutex m_staged_mutex;            // Guards m_staged and m_staged_slot (DoIP blocking thread -> control loop)
+    std::shared_ptr<AccImage> m_staged;
+    int m_staged_slot = 0;                // Slot m_staged was installed in
+    std::atomic<bool> m_staged_ready{false};
+};
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// --- Log levels ---
+// Numbered to match the ACC_LOG_* levels in acc_controller.hpp, which the
+// application passes through the C logging ABI.
+enum class LogLevel : int {
+    TRACE = 0,
+    DEBUG = 1,
+    INFO = 2,
+    WARN = 3,
+    ERROR = 4
+};
+
+// Messages below this level are removed at compile time; their arguments
+// are never evaluated. Override with -DVECU_LOG_MIN_LEVEL=<0..4>.
+#ifndef VECU_LOG_MIN_LEVEL
+#define VECU_LOG_MIN_LEVEL 2
+#endif
+
+// Asynchronous logger for the platform. Callers format into a slot of a
+// bounded lock-free multi-producer ring (Vyukov's sequence-numbered queue)
+// and return; a background thread drains the ring and does the actual
+// writes, so neither the control loop nor a DoIP handler ever waits on a
+// terminal or pipe. If the ring is full the message is dropped and counted
+// rather than blocking the caller.
+//
+// WARN and ERROR go to stderr, everything else to stdout, each line as
+// "[TAG] message" like the rest of the platform's output.
+class EcuLogger {
+public:
+    static constexpr size_t CAPACITY = 1024; // Records; a power of two
+    static constexpr size_t TAG_CAPACITY = 16;
+    static constexpr size_t TEXT_CAPACITY = 232;
+
+    EcuLogger() : m_slots(new Slot[CAPACITY]) {
+        for (size_t i = 0; i < CAPACITY; ++i) m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        m_writer = std::thread([this]() { writer_loop(); });
+    }
+
+    ~EcuLogger() {
+        {
+            std::lock_guard<std::mutex> lock(m_writer_mutex);
+            m_stop = true;
+        }
+        m_writer_cv.notify_one();
+        m_writer.join();
+    }
+
+    EcuLogger(const EcuLogger&) = delete;
+    EcuLogger& operator=(const EcuLogger&) = delete;
+
+    void log(LogLevel level, const char* tag, const char* format, ...) __attribute__((format(printf, 4, 5))) {
+        va_list args;
+        va_start(args, format);
+        vlog(level, tag, format, args);
+        va_end(args);
+    }
+
+    // Lock-free; safe from any thread. Text longer than TEXT_CAPACITY - 1
+    // bytes is truncated.
+    void vlog(LogLevel level, const char* tag, const char* format, va_list args) {
+        if (static_cast<int>(level) < m_level.load(std::memory_order_relaxed)) return;
+        size_t position = m_enqueue_position.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &m_slots[position & (CAPACITY - 1)];
+            size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (difference == 0) {
+                if (m_enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+            } else if (difference < 0) {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            } else {
+                position = m_enqueue_position.load(std::memory_order_relaxed);
+            }
+        }
+
+        Record& record = slot->record;
+        record.level = level;
+        std::strncpy(record.tag, tag ? tag : "", TAG_CAPACITY - 1);
+        record.tag[TAG_CAPACITY - 1] = '\0';
+        int length = std::vsnprintf(record.text, TEXT_CAPACITY, format, args);
+        record.length = static_cast<uint16_t>(std::clamp(length, 0, static_cast<int>(TEXT_CAPACITY - 1)));
+        slot->sequence.store(position + 1, std::memory_order_release);
+    }
+
+    // Blocks until everything logged before the call has been written.
+    void flush() {
+        size_t target = m_enqueue_position.load(std::memory_order_acquire);
+        std::unique_lock<std::mutex> lock(m_writer_mutex);
+        m_flush_requested = true;
+        m_writer_cv.notify_one();
+        m_flushed_cv.wait(lock, [&]() { return m_written >= target || m_stop; });
+    }
+
+    uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+    // Runtime threshold on top of VECU_LOG_MIN_LEVEL; messages below it are
+    // discarded before formatting.
+    void set_level(LogLevel level) { m_level.store(static_cast<int>(level), std::memory_order_relaxed); }
+
+private:
+    struct Record {
+        LogLevel level;
+        char tag[TAG_CAPACITY];
+        uint16_t length;
+        char text[TEXT_CAPACITY];
+    };
+    struct alignas(64) Slot {
+        std::atomic<size_t> sequence;
+        Record record;
+    };
+
+    // Single consumer: the writer thread.
+    bool drain() {
+        bool wrote_any = false;
+        while (true) {
+            Slot& slot = m_slots[m_dequeue_position & (CAPACITY - 1)];
+            if (slot.sequence.load(std::memory_order_acquire) != m_dequeue_position + 1) break;
+            const Record& record = slot.record;
+            std::FILE* stream = record.level >= LogLevel::WARN ? stderr : stdout;
+            std::fprintf(stream, "[%s] %.*s\n", record.tag, static_cast<int>(record.length), record.text);
+            slot.sequence.store(m_dequeue_position + CAPACITY, std::memory_order_release);
+            ++m_dequeue_position;
+            wrote_any = true;
+        }
+        uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+        if (dropped != m_reported_dropped) {
+            std::fprintf(stderr, "[LOG] WARNING: %llu message(s) dropped; log ring was full.\n",
+                         static_cast<unsigned long long>(dropped - m_reported_dropped));
+            m_reported_dropped = dropped;
+            wrote_any = true;
+        }
+        if (wrote_any) {
+            std::fflush(stdout);
+            std::fflush(stderr);
+        }
+        return wrote_any;
+    }
+
+    // Producers never signal (that would cost them a lock or a syscall), so
+    // the writer polls on a short timer and drains whatever has arrived.
+    void writer_loop() {
+        std::unique_lock<std::mutex> lock(m_writer_mutex);
+        while (true) {
+            lock.unlock();
+            drain();
+            lock.lock();
+            // A flush may wait for a record a producer had claimed but not yet
+            // published when the request arrived, so waiters are woken on every
+            // pass that writes something, not only on the pass that answers it.
+            bool advanced = m_written != m_dequeue_position;
+            m_written = m_dequeue_position;
+            if (m_flush_requested || advanced) {
+                m_flush_requested = false;
+                m_flushed_cv.notify_all();
+            }
+            if (m_stop) break;
+            m_writer_cv.wait_for(lock, WRITER_POLL_INTERVAL, [&]() { return m_stop || m_flush_requested; });
+        }
+        lock.unlock();
+        drain(); // Anything logged while stopping
+        lock.lock();
+        m_written = m_dequeue_position;
+        m_flushed_cv.notify_all();
+    }
+
+    static constexpr std::chrono::milliseconds WRITER_POLL_INTERVAL{2};
+
+    std::unique_ptr<Slot[]> m_slots;
+    alignas(64) std::atomic<size_t> m_enqueue_position{0};
+    alignas(64) size_t m_dequeue_position = 0; // Writer thread only
+    std::atomic<uint64_t> m_dropped{0};
+    std::atomic<int> m_level{VECU_LOG_MIN_LEVEL};
+    uint64_t m_reported_dropped = 0; // Writer thread only
+
+    std::mutex m_writer_mutex;
+    std::condition_variable m_writer_cv;
+    std::condition_variable m_flushed_cv;
+    bool m_stop = false;
+    bool m_flush_requested = false;
+    size_t m_written = 0; // Records written so far; guarded by m_writer_mutex
+    std::thread m_writer;
+};
+
+// The platform's logger, defined in main.cpp.
+extern EcuLogger g_logger;
+
+#define ECU_LOG(level, tag, ...)                                                   \
+    do {                                                                           \
+        if constexpr (static_cast<int>(level) >= VECU_LOG_MIN_LEVEL) {             \
+            g_logger.log(level, tag, __VA_ARGS__);                                 \
+        }                                                                          \
+    } while (0)
+
+#define ECU_LOG_TRACE(tag, ...) ECU_LOG(LogLevel::TRACE, tag, __VA_ARGS__)
+#define ECU_LOG_DEBUG(tag, ...) ECU_LOG(LogLevel::DEBUG, tag, __VA_ARGS__)
+#define ECU_LOG_INFO(tag, ...)  ECU_LOG(LogLevel::INFO, tag, __VA_ARGS__)
+#define ECU_LOG_WARN(tag, ...)  ECU_LOG(LogLevel::WARN, tag, __VA_ARGS__)
+#define ECU_LOG_ERROR(tag, ...) ECU_LOG(LogLevel::ERROR, tag, __VA_ARGS__)
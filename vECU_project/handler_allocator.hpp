@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+// A few handler-sized blocks owned by one connection. Asio allocates every
+// operation and every posted completion through the handler's associated
+// allocator; routing those through a fixed set of slots keeps a session's
+// steady-state request/response loop off the heap. Requests that do not fit
+// (too large, or all slots busy) fall back to operator new.
+//
+// Slots are claimed with an atomic flag because completions for one session
+// can be allocated from more than one thread (its socket strand and its
+// blocking-work strand).
+class HandlerMemory {
+public:
+    static constexpr size_t SLOT_SIZE = 512;
+    static constexpr size_t SLOT_COUNT = 6;
+
+    HandlerMemory() = default;
+    HandlerMemory(const HandlerMemory&) = delete;
+    HandlerMemory& operator=(const HandlerMemory&) = delete;
+
+    void* allocate(size_t size) {
+        if (size <= SLOT_SIZE) {
+            for (size_t i = 0; i < SLOT_COUNT; ++i) {
+                if (!m_in_use[i].load(std::memory_order_relaxed) &&
+                    !m_in_use[i].exchange(true, std::memory_order_acquire)) {
+                    return m_slots[i].bytes;
+                }
+            }
+        }
+        return ::operator new(size);
+    }
+
+    void deallocate(void* pointer) {
+        for (size_t i = 0; i < SLOT_COUNT; ++i) {
+            if (pointer == m_slots[i].bytes) {
+                m_in_use[i].store(false, std::memory_order_release);
+                return;
+            }
+        }
+        ::operator delete(pointer);
+    }
+
+private:
+    struct Slot {
+        alignas(std::max_align_t) unsigned char bytes[SLOT_SIZE];
+    };
+    Slot m_slots[SLOT_COUNT];
+    std::atomic<bool> m_in_use[SLOT_COUNT] = {};
+};
+
+// Standard allocator over a HandlerMemory, as required by associated_allocator.
+template <typename T>
+class HandlerAllocator {
+public:
+    using value_type = T;
+
+    explicit HandlerAllocator(HandlerMemory& memory) : m_memory(&memory) {}
+
+    template <typename U>
+    HandlerAllocator(const HandlerAllocator<U>& other) noexcept : m_memory(other.m_memory) {}
+
+    T* allocate(size_t n) const {
+        return static_cast<T*>(m_memory->allocate(sizeof(T) * n));
+    }
+
+    void deallocate(T* pointer, size_t) const {
+        m_memory->deallocate(pointer);
+    }
+
+    bool operator==(const HandlerAllocator& other) const noexcept { return m_memory == other.m_memory; }
+    bool operator!=(const HandlerAllocator& other) const noexcept { return m_memory != other.m_memory; }
+
+private:
+    template <typename> friend class HandlerAllocator;
+    HandlerMemory* m_memory;
+};
+
+// Wraps a completion handler so asio allocates its operation from `memory`.
+template <typename Handler>
+class CustomAllocHandler {
+public:
+    using allocator_type = HandlerAllocator<Handler>;
+
+    CustomAllocHandler(HandlerMemory& memory, Handler handler)
+        : m_memory(memory), m_handler(std::move(handler)) {}
+
+    allocator_type get_allocator() const noexcept {
+        return allocator_type(m_memory);
+    }
+
+    template <typename... Args>
+    void operator()(Args&&... args) {
+        m_handler(std::forward<Args>(args)...);
+    }
+
+private:
+    HandlerMemory& m_memory;
+    Handler m_handler;
+};
+
+template <typename Handler>
+inline CustomAllocHandler<Handler> make_custom_alloc_handler(HandlerMemory& memory, Handler handler) {
+    return CustomAllocHandler<Handler>(memory, std::move(handler));
+}
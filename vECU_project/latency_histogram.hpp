@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Log-linear latency histogram in the style of HdrHistogram. Values (in
+// nanoseconds) below 128 are counted exactly; above that each power-of-two
+// range is split into 64 sub-buckets, so any reported value is within about
+// 1.6% of the true one. Recording is O(1) and the memory is fixed (about
+// 30 KiB) regardless of how many samples are taken.
+class LatencyHistogram {
+public:
+    static constexpr unsigned SUB_BUCKET_BITS = 7;
+    static constexpr uint64_t SUB_BUCKET_COUNT = uint64_t(1) << SUB_BUCKET_BITS;
+    static constexpr uint64_t SUB_BUCKET_HALF = SUB_BUCKET_COUNT / 2;
+
+    LatencyHistogram() : m_counts((64 - SUB_BUCKET_BITS + 2) * SUB_BUCKET_HALF, 0) {}
+
+    void record(uint64_t value_ns) {
+        ++m_counts[index_of(value_ns)];
+        ++m_total;
+        m_sum += value_ns;
+        m_min = std::min(m_min, value_ns);
+        m_max = std::max(m_max, value_ns);
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < m_counts.size(); ++i) m_counts[i] += other.m_counts[i];
+        m_total += other.m_total;
+        m_sum += other.m_sum;
+        m_min = std::min(m_min, other.m_min);
+        m_max = std::max(m_max, other.m_max);
+    }
+
+    uint64_t count() const { return m_total; }
+    uint64_t min() const { return m_total ? m_min : 0; }
+    uint64_t max() const { return m_max; }
+    double mean() const { return m_total ? static_cast<double>(m_sum) / m_total : 0.0; }
+
+    // Smallest recorded bucket value at or above the given percentile
+    // (0-100), reported as the bucket's upper bound and capped at max().
+    uint64_t percentile(double percent) const {
+        if (m_total == 0) return 0;
+        uint64_t wanted = static_cast<uint64_t>(percent / 100.0 * m_total + 0.5);
+        wanted = std::clamp<uint64_t>(wanted, 1, m_total);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < m_counts.size(); ++i) {
+            seen += m_counts[i];
+            if (seen >= wanted) return std::min(highest_equivalent(i), m_max);
+        }
+        return m_max;
+    }
+
+private:
+    static size_t index_of(uint64_t value) {
+        unsigned bits = 64 - __builtin_clzll(value | 1);
+        unsigned bucket = bits > SUB_BUCKET_BITS ? bits - SUB_BUCKET_BITS : 0;
+        return static_cast<size_t>(bucket * SUB_BUCKET_HALF + (value >> bucket));
+    }
+
+    static uint64_t highest_equivalent(size_t index) {
+        unsigned bucket = index < SUB_BUCKET_COUNT ? 0 : static_cast<unsigned>(index / SUB_BUCKET_HALF - 1);
+        uint64_t sub_bucket = index - bucket * SUB_BUCKET_HALF;
+        return ((sub_bucket + 1) << bucket) - 1;
+    }
+
+    std::vector<uint64_t> m_counts;
+    uint64_t m_total = 0;
+    uint64_t m_sum = 0;
+    uint64_t m_min = UINT64_MAX;
+    uint64_t m_max = 0;
+};
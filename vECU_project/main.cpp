@@ -5,144 +5,164 @@
 #include <csignal>
 #include <memory>
 #include <vector>
-#include <iomanip>
 #include <sstream>
 #include <fstream>
 #include <cstdio>
+#include <cstring>
 #include <random>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstdarg>
 
 #include <openssl/evp.h>
 #include <openssl/sha.h>
-#include <dlfcn.h> // Required for dynamic library loading
 
+#include "ecu_log.hpp"
 #include "ecu_state.hpp"
 #include "nvram_manager.hpp"
+#include "ecu_instance.hpp"
+#include "acc_image.hpp"
 #include "doip_server.hpp"
+#include "cycle_scheduler.hpp"
+#include "sha256_stream.hpp"
+#include "Adaptive_Cruise_Control/acc_controller.hpp"
+
+extern "C" void acc_log_to_platform(int level, const char* tag, const char* format, ...);
 
 // --- Global state and control variables ---
-std::atomic<EcuState> g_ecu_state(EcuState::BOOT);
+EcuLogger g_logger; // Defined first so it outlives every other global that logs
 std::atomic<bool> g_running(true);
-NVRAMManager g_nvram("nvram.dat");
-std::string g_executable_path;
-
-// --- Dynamic Library Handling ---
-void* g_acc_library_handle = nullptr;
-void (*g_run_acc_application)() = nullptr;
+EcuMetrics g_metrics; // Process-wide; shared by every hosted ECU
+std::atomic<bool> g_metrics_dump_requested(false); // Set by SIGUSR1
+const char* const METRICS_DUMP_PATH = "metrics.prom";
 
-// This uses preprocessor directives to set the correct library name based on the OS
-#if defined(__APPLE__)
-    const std::string ACC_LIBRARY_PATH = "./libacc_app.dylib";
-#else
-    const std::string ACC_LIBRARY_PATH = "./libacc_app.so";
-#endif
+// --- Hosted ECUs ---
+// One ECU runs in the working directory; with --instances K, ECU i runs in
+// ecu<i>/ and listens on the base port + i. They share the control loop, the
+// DoIP threads, one NVRAM flusher thread and every identical ACC image.
+unsigned g_instance_count = 1;
+NvramFlusher g_nvram_flusher(std::chrono::milliseconds(100));
+AccImageCache g_acc_images(acc_log_to_platform);
+AccSlotPolicy g_slot_policy;
+std::vector<std::unique_ptr<EcuInstance>> g_ecus;
 
+// --- Control loop timing ---
+std::unique_ptr<CycleScheduler> g_cycle_scheduler;
+const std::chrono::seconds CYCLE_STATS_INTERVAL(10);
+// Bounds for --cycle-ms. Shorter periods only measure scheduler overhead, and
+// the period divides CYCLE_STATS_INTERVAL and paces CycleScheduler.
+const std::chrono::microseconds MIN_CYCLE_PERIOD(100);
+const std::chrono::seconds MAX_CYCLE_PERIOD(60);
 
 // --- Networking objects ---
 boost::asio::io_context g_io_context;
+unsigned g_doip_threads = std::max(1u, std::thread::hardware_concurrency());
+unsigned short g_doip_port = 13400; // Base port with --instances
 std::unique_ptr<DoIPServer> g_doip_server;
 std::thread g_server_thread;
 
 // --- Function Prototypes ---
-void run_boot_sequence(const std::string& executable_path);
-void run_application_mode();
 void handle_signal(int signal);
+void write_metrics_dump();
+bool parse_command_line(int argc, char* argv[], CycleSchedulerConfig& config);
+void print_cycle_stats();
 void start_network_server();
 void stop_network_server();
 std::optional<std::string> calculate_file_hash(const std::string& file_path);
-void apply_update(const std::string& library_path);
-bool load_acc_application();
-void unload_acc_application();
 
 
 std::optional<std::string> calculate_file_hash(const std::string& file_path) {
-    std::ifstream file(file_path, std::ios::binary);
-    if (!file.is_open()) {
-        std::cerr << "[HASH] ERROR: Could not open file: " << file_path << std::endl;
-        return std::nullopt;
-    }
-
-    EVP_MD_CTX* md_context = EVP_MD_CTX_new();
-    if (!md_context || 1 != EVP_DigestInit_ex(md_context, EVP_sha256(), NULL)) {
-        if(md_context) EVP_MD_CTX_free(md_context);
-        return std::nullopt;
-    }
-
-    char buffer[1024];
-    while (file.read(buffer, sizeof(buffer))) {
-        if (1 != EVP_DigestUpdate(md_context, buffer, file.gcount())) {
-            EVP_MD_CTX_free(md_context);
-            return std::nullopt;
-        }
-    }
-    if (file.gcount() > 0) {
-        if (1 != EVP_DigestUpdate(md_context, buffer, file.gcount())) {
-            EVP_MD_CTX_free(md_context);
-            return std::nullopt;
-        }
-    }
-
-    unsigned char hash[EVP_MAX_MD_SIZE];
-    unsigned int hash_len;
-    if (1 != EVP_DigestFinal_ex(md_context, hash, &hash_len)) {
-        EVP_MD_CTX_free(md_context);
-        return std::nullopt;
-    }
-    EVP_MD_CTX_free(md_context);
-
-    std::stringstream ss;
-    for (unsigned int i = 0; i < hash_len; i++) {
-        ss << std::hex << std::setw(2) << std::setfill('0') << (int)hash[i];
-    }
-    return ss.str();
+    return sha256_file_hex(file_path);
 }
 
 int main(int argc, char* argv[]) {
     if (argc < 1) return 1;
-    g_executable_path = argv[0];
+    if (argc == 5 && std::strcmp(argv[1], ACC_PROBE_OPTION) == 0) {
+        // Child started by probe_acc_library() to vet an update.
+        return run_acc_probe(argv[2], argv[3], std::strcmp(argv[4], "1") == 0);
+    }
+
+    CycleSchedulerConfig scheduler_config;
+    if (!parse_command_line(argc, argv, scheduler_config)) return 1;
 
     signal(SIGINT, handle_signal);
+    signal(SIGUSR1, handle_signal);
 
     std::cout << "--- Virtual ECU Simulation V4 Started ---" << std::endl;
+    if (g_instance_count > 1) {
+        std::cout << "--- Hosting " << g_instance_count << " ECUs on ports " << g_doip_port << "-"
+                  << g_doip_port + g_instance_count - 1 << ". ---" << std::endl;
+    }
     std::cout << "--- Use the client to change speed and gap settings at runtime. ---" << std::endl;
     std::cout << "Press Ctrl+C to shut down." << std::endl;
 
+    g_ecus.reserve(g_instance_count);
+    for (unsigned i = 0; i < g_instance_count; ++i) {
+        std::string directory = g_instance_count > 1 ? "ecu" + std::to_string(i) : std::string();
+        g_ecus.push_back(std::make_unique<EcuInstance>(i, directory, g_acc_images, &g_nvram_flusher, g_slot_policy));
+    }
+
     start_network_server();
 
+    g_cycle_scheduler = std::make_unique<CycleScheduler>(scheduler_config);
+    g_cycle_scheduler->start();
+    const uint64_t stats_every = std::max<uint64_t>(1, CYCLE_STATS_INTERVAL / scheduler_config.period);
+
     while (g_running) {
-        switch (g_ecu_state) {
-            case EcuState::BOOT:
-                run_boot_sequence(g_executable_path);
-                break;
-            case EcuState::APPLICATION:
-                run_application_mode();
-                break;
-            case EcuState::UPDATE_PENDING:
-                std::cout << "[STATE] In UPDATE_PENDING. Waiting for commands..." << std::endl;
-                std::this_thread::sleep_for(std::chrono::seconds(2));
-                break;
-            case EcuState::BRICKED:
-                std::cerr << "[STATE] ECU is BRICKED. Halting operations." << std::endl;
-                g_running = false;
-                break;
+        bool all_bricked = true;
+        for (auto& ecu : g_ecus) {
+            ecu->step();
+            all_bricked = all_bricked && ecu->state() == EcuState::BRICKED;
+        }
+        if (all_bricked) {
+            if (g_ecus.size() > 1) ECU_LOG_ERROR("STATE", "Every ECU is BRICKED. Halting operations.");
+            g_running = false;
+            continue;
+        }
+
+        if (g_cycle_scheduler->wait_next_cycle()) {
+            g_metrics.cycle_overruns.add(0);
+        }
+        if (g_metrics_dump_requested.exchange(false)) {
+            // Rendering and writing the file stays off the control loop.
+            boost::asio::post(g_io_context, write_metrics_dump);
+        }
+        if (g_cycle_scheduler->stats().cycles % stats_every == 0) {
+            print_cycle_stats();
         }
     }
 
+    print_cycle_stats();
     stop_network_server();
-    unload_acc_application(); // Unload the library on shutdown
+    g_doip_server.reset(); // Finishes any update still being installed
+    for (auto& ecu : g_ecus) {
+        ecu->unload_acc_application(); // Unload the library on shutdown
+    }
+    g_ecus.clear();
+    g_logger.flush();
     std::cout << "--- Virtual ECU Simulation Shutting Down ---" << std::endl;
     return 0;
 }
 
+// Opens every ECU's DoIP endpoint. An ECU whose port cannot be bound is
+// bricked; the others keep running.
 void start_network_server() {
-    try {
-        g_doip_server = std::make_unique<DoIPServer>(g_io_context, 13400);
-        g_server_thread = std::thread([]() {
-            g_doip_server->run();
-        });
-    } catch (const std::exception& e) {
-        std::cerr << "Failed to start network server: " << e.what() << std::endl;
-        g_ecu_state = EcuState::BRICKED;
+    g_doip_server = std::make_unique<DoIPServer>(g_io_context, g_doip_threads);
+    for (auto& ecu : g_ecus) {
+        unsigned short port = static_cast<unsigned short>(g_doip_port + ecu->index());
+        try {
+            g_doip_server->listen(*ecu, port);
+        } catch (const std::exception& e) {
+            ECU_LOG_ERROR("DoIP", "Failed to start network server on port %u: %s", port, e.what());
+            ecu->state() = EcuState::BRICKED;
+        }
     }
+    if (g_doip_server->endpoints() == 0) return;
+    g_server_thread = std::thread([]() {
+        g_doip_server->run();
+    });
 }
 
 void stop_network_server() {
@@ -154,68 +174,94 @@ void stop_network_server() {
     }
 }
 
-void run_boot_sequence(const std::string& executable_path) {
-    std::cout << "[STATE] Entering BOOT..." << std::endl;
-    if (!g_nvram.load()) {
-        std::cerr << "[BOOT] CRITICAL: Failed to load NVRAM. Entering BRICKED state." << std::endl;
-        g_ecu_state = EcuState::BRICKED;
-        return;
-    }
-    
-    std::cout << "[BOOT] Boot sequence complete. Transitioning to APPLICATION state." << std::endl;
-    g_ecu_state = EcuState::APPLICATION;
-}
-
-void run_application_mode() {
-    if (!g_running) return;
-    
-    // The environment is now stable and only changes via client commands.
-    if (load_acc_application()) {
-        if (g_run_acc_application) {
-            g_run_acc_application();
+// Accepts --cycle-ms <ms>, --sched-fifo <priority>, --cpu <index>, --doip-threads <n>, --port <port>,
+// --instances <n>, --log-level <level>, --smoke-cycle <on|off> and --rollback-after <n>.
+bool parse_command_line(int argc, char* argv[], CycleSchedulerConfig& config) {
+    static const char* const LOG_LEVEL_NAMES[] = {"trace", "debug", "info", "warn", "error"};
+    try {
+        for (int i = 1; i < argc; ++i) {
+            bool known = std::strcmp(argv[i], "--cycle-ms") == 0 || std::strcmp(argv[i], "--sched-fifo") == 0 ||
+                         std::strcmp(argv[i], "--cpu") == 0 || std::strcmp(argv[i], "--doip-threads") == 0 ||
+                         std::strcmp(argv[i], "--port") == 0 || std::strcmp(argv[i], "--instances") == 0 ||
+                         std::strcmp(argv[i], "--log-level") == 0 || std::strcmp(argv[i], "--smoke-cycle") == 0 ||
+                         std::strcmp(argv[i], "--rollback-after") == 0;
+            if (!known || i + 1 >= argc) {
+                std::cerr << "Usage: TargetECU [--cycle-ms <ms>] [--sched-fifo <priority>] [--cpu <index>] [--doip-threads <n>] [--port <port>]"
+                          << " [--instances <n>] [--log-level <trace|debug|info|warn|error>] [--smoke-cycle <on|off>] [--rollback-after <n>]" << std::endl;
+                return false;
+            }
+            if (std::strcmp(argv[i], "--cycle-ms") == 0) {
+                const char* text = argv[++i];
+                char* end = nullptr;
+                errno = 0;
+                double period_ms = std::strtod(text, &end);
+                if (end == text || *end != '\0' || errno == ERANGE || !std::isfinite(period_ms)) {
+                    std::cerr << "Invalid --cycle-ms value: " << text << std::endl;
+                    return false;
+                }
+                // Range-check in milliseconds so the conversion below cannot overflow.
+                const double min_ms = std::chrono::duration<double, std::milli>(MIN_CYCLE_PERIOD).count();
+                const double max_ms = std::chrono::duration<double, std::milli>(MAX_CYCLE_PERIOD).count();
+                if (!(period_ms >= min_ms && period_ms <= max_ms)) {
+                    std::cerr << "--cycle-ms must be between " << min_ms << " and " << max_ms << std::endl;
+                    return false;
+                }
+                config.period = std::chrono::nanoseconds(static_cast<int64_t>(period_ms * 1e6));
+            } else if (std::strcmp(argv[i], "--sched-fifo") == 0) {
+                config.fifo_priority = std::stoi(argv[++i]);
+            } else if (std::strcmp(argv[i], "--doip-threads") == 0) {
+                g_doip_threads = static_cast<unsigned>(std::max(1, std::stoi(argv[++i])));
+            } else if (std::strcmp(argv[i], "--port") == 0) {
+                g_doip_port = static_cast<unsigned short>(std::stoi(argv[++i]));
+            } else if (std::strcmp(argv[i], "--instances") == 0) {
+                g_instance_count = static_cast<unsigned>(std::max(1, std::stoi(argv[++i])));
+            } else if (std::strcmp(argv[i], "--log-level") == 0) {
+                const char* name = argv[++i];
+                auto level = std::find_if(std::begin(LOG_LEVEL_NAMES), std::end(LOG_LEVEL_NAMES),
+                                          [name](const char* candidate) { return std::strcmp(candidate, name) == 0; });
+                if (level == std::end(LOG_LEVEL_NAMES)) {
+                    std::cerr << "Unknown log level: " << name << std::endl;
+                    return false;
+                }
+                g_logger.set_level(static_cast<LogLevel>(level - std::begin(LOG_LEVEL_NAMES)));
+            } else if (std::strcmp(argv[i], "--smoke-cycle") == 0) {
+                g_slot_policy.smoke_cycle = std::strcmp(argv[++i], "off") != 0;
+            } else if (std::strcmp(argv[i], "--rollback-after") == 0) {
+                g_slot_policy.rollback_after = static_cast<unsigned>(std::max(0, std::stoi(argv[++i])));
+            } else {
+                config.cpu = std::stoi(argv[++i]);
+            }
         }
-    } else {
-        std::cerr << "[APP] Failed to run application logic." << std::endl;
-    }
-    
-    std::this_thread::sleep_for(std::chrono::milliseconds(200));
-}
-
-bool load_acc_application() {
-    if (g_acc_library_handle) {
-        dlclose(g_acc_library_handle);
-        g_acc_library_handle = nullptr;
-    }
-
-    g_acc_library_handle = dlopen(ACC_LIBRARY_PATH.c_str(), RTLD_LAZY);
-    if (!g_acc_library_handle) {
-        std::cerr << "[APP] ERROR: Cannot load shared library: " << dlerror() << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Invalid option value: " << e.what() << std::endl;
         return false;
     }
-
-    g_run_acc_application = (void (*)())dlsym(g_acc_library_handle, "run_acc_application");
-    const char* dlsym_error = dlerror();
-    if (dlsym_error) {
-        std::cerr << "[APP] ERROR: Cannot find symbol 'run_acc_application': " << dlsym_error << std::endl;
-        dlclose(g_acc_library_handle);
-        g_acc_library_handle = nullptr;
+    if (g_doip_port + g_instance_count - 1 > 65535) {
+        std::cerr << "--port plus --instances runs past port 65535" << std::endl;
         return false;
     }
     return true;
 }
 
-void unload_acc_application() {
-    if (g_acc_library_handle) {
-        dlclose(g_acc_library_handle);
-        g_acc_library_handle = nullptr;
-        g_run_acc_application = nullptr;
-        std::cout << "[APP] Unloaded ACC application library." << std::endl;
-    }
+void print_cycle_stats() {
+    if (!g_cycle_scheduler) return;
+    CycleStats stats = g_cycle_scheduler->stats();
+    ECU_LOG_INFO("SCHED", "period=%.1fus cycles=%llu overruns=%llu missed=%llu jitter(mean/max)=%.1f/%.1fus work(last/max)=%.1f/%.1fus",
+                 g_cycle_scheduler->config().period.count() / 1e3,
+                 static_cast<unsigned long long>(stats.cycles),
+                 static_cast<unsigned long long>(stats.overruns),
+                 static_cast<unsigned long long>(stats.missed_periods),
+                 stats.mean_jitter / 1e3, stats.max_jitter / 1e3,
+                 stats.last_work / 1e3, stats.max_work / 1e3);
 }
 
 void handle_signal(int signal) {
+    if (signal == SIGUSR1) {
+        g_metrics_dump_requested = true; // Picked up by the control loop
+        return;
+    }
     if (signal == SIGINT) {
-        std::cout << "\n[INFO] Shutdown signal received. Initiating shutdown..." << std::endl;
+        ECU_LOG_INFO("INFO", "Shutdown signal received. Initiating shutdown...");
         if (g_doip_server) {
             g_doip_server->stop();
         }
@@ -223,15 +269,34 @@ void handle_signal(int signal) {
     }
 }
 
-void apply_update(const std::string& current_executable_path) {
-    std::cout << "[OTA] Applying update to ACC application..." << std::endl;
-    
-    unload_acc_application();
-
-    if (std::rename("update.bin", ACC_LIBRARY_PATH.c_str()) != 0) {
-        perror("[OTA] CRITICAL: Failed to apply update to library");
-    } else {
-        std::cout << "[OTA] Update applied successfully to " << ACC_LIBRARY_PATH << ". ECU will reload it." << std::endl;
+// Writes the metrics in Prometheus text format to METRICS_DUMP_PATH in the
+// working directory, replacing the previous dump atomically.
+void write_metrics_dump() {
+    std::string text = metrics_prometheus_text(g_metrics);
+    std::string temp_path = std::string(METRICS_DUMP_PATH) + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::trunc);
+        out << text;
+        if (!out) {
+            ECU_LOG_ERROR("METRICS", "ERROR: Could not write %s", temp_path.c_str());
+            return;
+        }
+    }
+    if (std::rename(temp_path.c_str(), METRICS_DUMP_PATH) != 0) {
+        ECU_LOG_ERROR("METRICS", "ERROR: Could not replace metrics dump: %s", std::strerror(errno));
+        return;
     }
-    g_ecu_state = EcuState::APPLICATION; 
+    ECU_LOG_INFO("METRICS", "Wrote %s.", METRICS_DUMP_PATH);
+}
+
+// C logging ABI handed to the ACC application (see acc_attach_logger).
+// Levels the platform compiles out are dropped here as well.
+extern "C" void acc_log_to_platform(int level, const char* tag, const char* format, ...) {
+    static_assert(ACC_LOG_TRACE == static_cast<int>(LogLevel::TRACE) && ACC_LOG_ERROR == static_cast<int>(LogLevel::ERROR),
+                  "ACC and platform log levels must match");
+    if (level < VECU_LOG_MIN_LEVEL) return;
+    va_list args;
+    va_start(args, format);
+    g_logger.vlog(static_cast<LogLevel>(level), tag, format, args);
+    va_end(args);
 }
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// --- Runtime metrics ---
+// Counters and histograms cheap enough to leave on in production. Every
+// metric is split into METRIC_SHARDS cache-line-aligned shards and each
+// thread records into its own shard, so a record is one uncontended relaxed
+// atomic add (a few nanoseconds) with no locks and no false sharing between
+// the control loop and the DoIP threads. Readers sum the shards; a snapshot
+// is therefore not atomic across shards, which is fine for monitoring.
+
+constexpr size_t METRIC_SHARDS = 16;
+
+// Shard for the calling thread, assigned round-robin on first use.
+inline size_t metric_shard() {
+    static std::atomic<size_t> next_shard{0};
+    thread_local size_t shard = next_shard.fetch_add(1, std::memory_order_relaxed) % METRIC_SHARDS;
+    return shard;
+}
+
+inline uint64_t metric_now_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// N counters sharing one set of shards (e.g. one per UDS service ID).
+template <size_t N>
+class MetricCounters {
+public:
+    void add(size_t index, uint64_t amount = 1) {
+        m_shards[metric_shard()].values[index].fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    uint64_t value(size_t index) const {
+        uint64_t total = 0;
+        for (const Shard& shard : m_shards) total += shard.values[index].load(std::memory_order_relaxed);
+        return total;
+    }
+
+private:
+    struct alignas(64) Shard {
+        std::array<std::atomic<uint64_t>, N> values{};
+    };
+    std::array<Shard, METRIC_SHARDS> m_shards{};
+};
+
+using MetricCounter = MetricCounters<1>;
+
+// Durations in power-of-two buckets from about 1 us (2^10 ns) to about 17 s
+// (2^34 ns), plus an overflow bucket. N histograms share one set of shards.
+template <size_t N>
+class MetricHistograms {
+public:
+    static constexpr unsigned FIRST_BUCKET_BITS = 10;
+    static constexpr size_t BUCKETS = 26; // Last one is +Inf
+
+    // Upper bound of bucket i, in nanoseconds.
+    static constexpr uint64_t bucket_bound_ns(size_t i) { return uint64_t(1) << (FIRST_BUCKET_BITS + i); }
+
+    void record(size_t index, uint64_t duration_ns) {
+        unsigned bits = 64 - __builtin_clzll(duration_ns | 1);
+        size_t bucket = bits > FIRST_BUCKET_BITS ? bits - FIRST_BUCKET_BITS : 0;
+        if (bucket >= BUCKETS) bucket = BUCKETS - 1;
+        Slot& slot = m_shards[metric_shard()].slots[index];
+        slot.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        slot.sum_ns.fetch_add(duration_ns, std::memory_order_relaxed);
+    }
+
+    // Non-cumulative bucket counts and the sum of all recorded durations.
+    void read(size_t index, std::array<uint64_t, BUCKETS>& buckets, uint64_t& sum_ns) const {
+        buckets.fill(0);
+        sum_ns = 0;
+        for (const Shard& shard : m_shards) {
+            const Slot& slot = shard.slots[index];
+            for (size_t b = 0; b < BUCKETS; ++b) buckets[b] += slot.buckets[b].load(std::memory_order_relaxed);
+            sum_ns += slot.sum_ns.load(std::memory_order_relaxed);
+        }
+    }
+
+private:
+    struct Slot {
+        std::array<std::atomic<uint64_t>, BUCKETS> buckets{};
+        std::atomic<uint64_t> sum_ns{0};
+    };
+    struct alignas(64) Shard {
+        std::array<Slot, N> slots{};
+    };
+    std::array<Shard, METRIC_SHARDS> m_shards{};
+};
+
+using MetricHistogram = MetricHistograms<1>;
+
+// Request latency is tracked per service; these are the ones the ECU serves.
+// Index METRIC_SERVICES.size() collects anything else.
+inline constexpr std::array<uint8_t, 7> METRIC_SERVICES = {0x22, 0x2A, 0x2E, 0x31, 0x34, 0x36, 0x37};
+constexpr size_t METRIC_SERVICE_OTHER = METRIC_SERVICES.size();
+constexpr size_t METRIC_VEHICLE_IDENTIFICATION = METRIC_SERVICES.size() + 1; // DoIP 0x0004, not UDS
+constexpr size_t METRIC_SERVICE_SLOTS = METRIC_SERVICES.size() + 2;
+
+inline size_t metric_service_index(uint8_t service_id) {
+    for (size_t i = 0; i < METRIC_SERVICES.size(); ++i) {
+        if (METRIC_SERVICES[i] == service_id) return i;
+    }
+    return METRIC_SERVICE_OTHER;
+}
+
+// Everything the ECU measures about itself.
+struct EcuMetrics {
+    MetricCounters<256> uds_requests;           // By service ID
+    MetricCounters<256> uds_negative_responses; // By service ID
+    MetricCounter doip_bytes_received;
+    MetricCounter doip_bytes_sent;
+    MetricHistograms<METRIC_SERVICE_SLOTS> request_duration; // From message received to reply queued
+    MetricHistogram acc_cycle_duration;
+    MetricCounter cycle_overruns;
+    MetricHistogram acc_load_duration;  // dlopen + symbol lookup
+    MetricHistogram ota_apply_duration; // Installing a verified image
+};
+
+// --- Prometheus text exposition (format 0.0.4) ---
+namespace metrics_detail {
+
+inline void append_line(std::string& out, const char* format, ...) __attribute__((format(printf, 2, 3)));
+inline void append_line(std::string& out, const char* format, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    int length = std::vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (length > 0) out.append(line, std::min<size_t>(static_cast<size_t>(length), sizeof(line) - 1));
+}
+
+inline void append_header(std::string& out, const char* name, const char* type, const char* help) {
+    append_line(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+template <size_t N>
+inline void append_histogram(std::string& out, const char* name, const MetricHistograms<N>& histograms,
+                             size_t index, const std::string& labels) {
+    std::array<uint64_t, MetricHistograms<N>::BUCKETS> buckets;
+    uint64_t sum_ns;
+    histograms.read(index, buckets, sum_ns);
+    std::string prefix = labels.empty() ? std::string() : labels + ",";
+    uint64_t cumulative = 0;
+    for (size_t b = 0; b + 1 < buckets.size(); ++b) {
+        cumulative += buckets[b];
+        append_line(out, "%s_bucket{%sle=\"%.9g\"} %llu\n", name, prefix.c_str(),
+                    MetricHistograms<N>::bucket_bound_ns(b) / 1e9, static_cast<unsigned long long>(cumulative));
+    }
+    cumulative += buckets.back();
+    append_line(out, "%s_bucket{%sle=\"+Inf\"} %llu\n", name, prefix.c_str(), static_cast<unsigned long long>(cumulative));
+    std::string braces = labels.empty() ? std::string() : "{" + labels + "}";
+    append_line(out, "%s_sum%s %.9f\n", name, braces.c_str(), sum_ns / 1e9);
+    append_line(out, "%s_count%s %llu\n", name, braces.c_str(), static_cast<unsigned long long>(cumulative));
+}
+
+inline std::string service_label(size_t index) {
+    char label[48];
+    if (index < METRIC_SERVICES.size()) std::snprintf(label, sizeof(label), "service=\"0x%02X\"", METRIC_SERVICES[index]);
+    else if (index == METRIC_SERVICE_OTHER) std::snprintf(label, sizeof(label), "service=\"other\"");
+    else std::snprintf(label, sizeof(label), "service=\"vehicle_identification\"");
+    return label;
+}
+
+} // namespace metrics_detail
+
+// Renders every metric as Prometheus text. Allocates; not for the hot path.
+inline std::string metrics_prometheus_text(const EcuMetrics& metrics) {
+    using namespace metrics_detail;
+    std::string out;
+    out.reserve(16 * 1024);
+
+    append_header(out, "vecu_uds_requests_total", "counter", "UDS requests received, by service ID.");
+    for (size_t sid = 0; sid < 256; ++sid) {
+        if (uint64_t value = metrics.uds_requests.value(sid)) {
+            append_line(out, "vecu_uds_requests_total{service=\"0x%02zX\"} %llu\n", sid, static_cast<unsigned long long>(value));
+        }
+    }
+    append_header(out, "vecu_uds_negative_responses_total", "counter", "Negative responses sent, by service ID.");
+    for (size_t sid = 0; sid < 256; ++sid) {
+        if (uint64_t value = metrics.uds_negative_responses.value(sid)) {
+            append_line(out, "vecu_uds_negative_responses_total{service=\"0x%02zX\"} %llu\n", sid, static_cast<unsigned long long>(value));
+        }
+    }
+    append_header(out, "vecu_doip_received_bytes_total", "counter", "DoIP bytes received, headers included.");
+    append_line(out, "vecu_doip_received_bytes_total %llu\n", static_cast<unsigned long long>(metrics.doip_bytes_received.value(0)));
+    append_header(out, "vecu_doip_sent_bytes_total", "counter", "DoIP bytes sent, headers included.");
+    append_line(out, "vecu_doip_sent_bytes_total %llu\n", static_cast<unsigned long long>(metrics.doip_bytes_sent.value(0)));
+
+    append_header(out, "vecu_request_duration_seconds", "histogram", "Time from a request's arrival until its reply is queued.");
+    for (size_t i = 0; i < METRIC_SERVICE_SLOTS; ++i) {
+        append_histogram(out, "vecu_request_duration_seconds", metrics.request_duration, i, service_label(i));
+    }
+    append_header(out, "vecu_acc_cycle_duration_seconds", "histogram", "Run time of one ACC application cycle.");
+    append_histogram(out, "vecu_acc_cycle_duration_seconds", metrics.acc_cycle_duration, 0, "");
+    append_header(out, "vecu_cycle_overruns_total", "counter", "Control cycles that finished after their deadline.");
+    append_line(out, "vecu_cycle_overruns_total %llu\n", static_cast<unsigned long long>(metrics.cycle_overruns.value(0)));
+    append_header(out, "vecu_acc_load_duration_seconds", "histogram", "Time to dlopen the ACC image and resolve its entry points.");
+    append_histogram(out, "vecu_acc_load_duration_seconds", metrics.acc_load_duration, 0, "");
+    append_header(out, "vecu_ota_apply_duration_seconds", "histogram", "Time to install a verified OTA image.");
+    append_histogram(out, "vecu_ota_apply_duration_seconds", metrics.ota_apply_duration, 0, "");
+    return out;
+}
@@ -0,0 +1,24 @@
+#include <iostream>
+#include <string>
+
+#include "nvram_manager.hpp"
+
+// Converts a legacy key=value nvram.dat into the binary A/B NVRAM image.
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cerr << "Usage: nvram_convert <nvram.dat> <nvram.img>" << std::endl;
+        return 1;
+    }
+
+    NVRAMManager nvram(argv[2]);
+    if (!nvram.import_text(argv[1])) {
+        std::cerr << "[CONVERT] FAILED: Could not convert " << argv[1] << std::endl;
+        return 1;
+    }
+
+    for (size_t i = 0; i < NVRAM_PARAM_COUNT; ++i) {
+        std::cout << NVRAM_PARAMS[i].key << "=" << nvram.get_string(static_cast<NvramParam>(i)) << std::endl;
+    }
+    std::cout << "[CONVERT] Wrote " << argv[2] << std::endl;
+    return 0;
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "crc32.hpp"
+
+// --- Binary NVRAM image layout ---
+// The image file holds two fixed-size pages (A and B). Each page carries a
+// header, a record table indexed by parameter slot, and a CRC over the page.
+// A commit always rewrites the page that is *not* active with a higher
+// generation number, so a torn write only ever damages the older copy and
+// boot falls back to the page that is still intact.
+constexpr uint32_t NVRAM_IMAGE_MAGIC = 0x524E5645; // "EVNR"
+constexpr uint16_t NVRAM_IMAGE_FORMAT_VERSION = 1;
+constexpr size_t NVRAM_IMAGE_PAGE_SIZE = 4096;
+constexpr size_t NVRAM_IMAGE_PAGE_COUNT = 2;
+constexpr size_t NVRAM_IMAGE_TEXT_CAPACITY = 32;
+
+struct NvramImageHeader {
+    uint32_t crc;            // CRC-32 of the page from `magic` to the end of the page
+    uint32_t magic;
+    uint16_t format_version;
+    uint16_t record_count;
+    uint32_t generation;     // Incremented on every commit; the higher valid page wins
+    uint8_t  reserved[16];
+};
+
+struct NvramImageRecord {
+    uint8_t  type;           // NvramType the slot was written with
+    uint8_t  length;         // Valid bytes in `text` for string slots
+    uint8_t  reserved[2];
+    uint32_t numeric;        // Raw bits for float/int slots
+    char     text[NVRAM_IMAGE_TEXT_CAPACITY];
+};
+
+constexpr size_t NVRAM_IMAGE_MAX_RECORDS = (NVRAM_IMAGE_PAGE_SIZE - sizeof(NvramImageHeader)) / sizeof(NvramImageRecord);
+
+struct NvramImagePage {
+    NvramImageHeader header;
+    NvramImageRecord records[NVRAM_IMAGE_MAX_RECORDS];
+    uint8_t padding[NVRAM_IMAGE_PAGE_SIZE - sizeof(NvramImageHeader) - NVRAM_IMAGE_MAX_RECORDS * sizeof(NvramImageRecord)];
+};
+
+static_assert(sizeof(NvramImageHeader) == 32, "Image header layout is part of the on-disk format");
+static_assert(sizeof(NvramImageRecord) == 40, "Image record layout is part of the on-disk format");
+static_assert(sizeof(NvramImagePage) == NVRAM_IMAGE_PAGE_SIZE, "Image pages must be exactly one page");
+
+inline uint32_t nvram_image_page_crc(const NvramImagePage& page) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&page);
+    return crc32(bytes + sizeof(uint32_t), NVRAM_IMAGE_PAGE_SIZE - sizeof(uint32_t));
+}
+
+// Memory-mapped A/B page store. Not thread-safe; NVRAMManager serializes access.
+class NvramImage {
+public:
+    enum class OpenResult {
+        VALID,   // At least one page passed validation
+        BLANK,   // Freshly created or never committed
+        CORRUPT  // Pages were written before but none validates
+    };
+
+    explicit NvramImage(const std::string& path) : m_path(path) {}
+
+    ~NvramImage() {
+        close();
+    }
+
+    NvramImage(const NvramImage&) = delete;
+    NvramImage& operator=(const NvramImage&) = delete;
+
+    // Maps the image (creating it if needed) and selects the newest page that
+    // passes validation.
+    OpenResult open() {
+        close();
+        m_fd = ::open(m_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (m_fd < 0) {
+            perror("[NVRAM] ERROR: Could not open NVRAM image");
+            return OpenResult::CORRUPT;
+        }
+        struct stat st;
+        if (::fstat(m_fd, &st) != 0 || (static_cast<size_t>(st.st_size) != file_size() && ::ftruncate(m_fd, file_size()) != 0)) {
+            perror("[NVRAM] ERROR: Could not size NVRAM image");
+            close();
+            return OpenResult::CORRUPT;
+        }
+        void* mapping = ::mmap(nullptr, file_size(), PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+        if (mapping == MAP_FAILED) {
+            perror("[NVRAM] ERROR: Could not map NVRAM image");
+            close();
+            return OpenResult::CORRUPT;
+        }
+        m_pages = static_cast<NvramImagePage*>(mapping);
+
+        bool valid[NVRAM_IMAGE_PAGE_COUNT];
+        bool blank = true;
+        for (size_t i = 0; i < NVRAM_IMAGE_PAGE_COUNT; ++i) {
+            valid[i] = is_valid(m_pages[i]);
+            if (m_pages[i].header.magic != 0) blank = false;
+            if (!valid[i] && m_pages[i].header.magic != 0) {
+                std::cerr << "[NVRAM] WARNING: Image page " << page_name(i) << " failed validation." << std::endl;
+            }
+        }
+
+        if (valid[0] && valid[1]) {
+            m_active = m_pages[1].header.generation > m_pages[0].header.generation ? 1 : 0;
+        } else if (valid[0] || valid[1]) {
+            m_active = valid[0] ? 0 : 1;
+            if (!blank) {
+                std::cerr << "[NVRAM] Falling back to image page " << page_name(m_active) << "." << std::endl;
+            }
+        } else {
+            m_active = -1;
+            return blank ? OpenResult::BLANK : OpenResult::CORRUPT;
+        }
+        return OpenResult::VALID;
+    }
+
+    void close() {
+        if (m_pages) {
+            ::munmap(m_pages, file_size());
+            m_pages = nullptr;
+        }
+        if (m_fd >= 0) {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+        m_active = -1;
+    }
+
+    // The currently active page, or nullptr when the image holds no valid page.
+    const NvramImagePage* active_page() const {
+        return (m_pages && m_active >= 0) ? &m_pages[m_active] : nullptr;
+    }
+
+    // Writes `page` into the inactive slot with the next generation, syncs it,
+    // and makes it active. The previous page stays intact until the next commit.
+    // The first commit into a blank image seeds both pages so there is always
+    // a copy to fall back to.
+    bool commit(NvramImagePage& page) {
+        if (!m_pages) return false;
+        if (m_active < 0 && !commit_page(page)) return false;
+        return commit_page(page);
+    }
+
+private:
+    std::string m_path;
+    int m_fd = -1;
+    NvramImagePage* m_pages = nullptr;
+    int m_active = -1;
+
+    bool commit_page(NvramImagePage& page) {
+        int target = m_active == 0 ? 1 : 0;
+        page.header.magic = NVRAM_IMAGE_MAGIC;
+        page.header.format_version = NVRAM_IMAGE_FORMAT_VERSION;
+        page.header.generation = m_active >= 0 ? m_pages[m_active].header.generation + 1 : 1;
+        page.header.crc = nvram_image_page_crc(page);
+
+        std::memcpy(&m_pages[target], &page, sizeof(NvramImagePage));
+        if (::msync(&m_pages[target], sizeof(NvramImagePage), MS_SYNC) != 0) {
+            perror("[NVRAM] ERROR: Could not sync NVRAM image page");
+            return false;
+        }
+        m_active = target;
+        return true;
+    }
+
+    static constexpr size_t file_size() {
+        return NVRAM_IMAGE_PAGE_SIZE * NVRAM_IMAGE_PAGE_COUNT;
+    }
+
+    static const char* page_name(size_t index) {
+        return index == 0 ? "A" : "B";
+    }
+
+    static bool is_valid(const NvramImagePage& page) {
+        return page.header.magic == NVRAM_IMAGE_MAGIC &&
+               page.header.format_version == NVRAM_IMAGE_FORMAT_VERSION &&
+               page.header.record_count <= NVRAM_IMAGE_MAX_RECORDS &&
+               page.header.crc == nvram_image_page_crc(page);
+    }
+};
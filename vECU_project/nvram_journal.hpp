@@ -0,0 +1,209 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "crc32.hpp"
+
+// Tuning knobs for the NVRAM write-ahead journal.
+struct NvramJournalConfig {
+    // fsync after this many commits; 0 leaves syncing to the background flusher.
+    uint32_t fsync_every_commits = 0;
+    // Upper bound on how long a commit may sit in the page cache unsynced.
+    std::chrono::milliseconds fsync_interval{100};
+    // Fold the journal back into the NVRAM image once it grows past this size.
+    size_t compact_threshold_bytes = 64 * 1024;
+};
+
+// Append-only log of NVRAM parameter changes.
+//
+// Record layout (little endian):
+//   [crc32:4][param:1][length:1][payload:length]
+// The CRC covers param, length and payload, so a record torn by a crash is
+// detected on replay and everything from it onwards is discarded.
+class NvramJournal {
+public:
+    static constexpr size_t RECORD_HEADER_SIZE = 6;
+
+    NvramJournal(const std::string& path, const NvramJournalConfig& config)
+        : m_path(path), m_rotated_path(path + ".old"), m_config(config) {}
+
+    ~NvramJournal() {
+        close_internal();
+    }
+
+    NvramJournal(const NvramJournal&) = delete;
+    NvramJournal& operator=(const NvramJournal&) = delete;
+
+    const NvramJournalConfig& config() const { return m_config; }
+
+    // Appends one encoded record to `out`.
+    static void encode_record(std::vector<uint8_t>& out, uint8_t param, const void* payload, uint8_t length) {
+        size_t start = out.size();
+        out.resize(start + RECORD_HEADER_SIZE + length);
+        uint8_t* record = out.data() + start;
+        record[4] = param;
+        record[5] = length;
+        std::memcpy(record + RECORD_HEADER_SIZE, payload, length);
+        uint32_t crc = crc32(record + 4, 2 + length);
+        record[0] = static_cast<uint8_t>(crc);
+        record[1] = static_cast<uint8_t>(crc >> 8);
+        record[2] = static_cast<uint8_t>(crc >> 16);
+        record[3] = static_cast<uint8_t>(crc >> 24);
+    }
+
+    // Replays the rotated journal (left behind by an interrupted compaction)
+    // followed by the live journal, invoking
+    // `apply(uint8_t param, const uint8_t* payload, uint8_t length)` per record.
+    // A torn tail on the live journal is truncated away. Returns the number of
+    // records applied.
+    template <typename Apply>
+    size_t replay(Apply&& apply) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t records = 0;
+        replay_file_internal(m_rotated_path, apply, records);
+        size_t valid_bytes = replay_file_internal(m_path, apply, records);
+        if (::truncate(m_path.c_str(), static_cast<off_t>(valid_bytes)) != 0 && errno != ENOENT) {
+            perror("[NVRAM] WARNING: Could not trim journal tail");
+        }
+        return records;
+    }
+
+    bool open() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        close_internal();
+        return open_internal();
+    }
+
+    // Writes a batch of records with a single write() call (group commit).
+    bool append(const uint8_t* data, size_t length) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_fd < 0) return false;
+        while (length > 0) {
+            ssize_t written = ::write(m_fd, data, length);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                perror("[NVRAM] ERROR: Journal append failed");
+                return false;
+            }
+            data += written;
+            length -= static_cast<size_t>(written);
+            m_size += static_cast<size_t>(written);
+        }
+        ++m_unsynced_commits;
+        if (m_config.fsync_every_commits != 0 && m_unsynced_commits >= m_config.fsync_every_commits) {
+            m_unsynced_commits = 0;
+            ::fdatasync(m_fd);
+        }
+        return true;
+    }
+
+    // Flushes outstanding commits to stable storage. The file descriptor is
+    // duplicated so appends are not blocked while the disk catches up.
+    void sync() {
+        int fd;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_fd < 0 || m_unsynced_commits == 0) return;
+            m_unsynced_commits = 0;
+            fd = ::dup(m_fd);
+        }
+        if (fd < 0) return;
+        ::fdatasync(fd);
+        ::close(fd);
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_size;
+    }
+
+    // Moves the live journal aside and starts an empty one. The caller must
+    // hold off new commits until this returns so the rotated file plus the
+    // image page it is about to commit describe the same state.
+    bool rotate() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_fd >= 0) ::fdatasync(m_fd);
+        close_internal();
+        if (std::rename(m_path.c_str(), m_rotated_path.c_str()) != 0) {
+            perror("[NVRAM] ERROR: Could not rotate journal");
+            open_internal();
+            return false;
+        }
+        return open_internal();
+    }
+
+    bool has_rotated() const {
+        return ::access(m_rotated_path.c_str(), F_OK) == 0;
+    }
+
+    // Drops the rotated journal once its contents are in a durable image page.
+    void discard_rotated() {
+        std::remove(m_rotated_path.c_str());
+    }
+
+private:
+    std::string m_path;
+    std::string m_rotated_path;
+    NvramJournalConfig m_config;
+    std::mutex m_mutex;
+    int m_fd = -1;
+    size_t m_size = 0;
+    uint32_t m_unsynced_commits = 0;
+
+    bool open_internal() {
+        m_fd = ::open(m_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (m_fd < 0) {
+            perror("[NVRAM] ERROR: Could not open journal");
+            return false;
+        }
+        off_t end = ::lseek(m_fd, 0, SEEK_END);
+        m_size = end > 0 ? static_cast<size_t>(end) : 0;
+        m_unsynced_commits = 0;
+        return true;
+    }
+
+    void close_internal() {
+        if (m_fd >= 0) {
+            if (m_unsynced_commits != 0) ::fdatasync(m_fd);
+            ::close(m_fd);
+            m_fd = -1;
+        }
+    }
+
+    // Returns the length of the valid record prefix of the file.
+    template <typename Apply>
+    static size_t replay_file_internal(const std::string& path, Apply& apply, size_t& records) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) return 0;
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        size_t offset = 0;
+        while (data.size() - offset >= RECORD_HEADER_SIZE) {
+            const uint8_t* record = data.data() + offset;
+            uint8_t length = record[5];
+            if (data.size() - offset < RECORD_HEADER_SIZE + length) break;
+            uint32_t stored_crc = record[0] | (record[1] << 8) | (record[2] << 16) | (static_cast<uint32_t>(record[3]) << 24);
+            if (crc32(record + 4, 2 + length) != stored_crc) break;
+            apply(record[4], record + RECORD_HEADER_SIZE, length);
+            ++records;
+            offset += RECORD_HEADER_SIZE + length;
+        }
+        if (offset != data.size()) {
+            std::cerr << "[NVRAM] WARNING: Discarding " << (data.size() - offset)
+                      << " bytes of torn journal data in " << path << std::endl;
+        }
+        return offset;
+    }
+};
@@ -1,89 +1,590 @@
 #pragma once
 
 #include <iostream>
+#include <algorithm>
 #include <fstream>
 #include <string>
-#include <map>
+#include <string_view>
+#include <array>
+#include <vector>
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <optional>
+#include <memory>
 #include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+
+#include <unistd.h>
+
+#include "nvram_journal.hpp"
+#include "nvram_image.hpp"
+
+// Every parameter the ECU keeps in NVRAM. The enum value is the slot index,
+// so lookups are a plain array access instead of a string map search.
+enum class NvramParam : uint8_t {
+    FIRMWARE_VERSION,
+    ECU_SERIAL_NUMBER,
+    LEAD_VEHICLE_SPEED,
+    OWN_VEHICLE_SPEED,
+    ACC_GAP_SETTING,
+    ACC_KP,
+    ACC_KI,
+    ACC_MAX_ACCEL,
+    ACC_MAX_DECEL,
+    COUNT
+};
+
+enum class NvramType : uint8_t {
+    FLOAT,
+    INT,
+    STRING
+};
+
+struct NvramParamInfo {
+    const char* key;           // Name used in nvram.dat
+    NvramType type;
+    const char* default_value; // Value written when no NVRAM file exists
+};
+
+constexpr size_t NVRAM_PARAM_COUNT = static_cast<size_t>(NvramParam::COUNT);
+constexpr size_t NVRAM_STRING_CAPACITY = 32;
+static_assert(NVRAM_PARAM_COUNT <= 32, "Dirty tracking uses one bit per parameter");
+static_assert(NVRAM_PARAM_COUNT <= NVRAM_IMAGE_MAX_RECORDS, "Every parameter needs a record in the image page");
+static_assert(NVRAM_STRING_CAPACITY == NVRAM_IMAGE_TEXT_CAPACITY, "String slots must fit image records");
+
+// Indexed by NvramParam; keep the order in sync with the enum above.
+inline constexpr std::array<NvramParamInfo, NVRAM_PARAM_COUNT> NVRAM_PARAMS = {{
+    {"FIRMWARE_VERSION",   NvramType::STRING, "5.0.0"},
+    {"ECU_SERIAL_NUMBER",  NvramType::STRING, "VECU-2025-005"},
+    {"LEAD_VEHICLE_SPEED", NvramType::FLOAT,  "65.0"},
+    {"OWN_VEHICLE_SPEED",  NvramType::FLOAT,  "65.0"},
+    {"ACC_GAP_SETTING",    NvramType::INT,    "3"},
+    {"ACC_KP",             NvramType::FLOAT,  "0.4"}, // Proportional gain
+    {"ACC_KI",             NvramType::FLOAT,  "0.1"}, // Integral gain
+    {"ACC_MAX_ACCEL",      NvramType::FLOAT,  "2.0"}, // Max speed increase per cycle (mph)
+    {"ACC_MAX_DECEL",      NvramType::FLOAT,  "3.0"}, // Max speed decrease per cycle (mph)
+}};
+
+inline const NvramParamInfo& nvram_param_info(NvramParam param) {
+    return NVRAM_PARAMS[static_cast<size_t>(param)];
+}
+
+constexpr std::optional<NvramParam> nvram_param_from_key(std::string_view key) {
+    for (size_t i = 0; i < NVRAM_PARAM_COUNT; ++i) {
+        if (key == NVRAM_PARAMS[i].key) return static_cast<NvramParam>(i);
+    }
+    return std::nullopt;
+}
+
+// In-memory parameter store backed by a memory-mapped binary image (see
+// nvram_image.hpp). Numeric slots are lock-free atomics so the diagnostic read
+// path never blocks on (or allocates behind) the control loop. The image is
+// only read by load() and only written by save() when a value has changed.
+//
+// With a journal enabled, save() appends just the changed parameters to a
+// write-ahead log; a background flusher batches the fsyncs and folds the log
+// back into the image once it grows. Without one, save() commits a new image
+// page directly.
+class NvramFlusher;
 
 class NVRAMManager {
 public:
-    explicit NVRAMManager(const std::string& filename) : m_filename(filename) {}
+    // `legacy_text_path` names an old key=value nvram.dat that is imported the
+    // first time the image is created.
+    explicit NVRAMManager(const std::string& filename, const std::string& legacy_text_path = {})
+        : m_filename(filename), m_legacy_text_path(legacy_text_path), m_image(filename) {
+        for (auto& slot : m_numeric) slot.store(0, std::memory_order_relaxed);
+        for (auto& str : m_strings) str.fill('\0');
+    }
+
+    ~NVRAMManager() {
+        stop_flusher();
+    }
+
+    // Switches persistence to the write-ahead journal. Call before load().
+    void enable_journal(const NvramJournalConfig& config) {
+        stop_flusher();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_journal = std::make_unique<NvramJournal>(m_filename + ".journal", config);
+        m_commit_buffer.reserve(NVRAM_PARAM_COUNT * (NvramJournal::RECORD_HEADER_SIZE + NVRAM_STRING_CAPACITY));
+    }
+
+    // Hands fsyncs and compaction to a flusher shared with other managers
+    // instead of starting a thread of our own. Call before load(); the
+    // flusher must outlive this manager.
+    void use_flusher(NvramFlusher& flusher) {
+        stop_flusher();
+        m_shared_flusher = &flusher;
+    }
 
     bool load() {
+        stop_flusher(); // Restarted once the journal has been replayed.
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!load_image_internal()) return false;
+        if (m_journal && !recover_journal_internal()) return false;
+        return true;
+    }
+
+    bool save() {
         std::lock_guard<std::mutex> lock(m_mutex);
-        std::ifstream file(m_filename);
+        uint32_t dirty = m_dirty.exchange(0, std::memory_order_acq_rel);
+        if (dirty == 0) {
+            return true; // Nothing changed since the last load/save.
+        }
+        bool saved = m_journal ? append_journal_internal(dirty) : commit_image_internal();
+        if (!saved) {
+            m_dirty.fetch_or(dirty, std::memory_order_relaxed);
+            std::cerr << "[NVRAM] ERROR: Could not persist NVRAM to: " << m_filename << std::endl;
+        }
+        return saved;
+    }
+
+    // Converts a key=value text NVRAM file into the binary image.
+    bool import_text(const std::string& text_path) {
+        stop_flusher();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_image.active_page()) m_image.open();
+        return import_text_internal(text_path);
+    }
+
+    // --- Typed accessors (hot path) ---
+    float get_float(NvramParam param) const {
+        uint32_t bits = m_numeric[static_cast<size_t>(param)].load(std::memory_order_acquire);
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    int32_t get_int(NvramParam param) const {
+        return static_cast<int32_t>(m_numeric[static_cast<size_t>(param)].load(std::memory_order_acquire));
+    }
+
+    void set_float(NvramParam param, float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        store_numeric(param, bits);
+    }
+
+    void set_int(NvramParam param, int32_t value) {
+        store_numeric(param, static_cast<uint32_t>(value));
+    }
+
+    // --- String accessors (kept for text-oriented callers) ---
+    std::optional<std::string> get_string(const std::string& key) {
+        auto param = nvram_param_from_key(key);
+        if (!param) return std::nullopt;
+        return get_string(*param);
+    }
+
+    std::string get_string(NvramParam param) {
+        char buffer[NVRAM_STRING_CAPACITY];
+        size_t length = format_internal(param, buffer, sizeof(buffer));
+        return std::string(buffer, length);
+    }
+
+    void set_string(const std::string& key, const std::string& value) {
+        auto param = nvram_param_from_key(key);
+        if (!param) {
+            std::cerr << "[NVRAM] WARNING: Ignoring write to unknown key: " << key << std::endl;
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        set_from_text_internal(*param, value);
+        mark_dirty(*param);
+    }
+
+private:
+    std::string m_filename;
+    std::string m_legacy_text_path;
+    NvramImage m_image;
+    std::mutex m_image_mutex;         // Guards m_image commits (save vs. background compaction)
+    std::array<std::atomic<uint32_t>, NVRAM_PARAM_COUNT> m_numeric;
+    std::array<std::array<char, NVRAM_STRING_CAPACITY>, NVRAM_PARAM_COUNT> m_strings;
+    std::atomic<uint32_t> m_dirty{0}; // One bit per NvramParam changed since the last save
+    std::mutex m_mutex;               // Serializes load/save/set_string and journal commits
+    std::mutex m_string_mutex;        // Guards m_strings; always taken after m_mutex
+
+    // --- Journal state (only used after enable_journal) ---
+    std::unique_ptr<NvramJournal> m_journal;
+    std::vector<uint8_t> m_commit_buffer;
+    std::thread m_flusher;
+    std::mutex m_flusher_mutex;
+    std::condition_variable m_flusher_cv;
+    bool m_flusher_stop = false;
+    bool m_compact_requested = false;
+    NvramFlusher* m_shared_flusher = nullptr;
+    bool m_flusher_registered = false;
+
+    friend class NvramFlusher;
+
+    void mark_dirty(NvramParam param) {
+        m_dirty.fetch_or(1u << static_cast<size_t>(param), std::memory_order_release);
+    }
+
+    void store_numeric(NvramParam param, uint32_t bits) {
+        auto& slot = m_numeric[static_cast<size_t>(param)];
+        if (slot.exchange(bits, std::memory_order_acq_rel) != bits) {
+            mark_dirty(param);
+        }
+    }
+
+    // Parses a text value into the slot's native type.
+    void set_from_text_internal(NvramParam param, std::string_view text) {
+        const size_t index = static_cast<size_t>(param);
+        const char* first = text.data();
+        const char* last = text.data() + text.size();
+        switch (nvram_param_info(param).type) {
+            case NvramType::FLOAT: {
+                float value = 0.0f;
+                if (std::from_chars(first, last, value).ec == std::errc()) set_float(param, value);
+                break;
+            }
+            case NvramType::INT: {
+                // Older files may hold integers written as floats (e.g. "3.000000").
+                float value = 0.0f;
+                if (std::from_chars(first, last, value).ec == std::errc()) set_int(param, static_cast<int32_t>(value));
+                break;
+            }
+            case NvramType::STRING: {
+                std::lock_guard<std::mutex> string_lock(m_string_mutex);
+                size_t length = std::min(text.size(), NVRAM_STRING_CAPACITY - 1);
+                std::memcpy(m_strings[index].data(), first, length);
+                m_strings[index][length] = '\0';
+                break;
+            }
+        }
+    }
+
+    // Formats a slot as text into buffer and returns the number of characters written.
+    size_t format_internal(NvramParam param, char* buffer, size_t size) {
+        const size_t index = static_cast<size_t>(param);
+        switch (nvram_param_info(param).type) {
+            case NvramType::FLOAT:
+                return std::to_chars(buffer, buffer + size, get_float(param)).ptr - buffer;
+            case NvramType::INT:
+                return std::to_chars(buffer, buffer + size, get_int(param)).ptr - buffer;
+            case NvramType::STRING: {
+                std::lock_guard<std::mutex> lock(m_string_mutex);
+                size_t length = strnlen(m_strings[index].data(), NVRAM_STRING_CAPACITY);
+                std::memcpy(buffer, m_strings[index].data(), length);
+                return length;
+            }
+        }
+        return 0;
+    }
+
+    void apply_defaults_internal() {
+        for (size_t i = 0; i < NVRAM_PARAM_COUNT; ++i) {
+            set_from_text_internal(static_cast<NvramParam>(i), NVRAM_PARAMS[i].default_value);
+        }
+    }
+
+    bool load_image_internal() {
+        switch (m_image.open()) {
+            case NvramImage::OpenResult::VALID:
+                read_image_internal(*m_image.active_page());
+                return true;
+            case NvramImage::OpenResult::BLANK:
+                if (!m_legacy_text_path.empty() && ::access(m_legacy_text_path.c_str(), F_OK) == 0) {
+                    std::cout << "[NVRAM] Converting " << m_legacy_text_path << " to binary image." << std::endl;
+                    return import_text_internal(m_legacy_text_path);
+                }
+                std::cout << "[NVRAM] No existing NVRAM image found. Creating default." << std::endl;
+                return create_default_nvram_internal();
+            case NvramImage::OpenResult::CORRUPT:
+                break;
+        }
+        std::cerr << "[NVRAM] ERROR: No valid page in NVRAM image: " << m_filename << std::endl;
+        return false;
+    }
+
+    void read_image_internal(const NvramImagePage& page) {
+        apply_defaults_internal();
+        size_t count = std::min<size_t>(page.header.record_count, NVRAM_PARAM_COUNT);
+        for (size_t i = 0; i < count; ++i) {
+            const NvramImageRecord& record = page.records[i];
+            NvramParam param = static_cast<NvramParam>(i);
+            if (record.type != static_cast<uint8_t>(nvram_param_info(param).type)) continue;
+            if (record.type == static_cast<uint8_t>(NvramType::STRING)) {
+                size_t length = std::min<size_t>(record.length, NVRAM_STRING_CAPACITY);
+                set_from_text_internal(param, std::string_view(record.text, length));
+            } else {
+                m_numeric[i].store(record.numeric, std::memory_order_release);
+            }
+        }
+        m_dirty.store(0, std::memory_order_relaxed);
+    }
+
+    void fill_image_page_internal(NvramImagePage& page) {
+        std::memset(&page, 0, sizeof(page));
+        page.header.record_count = static_cast<uint16_t>(NVRAM_PARAM_COUNT);
+        for (size_t i = 0; i < NVRAM_PARAM_COUNT; ++i) {
+            NvramImageRecord& record = page.records[i];
+            NvramParam param = static_cast<NvramParam>(i);
+            record.type = static_cast<uint8_t>(nvram_param_info(param).type);
+            if (nvram_param_info(param).type == NvramType::STRING) {
+                record.length = static_cast<uint8_t>(format_internal(param, record.text, sizeof(record.text)));
+            } else {
+                record.numeric = m_numeric[i].load(std::memory_order_acquire);
+            }
+        }
+    }
+
+    bool commit_page_internal(NvramImagePage& page) {
+        std::lock_guard<std::mutex> lock(m_image_mutex);
+        return m_image.commit(page);
+    }
+
+    bool commit_image_internal() {
+        NvramImagePage page;
+        fill_image_page_internal(page);
+        return commit_page_internal(page);
+    }
+
+    bool import_text_internal(const std::string& text_path) {
+        std::ifstream file(text_path);
         if (!file.is_open()) {
-            std::cout << "[NVRAM] No existing NVRAM file found. Creating default." << std::endl;
-            return create_default_nvram_internal();
+            std::cerr << "[NVRAM] ERROR: Could not open text NVRAM file: " << text_path << std::endl;
+            return false;
         }
 
-        m_data.clear();
+        apply_defaults_internal();
         std::string line;
         while (std::getline(file, line)) {
             size_t delimiter_pos = line.find('=');
             if (delimiter_pos != std::string::npos) {
-                std::string key = line.substr(0, delimiter_pos);
-                std::string value = line.substr(delimiter_pos + 1);
-                m_data[key] = value;
+                std::string_view key(line.data(), delimiter_pos);
+                std::string_view value(line.data() + delimiter_pos + 1, line.size() - delimiter_pos - 1);
+                auto param = nvram_param_from_key(key);
+                if (!param) {
+                    std::cerr << "[NVRAM] WARNING: Ignoring unknown key: " << key << std::endl;
+                    continue;
+                }
+                set_from_text_internal(*param, value);
             }
         }
+        m_dirty.store(0, std::memory_order_relaxed);
+        return commit_image_internal();
+    }
+
+    // Creates a default NVRAM image with initial values for the advanced controller.
+    bool create_default_nvram_internal() {
+        apply_defaults_internal();
+        m_dirty.store(0, std::memory_order_relaxed);
+        return commit_image_internal();
+    }
+
+    // --- Journal ---
+
+    bool recover_journal_internal() {
+        auto start = std::chrono::steady_clock::now();
+        size_t records = m_journal->replay([this](uint8_t param, const uint8_t* payload, uint8_t length) {
+            apply_journal_record_internal(param, payload, length);
+        });
+        m_dirty.store(0, std::memory_order_relaxed);
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        std::cout << "[NVRAM] Replayed " << records << " journal records in " << elapsed.count() << " us." << std::endl;
+
+        // A compaction that was interrupted left a rotated journal behind; fold
+        // it into the image now so the next rotation cannot overwrite it.
+        if (m_journal->has_rotated()) {
+            if (!commit_image_internal()) return false;
+            m_journal->discard_rotated();
+        }
+        if (!m_journal->open()) return false;
+        start_flusher();
         return true;
     }
 
-    bool save() {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        std::ofstream file(m_filename, std::ios::trunc);
-        if (!file.is_open()) {
-            std::cerr << "[NVRAM] ERROR: Could not open file for writing: " << m_filename << std::endl;
-            return false;
+    void apply_journal_record_internal(uint8_t param_index, const uint8_t* payload, uint8_t length) {
+        if (param_index >= NVRAM_PARAM_COUNT) return;
+        NvramParam param = static_cast<NvramParam>(param_index);
+        if (nvram_param_info(param).type == NvramType::STRING) {
+            set_from_text_internal(param, std::string_view(reinterpret_cast<const char*>(payload), length));
+        } else if (length == sizeof(uint32_t)) {
+            uint32_t bits = payload[0] | (payload[1] << 8) | (payload[2] << 16) | (static_cast<uint32_t>(payload[3]) << 24);
+            m_numeric[param_index].store(bits, std::memory_order_release);
         }
+    }
 
-        for (const auto& pair : m_data) {
-            file << pair.first << "=" << pair.second << std::endl;
+    // Encodes every dirty parameter and commits them with a single append.
+    bool append_journal_internal(uint32_t dirty) {
+        m_commit_buffer.clear();
+        for (size_t i = 0; i < NVRAM_PARAM_COUNT; ++i) {
+            if (!(dirty & (1u << i))) continue;
+            NvramParam param = static_cast<NvramParam>(i);
+            if (nvram_param_info(param).type == NvramType::STRING) {
+                char buffer[NVRAM_STRING_CAPACITY];
+                size_t length = format_internal(param, buffer, sizeof(buffer));
+                NvramJournal::encode_record(m_commit_buffer, static_cast<uint8_t>(i), buffer, static_cast<uint8_t>(length));
+            } else {
+                uint32_t bits = m_numeric[i].load(std::memory_order_acquire);
+                uint8_t payload[4] = {static_cast<uint8_t>(bits), static_cast<uint8_t>(bits >> 8),
+                                      static_cast<uint8_t>(bits >> 16), static_cast<uint8_t>(bits >> 24)};
+                NvramJournal::encode_record(m_commit_buffer, static_cast<uint8_t>(i), payload, sizeof(payload));
+            }
+        }
+        if (!m_journal->append(m_commit_buffer.data(), m_commit_buffer.size())) return false;
+
+        if (m_journal->size() >= m_journal->config().compact_threshold_bytes) {
+            std::lock_guard<std::mutex> lock(m_flusher_mutex);
+            if (!m_compact_requested) {
+                m_compact_requested = true;
+                m_flusher_cv.notify_one();
+            }
         }
         return true;
     }
 
-    std::optional<std::string> get_string(const std::string& key) {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        auto it = m_data.find(key);
-        if (it != m_data.end()) {
-            return it->second;
+    // Folds the journal into a fresh image page. Runs on the flusher thread.
+    void compact() {
+        NvramImagePage page;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            fill_image_page_internal(page);
+            // The page already covers everything in the live journal; move it
+            // aside so new commits land in an empty one.
+            if (!m_journal->has_rotated() && !m_journal->rotate()) return;
+        }
+        if (commit_page_internal(page)) {
+            m_journal->discard_rotated();
+        } else {
+            std::cerr << "[NVRAM] ERROR: Journal compaction failed; will retry." << std::endl;
         }
-        return std::nullopt;
     }
 
-    void set_string(const std::string& key, const std::string& value) {
+    void start_flusher() {
+        {
+            std::lock_guard<std::mutex> lock(m_flusher_mutex);
+            m_flusher_stop = false;
+            m_compact_requested = false;
+        }
+        if (m_shared_flusher) {
+            register_with_shared_flusher();
+            return;
+        }
+        m_flusher = std::thread([this]() { flusher_loop(); });
+    }
+
+    void stop_flusher() {
+        if (m_flusher_registered) {
+            unregister_from_shared_flusher();
+            m_journal->sync();
+            return;
+        }
+        if (!m_flusher.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(m_flusher_mutex);
+            m_flusher_stop = true;
+        }
+        m_flusher_cv.notify_one();
+        m_flusher.join();
+        m_journal->sync();
+    }
+
+    void register_with_shared_flusher();
+    void unregister_from_shared_flusher();
+
+    // One round of background work, as done by flusher_loop() per wake-up.
+    // Called by a shared NvramFlusher.
+    void flush_once() {
+        bool compact_now;
+        {
+            std::lock_guard<std::mutex> lock(m_flusher_mutex);
+            compact_now = m_compact_requested;
+            m_compact_requested = false;
+        }
+        m_journal->sync();
+        if (compact_now) compact();
+    }
+
+    void flusher_loop() {
+        const auto interval = m_journal->config().fsync_interval;
+        std::unique_lock<std::mutex> lock(m_flusher_mutex);
+        while (!m_flusher_stop) {
+            m_flusher_cv.wait_for(lock, interval, [this]() { return m_flusher_stop || m_compact_requested; });
+            bool compact_now = m_compact_requested;
+            m_compact_requested = false;
+            lock.unlock();
+
+            m_journal->sync();
+            if (compact_now) compact();
+
+            lock.lock();
+        }
+    }
+};
+
+// Background fsyncs and compaction for any number of journaled NVRAMManagers
+// on a single thread. A process hosting many ECUs would otherwise run one
+// flusher thread per parameter store. Managers opt in with use_flusher().
+//
+// Compaction requests are picked up on the next tick rather than waking the
+// thread, so a full journal waits at most one interval longer to be folded.
+class NvramFlusher {
+public:
+    explicit NvramFlusher(std::chrono::milliseconds interval) : m_interval(interval) {
+        m_thread = std::thread([this]() { run(); });
+    }
+
+    ~NvramFlusher() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_one();
+        m_thread.join();
+    }
+
+    NvramFlusher(const NvramFlusher&) = delete;
+    NvramFlusher& operator=(const NvramFlusher&) = delete;
+
+    size_t size() {
         std::lock_guard<std::mutex> lock(m_mutex);
-        m_data[key] = value;
+        return m_managers.size();
     }
 
 private:
-    std::string m_filename;
-    std::map<std::string, std::string> m_data;
-    std::mutex m_mutex;
+    friend class NVRAMManager;
 
-    // Creates a default NVRAM file with initial values for the advanced controller.
-    bool create_default_nvram_internal() {
-        m_data["FIRMWARE_VERSION"] = "5.0.0";
-        m_data["ECU_SERIAL_NUMBER"] = "VECU-2025-005";
-        m_data["LEAD_VEHICLE_SPEED"] = "65.0";
-        m_data["OWN_VEHICLE_SPEED"] = "65.0";
-        m_data["ACC_GAP_SETTING"] = "3";
-        
-        // --- New Advanced Parameters ---
-        m_data["ACC_KP"] = "0.4"; // Proportional gain
-        m_data["ACC_KI"] = "0.1"; // Integral gain
-        m_data["ACC_MAX_ACCEL"] = "2.0"; // Max speed increase per cycle (mph)
-        m_data["ACC_MAX_DECEL"] = "3.0"; // Max speed decrease per cycle (mph)
-        
-        std::ofstream file(m_filename);
-        if (!file.is_open()) return false;
-        for (const auto& pair : m_data) {
-            file << pair.first << "=" << pair.second << std::endl;
+    std::chrono::milliseconds m_interval;
+    std::mutex m_mutex;               // Guards m_managers; held for a whole pass
+    std::condition_variable m_cv;
+    std::vector<NVRAMManager*> m_managers;
+    bool m_stop = false;
+    std::thread m_thread;
+
+    void add(NVRAMManager* manager) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_managers.push_back(manager);
+    }
+
+    // Returns only once no pass is touching `manager`.
+    void remove(NVRAMManager* manager) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_managers.erase(std::remove(m_managers.begin(), m_managers.end(), manager), m_managers.end());
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_stop) {
+            m_cv.wait_for(lock, m_interval, [this]() { return m_stop; });
+            for (NVRAMManager* manager : m_managers) manager->flush_once();
         }
-        return true;
     }
 };
+
+inline void NVRAMManager::register_with_shared_flusher() {
+    m_shared_flusher->add(this);
+    m_flusher_registered = true;
+}
+
+inline void NVRAMManager::unregister_from_shared_flusher() {
+    m_shared_flusher->remove(this);
+    m_flusher_registered = false;
+}
@@ -0,0 +1,587 @@
+// ota_campaign: flashes one image onto many ECUs at once. Every target runs
+// the same UDS sequence as `doip_client --update` (RoutineControl 0xFF00,
+// RequestDownload, windowed TransferData, TransferExit) on its own
+// connection, and all of them are driven from a single io_context thread.
+// The image is memory-mapped and hashed once, and every session sends its
+// blocks straight from the shared mapping, so the campaign takes about as
+// long as its slowest target rather than the sum of all of them. A target
+// that fails is retried from the start, or with --resume on from the first
+// chunk the ECU still lacks (see ota_manifest.hpp). Progress is printed once a second,
+// with a per-target report at the end as text and, optionally, JSON.
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <deque>
+#include <chrono>
+#include <array>
+#include <algorithm>
+#include <cstdio>
+#include <boost/asio.hpp>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "doip_protocol.hpp"
+#include "sha256_stream.hpp"
+#include "ota_manifest.hpp"
+
+using boost::asio::ip::tcp;
+using CampaignClock = std::chrono::steady_clock;
+
+// Blocks kept in flight per target unless --window overrides it.
+const uint8_t DEFAULT_CAMPAIGN_WINDOW = 16;
+
+struct CampaignOptions {
+    std::string image_path;
+    std::vector<std::string> targets; // host:port
+    unsigned concurrency = 0;         // Targets flashed at the same time; 0 = all
+    unsigned retries = 2;             // Extra attempts per target
+    double retry_delay_s = 1;
+    double timeout_s = 120;           // Per attempt
+    uint8_t window = DEFAULT_CAMPAIGN_WINDOW;
+    bool resume = false;              // Send a chunk manifest so retries resume
+    std::string json_path;            // "-" = stdout
+};
+
+// Read-only mapping of the image, shared by every session.
+class MappedImage {
+public:
+    MappedImage() = default;
+    MappedImage(const MappedImage&) = delete;
+    MappedImage& operator=(const MappedImage&) = delete;
+
+    ~MappedImage() {
+        if (m_data) ::munmap(m_data, m_size);
+    }
+
+    bool open(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        struct stat st;
+        bool ok = ::fstat(fd, &st) == 0 && st.st_size > 0;
+        if (ok) {
+            m_size = static_cast<size_t>(st.st_size);
+            void* mapping = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ok = mapping != MAP_FAILED;
+            if (ok) {
+                m_data = static_cast<uint8_t*>(mapping);
+                ::madvise(m_data, m_size, MADV_SEQUENTIAL);
+            }
+        }
+        ::close(fd);
+        return ok;
+    }
+
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+};
+
+struct TargetResult {
+    std::string target;
+    bool ok = false;
+    unsigned attempts = 0;
+    double seconds = 0;      // From the first attempt until the target finished
+    double last_attempt_s = 0;
+    uint64_t bytes_sent = 0; // Image bytes, summed over every attempt
+    std::string error;       // Reason the last attempt failed
+};
+
+// State shared by every target. Everything runs on one io_context thread.
+struct Campaign {
+    boost::asio::io_context io_context;
+    CampaignOptions options;
+    MappedImage image;
+    std::string image_hash;
+    std::vector<uint8_t> manifest;    // Encoded chunk manifest with --resume on
+    uint32_t manifest_chunk_size = 0;
+    std::string manifest_root;        // Sent in TransferExit instead of image_hash
+    std::vector<TargetResult> results;
+    size_t next_target = 0;
+    size_t active = 0;
+    size_t finished = 0;
+    size_t failed = 0;
+    CampaignClock::time_point start;
+    CampaignClock::time_point last_finish;
+    boost::asio::steady_timer progress_timer{io_context};
+};
+
+void start_next_target(Campaign& campaign);
+
+// Flashes one ECU, retrying from the start after a failure. Every callback
+// carries the attempt it belongs to, so completions left over from an
+// abandoned attempt are ignored.
+class TargetSession : public std::enable_shared_from_this<TargetSession> {
+public:
+    TargetSession(Campaign& campaign, size_t index)
+        : m_campaign(campaign), m_index(index), m_resolver(campaign.io_context), m_socket(campaign.io_context),
+          m_deadline(campaign.io_context), m_retry_timer(campaign.io_context) {
+        const std::string& target = result().target;
+        size_t colon = target.rfind(':');
+        m_host = colon == std::string::npos ? target : target.substr(0, colon);
+        m_port = colon == std::string::npos ? "13400" : target.substr(colon + 1);
+    }
+
+    void start() {
+        m_first_start = CampaignClock::now();
+        begin_attempt();
+    }
+
+private:
+    TargetResult& result() { return m_campaign.results[m_index]; }
+
+    void begin_attempt() {
+        ++m_attempt;
+        ++result().attempts;
+        m_attempt_start = CampaignClock::now();
+        m_offset = 0;
+        m_block_counter = 1;
+        m_unacked.clear();
+        m_writing = false;
+        m_exit_sent = false;
+
+        auto self = shared_from_this();
+        unsigned attempt = m_attempt;
+        m_deadline.expires_after(std::chrono::duration_cast<CampaignClock::duration>(
+            std::chrono::duration<double>(m_campaign.options.timeout_s)));
+        m_deadline.async_wait([this, self, attempt](const boost::system::error_code& ec) {
+            if (!ec && attempt == m_attempt) fail("timed out");
+        });
+        m_resolver.async_resolve(m_host, m_port,
+            [this, self, attempt](const boost::system::error_code& ec, tcp::resolver::results_type endpoints) {
+                if (attempt != m_attempt) return;
+                if (ec) return fail("resolve: " + ec.message());
+                boost::asio::async_connect(m_socket, endpoints,
+                    [this, self, attempt](const boost::system::error_code& ec, const tcp::endpoint&) {
+                        if (attempt != m_attempt) return;
+                        if (ec) return fail("connect: " + ec.message());
+                        m_socket.set_option(tcp::no_delay(true));
+                        enter_programming_session();
+                    });
+            });
+    }
+
+    // --- UDS sequence ---
+    void enter_programming_session() {
+        exchange({UDS_ROUTINE_CONTROL, 0x01, UDS_ENTER_PROGRAMMING_SESSION >> 8, UDS_ENTER_PROGRAMMING_SESSION & 0xFF},
+            [this]() {
+                if (m_response[0] != 0x71) return fail("programming session refused");
+                request_download();
+            });
+    }
+
+    void request_download() {
+        uint32_t size = static_cast<uint32_t>(m_campaign.image.size());
+        const bool resume = m_campaign.options.resume;
+        std::vector<uint8_t> request = {UDS_REQUEST_DOWNLOAD, resume ? OTA_FORMAT_MANIFEST : uint8_t(0x00), 0x44, 0x00, 0x00, 0x00, 0x00,
+                                        static_cast<uint8_t>(size >> 24), static_cast<uint8_t>(size >> 16),
+                                        static_cast<uint8_t>(size >> 8), static_cast<uint8_t>(size), m_campaign.options.window};
+        request.insert(request.end(), m_campaign.manifest.begin(), m_campaign.manifest.end());
+        exchange(std::move(request),
+            [this, resume]() {
+                if (m_response[0] != 0x74) return fail("RequestDownload refused");
+                if (resume) {
+                    // 0x74, 0x40, maxNumberOfBlockLength[4], window, first_missing_chunk[4]; one chunk per block.
+                    if (m_response.size() < 11) return fail("resumable downloads not supported");
+                    m_chunk_size = m_campaign.manifest_chunk_size;
+                    m_window = std::max<uint8_t>(1, m_response[6]);
+                    uint32_t first_chunk = (uint32_t(m_response[7]) << 24) | (uint32_t(m_response[8]) << 16) |
+                                           (uint32_t(m_response[9]) << 8) | m_response[10];
+                    m_offset = std::min<size_t>(size_t(first_chunk) * m_chunk_size, m_campaign.image.size());
+                    read_transfer_response();
+                    pump_transfer();
+                    return;
+                }
+                // 0x74, lengthFormatIdentifier, maxNumberOfBlockLength[n], then the granted window.
+                m_chunk_size = DEFAULT_TRANSFER_CHUNK_SIZE;
+                m_window = 1;
+                size_t length_bytes = m_response.size() >= 2 ? m_response[1] >> 4 : 0;
+                if (length_bytes > 0 && m_response.size() >= 2 + length_bytes) {
+                    size_t max_block_length = 0;
+                    for (size_t i = 0; i < length_bytes; ++i) max_block_length = (max_block_length << 8) | m_response[2 + i];
+                    if (max_block_length > 2) m_chunk_size = max_block_length - 2;
+                    if (m_response.size() > 2 + length_bytes) m_window = std::max<uint8_t>(1, m_response[2 + length_bytes]);
+                }
+                read_transfer_response();
+                pump_transfer();
+            });
+    }
+
+    // Writes TransferData blocks while the window has room, then TransferExit
+    // once the whole image is out. One write is in flight at a time.
+    void pump_transfer() {
+        if (m_writing || m_exit_sent) return;
+        const size_t image_size = m_campaign.image.size();
+        auto self = shared_from_this();
+        unsigned attempt = m_attempt;
+        if (m_offset < image_size) {
+            if (m_unacked.size() >= m_window) return;
+            size_t length = std::min(m_chunk_size, image_size - m_offset);
+            m_block_header = make_doip_header(0x8001, static_cast<uint32_t>(length + 2));
+            m_block_prefix = {UDS_TRANSFER_DATA, m_block_counter};
+            std::array<boost::asio::const_buffer, 3> buffers = {
+                boost::asio::buffer(&m_block_header, sizeof(DoIPHeader)), boost::asio::buffer(m_block_prefix),
+                boost::asio::buffer(m_campaign.image.data() + m_offset, length)};
+            m_unacked.push_back(m_block_counter++);
+            m_offset += length;
+            result().bytes_sent += length;
+            m_writing = true;
+            boost::asio::async_write(m_socket, buffers, [this, self, attempt](const boost::system::error_code& ec, std::size_t) {
+                if (attempt != m_attempt) return;
+                if (ec) return fail("send: " + ec.message());
+                m_writing = false;
+                pump_transfer();
+            });
+            return;
+        }
+        // The ECU verifies the image against this digest (or Merkle root) before installing it.
+        m_exit_sent = true;
+        m_request = {UDS_REQUEST_TRANSFER_EXIT};
+        const std::string& hash = m_campaign.options.resume ? m_campaign.manifest_root : m_campaign.image_hash;
+        m_request.insert(m_request.end(), hash.begin(), hash.end());
+        write_request([](){});
+    }
+
+    // TransferData acknowledgements are cumulative: 0x76 with counter N
+    // covers every block up to N. TransferExit's 0x77 ends the transfer.
+    void read_transfer_response() {
+        read_response([this]() {
+            if (m_response[0] == 0x77) return succeed();
+            if (m_response[0] != 0x76 || m_response.size() < 2) return fail("unexpected response during transfer");
+            uint8_t acked = m_response[1];
+            while (!m_unacked.empty()) {
+                uint8_t counter = m_unacked.front();
+                m_unacked.pop_front();
+                if (counter == acked) break;
+            }
+            read_transfer_response();
+            pump_transfer();
+        });
+    }
+
+    // --- Outcome ---
+    void succeed() {
+        finish_attempt();
+        finish(true);
+    }
+
+    void fail(const std::string& reason) {
+        finish_attempt();
+        result().error = reason;
+        if (result().attempts > m_campaign.options.retries) return finish(false);
+        std::cout << "[CAMPAIGN] " << result().target << ": attempt " << result().attempts << " failed (" << reason
+                  << "); retrying in " << m_campaign.options.retry_delay_s << " s." << std::endl;
+        auto self = shared_from_this();
+        m_retry_timer.expires_after(std::chrono::duration_cast<CampaignClock::duration>(
+            std::chrono::duration<double>(m_campaign.options.retry_delay_s)));
+        m_retry_timer.async_wait([this, self](const boost::system::error_code& ec) {
+            if (!ec) begin_attempt();
+        });
+    }
+
+    // Abandons whatever the current attempt still has outstanding.
+    void finish_attempt() {
+        ++m_attempt;
+        result().last_attempt_s = std::chrono::duration<double>(CampaignClock::now() - m_attempt_start).count();
+        m_deadline.cancel();
+        m_resolver.cancel();
+        boost::system::error_code ignored;
+        m_socket.close(ignored);
+    }
+
+    void finish(bool ok) {
+        TargetResult& target = result();
+        target.ok = ok;
+        if (ok) target.error.clear();
+        m_campaign.last_finish = CampaignClock::now();
+        target.seconds = std::chrono::duration<double>(m_campaign.last_finish - m_first_start).count();
+        --m_campaign.active;
+        ++m_campaign.finished;
+        if (!ok) ++m_campaign.failed;
+        if (ok) {
+            std::cout << "[CAMPAIGN] " << target.target << ": flashed in " << std::fixed << std::setprecision(2)
+                      << target.seconds << " s (" << std::setprecision(1)
+                      << (target.last_attempt_s > 0 ? m_campaign.image.size() / target.last_attempt_s / (1024.0 * 1024.0) : 0.0)
+                      << " MiB/s, attempt " << target.attempts << ")." << std::defaultfloat << std::setprecision(6) << std::endl;
+        } else {
+            std::cerr << "[CAMPAIGN] " << target.target << ": FAILED after " << target.attempts << " attempt(s): "
+                      << target.error << std::endl;
+        }
+        start_next_target(m_campaign);
+    }
+
+    // --- Request/response plumbing ---
+    template <typename Done>
+    void exchange(std::vector<uint8_t> payload, Done done) {
+        m_request = std::move(payload);
+        write_request([this, done]() { read_response(done); });
+    }
+
+    template <typename Done>
+    void write_request(Done done) {
+        auto self = shared_from_this();
+        unsigned attempt = m_attempt;
+        m_request_header = make_doip_header(0x8001, static_cast<uint32_t>(m_request.size()));
+        std::array<boost::asio::const_buffer, 2> buffers = {
+            boost::asio::buffer(&m_request_header, sizeof(DoIPHeader)), boost::asio::buffer(m_request)};
+        m_writing = true;
+        boost::asio::async_write(m_socket, buffers, [this, self, attempt, done](const boost::system::error_code& ec, std::size_t) {
+            if (attempt != m_attempt) return;
+            if (ec) return fail("send: " + ec.message());
+            m_writing = false;
+            done();
+        });
+    }
+
+    // Reads one message into m_response. Negative responses fail the attempt;
+    // `done` sees only positive ones, with m_response[0] always valid.
+    template <typename Done>
+    void read_response(Done done) {
+        auto self = shared_from_this();
+        unsigned attempt = m_attempt;
+        boost::asio::async_read(m_socket, boost::asio::buffer(&m_response_header, sizeof(DoIPHeader)),
+            [this, self, attempt, done](const boost::system::error_code& ec, std::size_t) {
+                if (attempt != m_attempt) return;
+                if (ec) return fail("receive: " + ec.message());
+                m_response.resize(ntohl(m_response_header.payload_length));
+                boost::asio::async_read(m_socket, boost::asio::buffer(m_response),
+                    [this, self, attempt, done](const boost::system::error_code& ec, std::size_t) {
+                        if (attempt != m_attempt) return;
+                        if (ec) return fail("receive: " + ec.message());
+                        uint16_t type = ntohs(m_response_header.payload_type);
+                        if (is_negative_response(type, m_response)) {
+                            char reason[64];
+                            std::snprintf(reason, sizeof(reason), "negative response (NRC 0x%02X)",
+                                          m_response.size() >= 3 ? m_response[2] : 0);
+                            return fail(type == 0x8002 ? "DoIP negative acknowledgement" : reason);
+                        }
+                        if (m_response.empty()) m_response.push_back(0);
+                        done();
+                    });
+            });
+    }
+
+    Campaign& m_campaign;
+    size_t m_index;
+    std::string m_host;
+    std::string m_port;
+    tcp::resolver m_resolver;
+    tcp::socket m_socket;
+    boost::asio::steady_timer m_deadline;
+    boost::asio::steady_timer m_retry_timer;
+    unsigned m_attempt = 0;
+    CampaignClock::time_point m_first_start;
+    CampaignClock::time_point m_attempt_start;
+
+    DoIPHeader m_request_header;
+    DoIPHeader m_response_header;
+    std::vector<uint8_t> m_request;
+    std::vector<uint8_t> m_response;
+    bool m_writing = false;
+
+    size_t m_chunk_size = DEFAULT_TRANSFER_CHUNK_SIZE;
+    uint8_t m_window = 1;
+    size_t m_offset = 0;
+    uint8_t m_block_counter = 1;
+    std::deque<uint8_t> m_unacked; // Block counters sent but not yet acknowledged
+    DoIPHeader m_block_header;
+    std::array<uint8_t, 2> m_block_prefix{};
+    bool m_exit_sent = false;
+};
+
+void start_next_target(Campaign& campaign) {
+    size_t limit = campaign.options.concurrency ? campaign.options.concurrency : campaign.results.size();
+    while (campaign.active < limit && campaign.next_target < campaign.results.size()) {
+        ++campaign.active;
+        std::make_shared<TargetSession>(campaign, campaign.next_target++)->start();
+    }
+    if (campaign.finished == campaign.results.size()) campaign.progress_timer.cancel();
+}
+
+void schedule_progress(Campaign& campaign) {
+    campaign.progress_timer.expires_after(std::chrono::seconds(1));
+    campaign.progress_timer.async_wait([&campaign](const boost::system::error_code& ec) {
+        if (ec || campaign.finished == campaign.results.size()) return;
+        uint64_t sent = 0;
+        for (const TargetResult& result : campaign.results) sent += result.bytes_sent;
+        double elapsed = std::chrono::duration<double>(CampaignClock::now() - campaign.start).count();
+        std::cout << "[CAMPAIGN] " << std::fixed << std::setprecision(1) << elapsed << " s: "
+                  << campaign.finished - campaign.failed << " flashed, " << campaign.failed << " failed, "
+                  << campaign.active << " in progress, " << campaign.results.size() - campaign.next_target << " waiting; "
+                  << sent / (1024.0 * 1024.0) << " MiB sent." << std::defaultfloat << std::setprecision(6) << std::endl;
+        schedule_progress(campaign);
+    });
+}
+
+void print_usage() {
+    std::cerr << "Usage: ota_campaign --image <file> (--targets <host:port>[,...] | --targets-file <file>) [options]" << std::endl;
+    std::cerr << "  --image <file>              Firmware image to install on every target" << std::endl;
+    std::cerr << "  --targets <list>            Comma-separated host:port targets (port defaults to 13400)" << std::endl;
+    std::cerr << "  --targets-file <file>       One host:port per line; # starts a comment" << std::endl;
+    std::cerr << "  --concurrency <n>           Targets flashed at the same time (default: all)" << std::endl;
+    std::cerr << "  --retries <n>               Extra attempts per target after a failure (default 2)" << std::endl;
+    std::cerr << "  --retry-delay <s>           Pause before a retry (default 1)" << std::endl;
+    std::cerr << "  --timeout <s>               Limit for one attempt (default 120)" << std::endl;
+    std::cerr << "  --window <n>                TransferData blocks in flight per target (default 16)" << std::endl;
+    std::cerr << "  --resume on|off             Send a chunk manifest so a retry continues where the failed" << std::endl;
+    std::cerr << "                              attempt stopped instead of starting over (default off)" << std::endl;
+    std::cerr << "  --json <file|->             Also write the per-target results as JSON" << std::endl;
+}
+
+bool read_targets_file(const std::string& path, std::vector<std::string>& targets) {
+    std::ifstream file(path);
+    if (!file.is_open()) return false;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream words(line.substr(0, line.find('#')));
+        std::string target;
+        if (words >> target) targets.push_back(target);
+    }
+    return true;
+}
+
+bool parse_command_line(int argc, char* argv[], CampaignOptions& options) {
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string option = argv[i];
+            if (i + 1 >= argc) { print_usage(); return false; }
+            std::string value = argv[++i];
+            if (option == "--image") options.image_path = value;
+            else if (option == "--targets") {
+                std::stringstream list(value);
+                std::string target;
+                while (std::getline(list, target, ',')) {
+                    if (!target.empty()) options.targets.push_back(target);
+                }
+            } else if (option == "--targets-file") {
+                if (!read_targets_file(value, options.targets)) {
+                    std::cerr << "[CAMPAIGN] Could not read " << value << std::endl;
+                    return false;
+                }
+            }
+            else if (option == "--concurrency") options.concurrency = static_cast<unsigned>(std::max(0, std::stoi(value)));
+            else if (option == "--retries") options.retries = static_cast<unsigned>(std::max(0, std::stoi(value)));
+            else if (option == "--retry-delay") options.retry_delay_s = std::max(0.0, std::stod(value));
+            else if (option == "--timeout") options.timeout_s = std::max(0.1, std::stod(value));
+            else if (option == "--window") options.window = static_cast<uint8_t>(std::clamp(std::stoi(value), 1, 255));
+            else if (option == "--resume" && (value == "on" || value == "off")) options.resume = value == "on";
+            else if (option == "--json") options.json_path = value;
+            else { print_usage(); return false; }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "[CAMPAIGN] Invalid argument: " << e.what() << std::endl;
+        return false;
+    }
+    if (options.image_path.empty() || options.targets.empty()) {
+        print_usage();
+        return false;
+    }
+    return true;
+}
+
+void print_text_report(const Campaign& campaign, double elapsed_s) {
+    std::cout << std::left << std::setw(24) << "target" << std::right << std::setw(8) << "status" << std::setw(10) << "attempts"
+              << std::setw(11) << "seconds" << std::setw(10) << "MiB/s" << "  error" << std::endl;
+    double slowest = 0;
+    double total = 0;
+    for (const TargetResult& result : campaign.results) {
+        slowest = std::max(slowest, result.seconds);
+        total += result.seconds;
+        double rate = result.ok && result.last_attempt_s > 0 ? campaign.image.size() / result.last_attempt_s / (1024.0 * 1024.0) : 0.0;
+        std::cout << std::left << std::setw(24) << result.target << std::right << std::setw(8) << (result.ok ? "ok" : "FAILED")
+                  << std::setw(10) << result.attempts << std::fixed << std::setprecision(3) << std::setw(11) << result.seconds
+                  << std::setprecision(1) << std::setw(10) << rate << std::defaultfloat << std::setprecision(6)
+                  << "  " << result.error << std::endl;
+    }
+    std::cout << "[CAMPAIGN] " << campaign.results.size() << " target(s): " << campaign.finished - campaign.failed << " flashed, "
+              << campaign.failed << " failed in " << std::fixed << std::setprecision(2) << elapsed_s << " s (slowest target "
+              << slowest << " s, sum over targets " << total << " s)." << std::defaultfloat << std::setprecision(6) << std::endl;
+}
+
+void write_json_report(std::ostream& out, const Campaign& campaign, double elapsed_s) {
+    out << std::defaultfloat << std::setprecision(9);
+    out << "{\n  \"image\": \"" << json_escape(campaign.options.image_path) << "\",\n  \"image_bytes\": " << campaign.image.size()
+        << ",\n  \"image_sha256\": \"" << campaign.image_hash << "\",\n  \"elapsed_s\": " << elapsed_s
+        << ",\n  \"flashed\": " << campaign.finished - campaign.failed << ",\n  \"failed\": " << campaign.failed
+        << ",\n  \"targets\": [\n";
+    for (size_t i = 0; i < campaign.results.size(); ++i) {
+        const TargetResult& result = campaign.results[i];
+        out << "    {\"target\": \"" << json_escape(result.target) << "\", \"ok\": " << (result.ok ? "true" : "false")
+            << ", \"attempts\": " << result.attempts << ", \"seconds\": " << result.seconds
+            << ", \"bytes_sent\": " << result.bytes_sent << ", \"error\": \"" << json_escape(result.error) << "\"}"
+            << (i + 1 < campaign.results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    Campaign campaign;
+    if (!parse_command_line(argc, argv, campaign.options)) return 1;
+    const CampaignOptions& options = campaign.options;
+
+    // Mapped and hashed once; every session sends from this mapping.
+    if (!campaign.image.open(options.image_path)) {
+        std::cerr << "[CAMPAIGN] Could not map image: " << options.image_path << std::endl;
+        return 1;
+    }
+    Sha256Stream digest;
+    digest.update(campaign.image.data(), campaign.image.size());
+    auto hash = digest.finish_hex();
+    if (!hash) {
+        std::cerr << "[CAMPAIGN] Could not hash image: " << options.image_path << std::endl;
+        return 1;
+    }
+    campaign.image_hash = *hash;
+    if (options.resume) {
+        uint32_t chunk_size = OTA_DEFAULT_CHUNK_SIZE;
+        OtaManifest manifest = OtaManifest::build(campaign.image.data(), static_cast<uint32_t>(campaign.image.size()), chunk_size);
+        if (manifest.chunk_count() > OTA_MAX_MANIFEST_CHUNKS) {
+            std::cerr << "[CAMPAIGN] Image is too large for a chunk manifest: " << options.image_path << std::endl;
+            return 1;
+        }
+        manifest.encode(campaign.manifest);
+        campaign.manifest_chunk_size = chunk_size;
+        campaign.manifest_root = sha256_digest_hex(manifest.root());
+    }
+
+    for (const std::string& target : options.targets) {
+        TargetResult result;
+        result.target = target;
+        campaign.results.push_back(result);
+    }
+    std::cout << "[CAMPAIGN] Flashing " << campaign.image.size() << " bytes onto " << campaign.results.size() << " target(s), "
+              << (options.concurrency ? std::to_string(options.concurrency) : std::string("all")) << " at a time." << std::endl;
+
+    try {
+        campaign.start = CampaignClock::now();
+        campaign.last_finish = campaign.start;
+        start_next_target(campaign);
+        schedule_progress(campaign);
+        campaign.io_context.run();
+    } catch (const std::exception& e) {
+        std::cerr << "[CAMPAIGN] Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    double elapsed_s = std::chrono::duration<double>(campaign.last_finish - campaign.start).count();
+    print_text_report(campaign, elapsed_s);
+    if (options.json_path == "-") {
+        write_json_report(std::cout, campaign, elapsed_s);
+    } else if (!options.json_path.empty()) {
+        std::ofstream json(options.json_path);
+        write_json_report(json, campaign, elapsed_s);
+        if (!json) {
+            std::cerr << "[CAMPAIGN] Could not write " << options.json_path << std::endl;
+            return 1;
+        }
+    }
+    return campaign.failed == 0 ? 0 : 2;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <iostream>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <zlib.h>
+
+// Set in RequestDownload's dataFormatIdentifier when the TransferData stream
+// is zlib-compressed. Combines with OTA_FORMAT_DELTA (ota_delta.hpp): the
+// patch is compressed, the ECU inflates it and then applies it.
+const uint8_t OTA_FORMAT_COMPRESSED = 0x20;
+
+// Inflated output is handed on in pieces of at most this size.
+constexpr size_t OTA_INFLATE_CHUNK_SIZE = 64 * 1024;
+
+// Compresses a stream in pieces. Each call appends whatever compressed output
+// is ready to `out`; the last call must pass finish = true.
+class OtaDeflater {
+public:
+    explicit OtaDeflater(int level = Z_BEST_COMPRESSION) {
+        m_stream.zalloc = Z_NULL;
+        m_stream.zfree = Z_NULL;
+        m_stream.opaque = Z_NULL;
+        m_ok = deflateInit(&m_stream, level) == Z_OK;
+    }
+
+    ~OtaDeflater() {
+        if (m_ok) deflateEnd(&m_stream);
+    }
+
+    OtaDeflater(const OtaDeflater&) = delete;
+    OtaDeflater& operator=(const OtaDeflater&) = delete;
+
+    bool compress(const uint8_t* data, size_t length, bool finish, std::vector<uint8_t>& out) {
+        if (!m_ok) return false;
+        m_stream.next_in = const_cast<Bytef*>(data);
+        m_stream.avail_in = static_cast<uInt>(length);
+        const int flush = finish ? Z_FINISH : Z_NO_FLUSH;
+        int rc;
+        do {
+            size_t used = out.size();
+            out.resize(used + deflateBound(&m_stream, m_stream.avail_in) + 64);
+            m_stream.next_out = out.data() + used;
+            m_stream.avail_out = static_cast<uInt>(out.size() - used);
+            rc = deflate(&m_stream, flush);
+            out.resize(out.size() - m_stream.avail_out);
+            if (rc == Z_STREAM_ERROR) return m_ok = false;
+        } while (m_stream.avail_in > 0 || (finish && rc != Z_STREAM_END));
+        return true;
+    }
+
+private:
+    z_stream m_stream{};
+    bool m_ok = false;
+};
+
+// Inflates a zlib stream fed in arbitrary pieces and passes the output to
+// `sink` as it is produced. Any corrupt input or a sink failure makes feed()
+// return false.
+class OtaInflater {
+public:
+    using Sink = std::function<bool(const uint8_t* data, size_t length)>;
+
+    explicit OtaInflater(Sink sink) : m_sink(std::move(sink)), m_output(OTA_INFLATE_CHUNK_SIZE) {
+        m_stream.zalloc = Z_NULL;
+        m_stream.zfree = Z_NULL;
+        m_stream.opaque = Z_NULL;
+        m_ok = inflateInit(&m_stream) == Z_OK;
+    }
+
+    ~OtaInflater() {
+        inflateEnd(&m_stream);
+    }
+
+    OtaInflater(const OtaInflater&) = delete;
+    OtaInflater& operator=(const OtaInflater&) = delete;
+
+    bool feed(const uint8_t* data, size_t length) {
+        if (!m_ok) return false;
+        if (m_finished) return length == 0 || fail("Data after end of compressed stream");
+        m_stream.next_in = const_cast<Bytef*>(data);
+        m_stream.avail_in = static_cast<uInt>(length);
+        while (!m_finished) {
+            m_stream.next_out = m_output.data();
+            m_stream.avail_out = static_cast<uInt>(m_output.size());
+            int rc = inflate(&m_stream, Z_NO_FLUSH);
+            if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR) return fail(m_stream.msg ? m_stream.msg : "inflate failed");
+            size_t produced = m_output.size() - m_stream.avail_out;
+            if (produced > 0 && !m_sink(m_output.data(), produced)) return m_ok = false;
+            if (rc == Z_STREAM_END) {
+                m_finished = true;
+                if (m_stream.avail_in > 0) return fail("Data after end of compressed stream");
+            } else if (m_stream.avail_out > 0) {
+                break; // All input consumed and all output flushed; needs more input.
+            }
+        }
+        return true;
+    }
+
+    // True once the end of the compressed stream has been reached.
+    bool finished() const { return m_finished; }
+
+private:
+    Sink m_sink;
+    std::vector<uint8_t> m_output;
+    z_stream m_stream{};
+    bool m_ok = false;
+    bool m_finished = false;
+
+    bool fail(const char* reason) {
+        std::cerr << "[OTA] ERROR: Invalid compressed stream: " << reason << std::endl;
+        m_ok = false;
+        return false;
+    }
+};
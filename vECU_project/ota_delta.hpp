@@ -0,0 +1,325 @@
+#pragma once
+
+#include <iostream>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sha256_stream.hpp"
+
+// --- OTA data formats ---
+// RequestDownload's dataFormatIdentifier selects how the TransferData stream
+// is encoded. The high nibble (compressionMethod in ISO 14229) is
+// vendor-defined; this ECU uses it for the encodings below.
+const uint8_t OTA_FORMAT_RAW = 0x00;   // The image itself
+const uint8_t OTA_FORMAT_DELTA = 0x10; // A delta patch against the installed image
+
+// --- Delta patch format ---
+// A patch rebuilds the target image from the installed (base) image with two
+// operations: COPY a range of the base, or INSERT literal bytes. All integers
+// are little-endian.
+//
+//   header: magic, version, reserved[3], base_size, target_size, base_sha256[32]
+//   ops:    0x01 COPY   offset:u32 length:u32
+//           0x02 INSERT length:u32 bytes[length]
+//           0x00 END
+constexpr uint32_t OTA_DELTA_MAGIC = 0x544C4456; // "VDLT"
+constexpr uint8_t OTA_DELTA_VERSION = 1;
+constexpr size_t OTA_DELTA_HEADER_SIZE = 48;
+constexpr uint8_t OTA_DELTA_OP_END = 0x00;
+constexpr uint8_t OTA_DELTA_OP_COPY = 0x01;
+constexpr uint8_t OTA_DELTA_OP_INSERT = 0x02;
+
+// Matches shorter than this are cheaper to send as literals.
+constexpr size_t OTA_DELTA_BLOCK_SIZE = 32;
+// Base offsets are indexed every this many bytes; any match at least
+// BLOCK_SIZE + STRIDE - 1 long is guaranteed to be found.
+constexpr size_t OTA_DELTA_INDEX_STRIDE = 8;
+// Hash-chain candidates checked per position.
+constexpr size_t OTA_DELTA_MAX_CANDIDATES = 16;
+
+inline void ota_put_u32(std::vector<uint8_t>& out, uint32_t value) {
+    out.push_back(static_cast<uint8_t>(value));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value >> 16));
+    out.push_back(static_cast<uint8_t>(value >> 24));
+}
+
+inline uint32_t ota_get_u32(const uint8_t* bytes) {
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+inline bool ota_hex_to_bytes(const std::string& hex, uint8_t* out, size_t size) {
+    if (hex.size() != size * 2) return false;
+    auto nibble = [](char c) -> int {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    };
+    for (size_t i = 0; i < size; ++i) {
+        int hi = nibble(hex[2 * i]), lo = nibble(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) return false;
+        out[i] = static_cast<uint8_t>((hi << 4) | lo);
+    }
+    return true;
+}
+
+// Builds a patch that turns `base` into `target`. Rsync-style: the base is
+// indexed by a rolling hash of fixed-size blocks, the target is scanned one
+// byte at a time, and every hit is extended in both directions as far as the
+// bytes agree.
+inline std::vector<uint8_t> encode_ota_delta(const std::vector<uint8_t>& base, const std::vector<uint8_t>& target) {
+    constexpr uint64_t PRIME = 0x100000001B3ULL;
+    constexpr size_t B = OTA_DELTA_BLOCK_SIZE;
+    uint64_t top_power = 1; // PRIME^(B-1)
+    for (size_t i = 1; i < B; ++i) top_power *= PRIME;
+    auto hash_block = [&](const uint8_t* p) {
+        uint64_t h = 0;
+        for (size_t i = 0; i < B; ++i) h = h * PRIME + p[i];
+        return h;
+    };
+
+    std::vector<uint8_t> patch;
+    patch.reserve(OTA_DELTA_HEADER_SIZE + target.size() / 8);
+    ota_put_u32(patch, OTA_DELTA_MAGIC);
+    patch.insert(patch.end(), {OTA_DELTA_VERSION, 0, 0, 0});
+    ota_put_u32(patch, static_cast<uint32_t>(base.size()));
+    ota_put_u32(patch, static_cast<uint32_t>(target.size()));
+    Sha256Stream base_digest;
+    base_digest.update(base.data(), base.size());
+    uint8_t base_hash[32] = {};
+    ota_hex_to_bytes(base_digest.finish_hex().value_or(""), base_hash, sizeof(base_hash));
+    patch.insert(patch.end(), base_hash, base_hash + sizeof(base_hash));
+
+    // Hash table of base blocks with chaining through `next`.
+    size_t table_bits = 10;
+    while ((size_t(1) << table_bits) < base.size() / OTA_DELTA_INDEX_STRIDE && table_bits < 24) ++table_bits;
+    const uint64_t table_mask = (uint64_t(1) << table_bits) - 1;
+    const uint32_t NONE = UINT32_MAX;
+    std::vector<uint32_t> head(size_t(1) << table_bits, NONE);
+    std::vector<uint32_t> next(base.size() >= B ? (base.size() - B) / OTA_DELTA_INDEX_STRIDE + 1 : 0, NONE);
+    for (size_t slot = 0; slot < next.size(); ++slot) {
+        size_t bucket = (hash_block(&base[slot * OTA_DELTA_INDEX_STRIDE]) >> 20) & table_mask;
+        next[slot] = head[bucket];
+        head[bucket] = static_cast<uint32_t>(slot);
+    }
+
+    size_t literal_start = 0;
+    auto emit_insert = [&](size_t end) {
+        if (end <= literal_start) return;
+        patch.push_back(OTA_DELTA_OP_INSERT);
+        ota_put_u32(patch, static_cast<uint32_t>(end - literal_start));
+        patch.insert(patch.end(), target.begin() + literal_start, target.begin() + end);
+    };
+
+    size_t pos = 0;
+    uint64_t h = target.size() >= B ? hash_block(target.data()) : 0;
+    while (target.size() >= B && pos + B <= target.size()) {
+        size_t best_length = 0, best_base = 0, best_back = 0;
+        size_t bucket = (h >> 20) & table_mask;
+        size_t checked = 0;
+        for (uint32_t slot = head[bucket]; slot != NONE && checked < OTA_DELTA_MAX_CANDIDATES; slot = next[slot], ++checked) {
+            size_t candidate = static_cast<size_t>(slot) * OTA_DELTA_INDEX_STRIDE;
+            if (std::memcmp(&base[candidate], &target[pos], B) != 0) continue;
+            size_t forward = B;
+            while (candidate + forward < base.size() && pos + forward < target.size() &&
+                   base[candidate + forward] == target[pos + forward]) ++forward;
+            size_t back = 0;
+            while (back < candidate && back < pos - literal_start &&
+                   base[candidate - back - 1] == target[pos - back - 1]) ++back;
+            if (forward + back > best_length) {
+                best_length = forward + back;
+                best_base = candidate - back;
+                best_back = back;
+            }
+        }
+        if (best_length == 0) {
+            if (pos + B < target.size()) {
+                h = (h - target[pos] * top_power) * PRIME + target[pos + B];
+            }
+            ++pos;
+            continue;
+        }
+        size_t match_start = pos - best_back;
+        emit_insert(match_start);
+        patch.push_back(OTA_DELTA_OP_COPY);
+        ota_put_u32(patch, static_cast<uint32_t>(best_base));
+        ota_put_u32(patch, static_cast<uint32_t>(best_length));
+        pos = match_start + best_length;
+        literal_start = pos;
+        if (pos + B <= target.size()) h = hash_block(&target[pos]);
+    }
+    emit_insert(target.size());
+    patch.push_back(OTA_DELTA_OP_END);
+    return patch;
+}
+
+// Read-only view of a whole file; used as the base image while a patch is applied.
+class ReadOnlyMapping {
+public:
+    ReadOnlyMapping() = default;
+    ~ReadOnlyMapping() { reset(); }
+    ReadOnlyMapping(const ReadOnlyMapping&) = delete;
+    ReadOnlyMapping& operator=(const ReadOnlyMapping&) = delete;
+
+    bool open(const std::string& path) {
+        reset();
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        struct stat st;
+        bool ok = ::fstat(fd, &st) == 0;
+        if (ok && st.st_size > 0) {
+            void* mapping = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            ok = mapping != MAP_FAILED;
+            if (ok) {
+                m_data = static_cast<const uint8_t*>(mapping);
+                m_size = static_cast<size_t>(st.st_size);
+            }
+        }
+        ::close(fd);
+        return ok;
+    }
+
+    void reset() {
+        if (m_data) ::munmap(const_cast<uint8_t*>(m_data), m_size);
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+};
+
+// Applies a delta patch as it arrives. feed() accepts the patch in arbitrary
+// pieces and passes the rebuilt image to `sink` in order, so the target is
+// never held in memory. Any malformed input makes feed() return false.
+class OtaDeltaDecoder {
+public:
+    using Sink = std::function<bool(const uint8_t* data, size_t length)>;
+
+    OtaDeltaDecoder(const uint8_t* base, size_t base_size, Sink sink)
+        : m_base(base), m_base_size(base_size), m_sink(std::move(sink)) {}
+
+    bool feed(const uint8_t* data, size_t length) {
+        while (length > 0) {
+            if (m_state == State::FAILED) return false;
+            if (m_state == State::DONE) return fail("Data after end of patch");
+            if (m_state == State::INSERT_DATA) {
+                size_t n = std::min<size_t>(length, m_remaining);
+                if (!emit(data, n)) return false;
+                data += n;
+                length -= n;
+                m_remaining -= static_cast<uint32_t>(n);
+                if (m_remaining == 0) expect(State::OPCODE, 1);
+                continue;
+            }
+            size_t n = std::min(length, m_need - m_have);
+            std::memcpy(m_field + m_have, data, n);
+            m_have += n;
+            data += n;
+            length -= n;
+            if (m_have == m_need && !parse_field()) return false;
+        }
+        return m_state != State::FAILED;
+    }
+
+    // True once the END op has been seen and the output size matched the header.
+    bool finished() const { return m_state == State::DONE; }
+
+private:
+    enum class State { HEADER, OPCODE, COPY_ARGS, INSERT_LENGTH, INSERT_DATA, DONE, FAILED };
+
+    const uint8_t* m_base;
+    size_t m_base_size;
+    Sink m_sink;
+    State m_state = State::HEADER;
+    uint8_t m_field[OTA_DELTA_HEADER_SIZE];
+    size_t m_need = OTA_DELTA_HEADER_SIZE;
+    size_t m_have = 0;
+    uint32_t m_remaining = 0;
+    uint64_t m_target_size = 0;
+    uint64_t m_written = 0;
+
+    void expect(State state, size_t bytes) {
+        m_state = state;
+        m_need = bytes;
+        m_have = 0;
+    }
+
+    bool fail(const char* reason) {
+        std::cerr << "[OTA] ERROR: Invalid delta patch: " << reason << std::endl;
+        m_state = State::FAILED;
+        return false;
+    }
+
+    bool emit(const uint8_t* data, size_t length) {
+        if (m_written + length > m_target_size) return fail("Output exceeds target size");
+        m_written += length;
+        if (!m_sink(data, length)) {
+            m_state = State::FAILED;
+            return false;
+        }
+        return true;
+    }
+
+    bool parse_field() {
+        switch (m_state) {
+            case State::HEADER: {
+                if (ota_get_u32(m_field) != OTA_DELTA_MAGIC || m_field[4] != OTA_DELTA_VERSION) return fail("Bad header");
+                if (ota_get_u32(m_field + 8) != m_base_size) return fail("Patch was built for a different base image");
+                m_target_size = ota_get_u32(m_field + 12);
+                Sha256Stream base_digest;
+                base_digest.update(m_base, m_base_size);
+                uint8_t base_hash[32];
+                if (!ota_hex_to_bytes(base_digest.finish_hex().value_or(""), base_hash, sizeof(base_hash)) ||
+                    std::memcmp(base_hash, m_field + 16, sizeof(base_hash)) != 0) {
+                    return fail("Patch was built for a different base image");
+                }
+                expect(State::OPCODE, 1);
+                return true;
+            }
+            case State::OPCODE:
+                switch (m_field[0]) {
+                    case OTA_DELTA_OP_END:
+                        if (m_written != m_target_size) return fail("Output is shorter than target size");
+                        m_state = State::DONE;
+                        return true;
+                    case OTA_DELTA_OP_COPY: expect(State::COPY_ARGS, 8); return true;
+                    case OTA_DELTA_OP_INSERT: expect(State::INSERT_LENGTH, 4); return true;
+                    default: return fail("Unknown op");
+                }
+            case State::COPY_ARGS: {
+                uint64_t offset = ota_get_u32(m_field);
+                uint64_t length = ota_get_u32(m_field + 4);
+                if (offset + length > m_base_size) return fail("COPY outside base image");
+                if (!emit(m_base + offset, static_cast<size_t>(length))) return false;
+                expect(State::OPCODE, 1);
+                return true;
+            }
+            case State::INSERT_LENGTH:
+                m_remaining = ota_get_u32(m_field);
+                if (m_remaining == 0) {
+                    expect(State::OPCODE, 1);
+                } else {
+                    m_state = State::INSERT_DATA;
+                }
+                return true;
+            default:
+                return fail("Unexpected state");
+        }
+    }
+};
@@ -0,0 +1,317 @@
+#pragma once
+
+#include <iostream>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <openssl/sha.h>
+
+#include "sha256_stream.hpp"
+
+// --- Resumable downloads ---
+// With OTA_FORMAT_MANIFEST, RequestDownload carries a chunk manifest: the
+// image is cut into fixed-size chunks and the SHA-256 of each one is listed.
+// Those hashes are the leaves of a Merkle tree whose root stands in for the
+// image hash in TransferExit. Every TransferData block is exactly one chunk,
+// so the ECU checks each one against its leaf as it arrives and records it as
+// done; a tester that reconnects after a broken link gets the first missing
+// chunk back in the RequestDownload response and continues from there.
+// Manifest downloads carry the raw image; they do not combine with the other
+// formats.
+//
+//   RequestDownload: 0x34, 0x40, 0x44, address[4], size[4], window, chunk_size[4], leaves[n][32]
+//   response:        0x74, 0x40, maxNumberOfBlockLength[4], window, first_missing_chunk[4]
+//   TransferExit:    0x37, Merkle root as lowercase hex
+const uint8_t OTA_FORMAT_MANIFEST = 0x40;
+constexpr uint32_t OTA_DEFAULT_CHUNK_SIZE = 64 * 1024;
+constexpr uint32_t OTA_MIN_CHUNK_SIZE = 1024;
+// One chunk is one TransferData block, so it must fit the ECU's block length.
+constexpr uint32_t OTA_MAX_CHUNK_SIZE = 64 * 1024;
+// Keeps RequestDownload within the ECU's 1 MiB payload limit; images needing
+// more chunks use larger ones.
+constexpr size_t OTA_MAX_MANIFEST_CHUNKS = 32 * 1024 - 1;
+
+using Sha256Digest = std::array<uint8_t, SHA256_DIGEST_LENGTH>;
+
+inline Sha256Digest sha256_digest(const uint8_t* data, size_t length) {
+    Sha256Digest digest;
+    SHA256(data, length, digest.data());
+    return digest;
+}
+
+inline std::string sha256_digest_hex(const Sha256Digest& digest) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(digest.size() * 2, '0');
+    for (size_t i = 0; i < digest.size(); ++i) {
+        hex[2 * i] = digits[digest[i] >> 4];
+        hex[2 * i + 1] = digits[digest[i] & 0x0F];
+    }
+    return hex;
+}
+
+struct OtaManifest {
+    uint32_t image_size = 0;
+    uint32_t chunk_size = OTA_DEFAULT_CHUNK_SIZE;
+    std::vector<Sha256Digest> leaves;
+
+    size_t chunk_count() const { return leaves.size(); }
+
+    size_t chunk_offset(size_t chunk) const { return chunk * static_cast<size_t>(chunk_size); }
+
+    size_t chunk_length(size_t chunk) const {
+        return std::min<size_t>(chunk_size, image_size - chunk_offset(chunk));
+    }
+
+    // Each level hashes pairs of the one below; an odd node out is carried up
+    // unchanged. A one-chunk image's root is its leaf.
+    Sha256Digest root() const {
+        if (leaves.empty()) return sha256_digest(nullptr, 0);
+        std::vector<Sha256Digest> level = leaves;
+        while (level.size() > 1) {
+            std::vector<Sha256Digest> parents;
+            parents.reserve((level.size() + 1) / 2);
+            for (size_t i = 0; i + 1 < level.size(); i += 2) {
+                uint8_t pair[2 * SHA256_DIGEST_LENGTH];
+                std::memcpy(pair, level[i].data(), SHA256_DIGEST_LENGTH);
+                std::memcpy(pair + SHA256_DIGEST_LENGTH, level[i + 1].data(), SHA256_DIGEST_LENGTH);
+                parents.push_back(sha256_digest(pair, sizeof(pair)));
+            }
+            if (level.size() % 2) parents.push_back(level.back());
+            level = std::move(parents);
+        }
+        return level.front();
+    }
+
+    // Builds the manifest of an image held in memory (tester side).
+    static OtaManifest build(const uint8_t* image, uint32_t size, uint32_t chunk_size) {
+        OtaManifest manifest;
+        manifest.image_size = size;
+        manifest.chunk_size = chunk_size;
+        for (size_t offset = 0; offset < size; offset += chunk_size) {
+            manifest.leaves.push_back(sha256_digest(image + offset, std::min<size_t>(chunk_size, size - offset)));
+        }
+        return manifest;
+    }
+
+    // Appends chunk_size and the leaves, as they follow the window byte in RequestDownload.
+    void encode(std::vector<uint8_t>& out) const {
+        out.push_back(static_cast<uint8_t>(chunk_size >> 24));
+        out.push_back(static_cast<uint8_t>(chunk_size >> 16));
+        out.push_back(static_cast<uint8_t>(chunk_size >> 8));
+        out.push_back(static_cast<uint8_t>(chunk_size));
+        for (const Sha256Digest& leaf : leaves) out.insert(out.end(), leaf.begin(), leaf.end());
+    }
+
+    // Parses what encode() wrote. The leaf count must match the image size.
+    static std::optional<OtaManifest> decode(uint32_t image_size, const uint8_t* data, size_t length) {
+        if (length < 4) return std::nullopt;
+        OtaManifest manifest;
+        manifest.image_size = image_size;
+        manifest.chunk_size = (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) | (uint32_t(data[2]) << 8) | data[3];
+        if (manifest.chunk_size < OTA_MIN_CHUNK_SIZE || manifest.chunk_size > OTA_MAX_CHUNK_SIZE) return std::nullopt;
+        size_t expected = (static_cast<size_t>(image_size) + manifest.chunk_size - 1) / manifest.chunk_size;
+        if (length - 4 != expected * SHA256_DIGEST_LENGTH) return std::nullopt;
+        manifest.leaves.resize(expected);
+        for (size_t i = 0; i < expected; ++i) {
+            std::memcpy(manifest.leaves[i].data(), data + 4 + i * SHA256_DIGEST_LENGTH, SHA256_DIGEST_LENGTH);
+        }
+        return manifest;
+    }
+
+    bool operator==(const OtaManifest& other) const {
+        return image_size == other.image_size && chunk_size == other.chunk_size && leaves == other.leaves;
+    }
+};
+
+// Process-wide helpers for verify_ota_chunks(), shared by every ECU in the
+// process so concurrent installs do not each start a full set of threads.
+inline boost::asio::thread_pool& ota_verify_pool() {
+    static boost::asio::thread_pool pool(std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+}
+
+// Hashes the chunks of the file at `path` that are set in `wanted` (every
+// chunk when it is empty). The caller and up to `threads - 1` helpers from
+// ota_verify_pool() claim chunks from a shared counter; helpers that start
+// after the caller has finished do nothing. Returns one flag per chunk: 1 if
+// it matches its leaf. Chunks not wanted come back as 0.
+inline std::vector<uint8_t> verify_ota_chunks(const std::string& path, const OtaManifest& manifest,
+                                              const std::vector<uint8_t>& wanted = {},
+                                              unsigned threads = std::thread::hardware_concurrency()) {
+    std::vector<uint8_t> valid(manifest.chunk_count(), 0);
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return valid;
+
+    std::atomic<size_t> next_chunk{0};
+    auto worker = [&]() {
+        AlignedBuffer buffer = make_aligned_buffer((manifest.chunk_size + SHA256_FILE_BUFFER_ALIGNMENT - 1) /
+                                                   SHA256_FILE_BUFFER_ALIGNMENT * SHA256_FILE_BUFFER_ALIGNMENT);
+        if (!buffer) return;
+        for (size_t chunk; (chunk = next_chunk.fetch_add(1, std::memory_order_relaxed)) < manifest.chunk_count();) {
+            if (!wanted.empty() && !wanted[chunk]) continue;
+            size_t length = manifest.chunk_length(chunk);
+            size_t filled = 0;
+            while (filled < length) {
+                ssize_t n = ::pread(fd, buffer.get() + filled, length - filled, static_cast<off_t>(manifest.chunk_offset(chunk) + filled));
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) break;
+                filled += static_cast<size_t>(n);
+            }
+            valid[chunk] = filled == length && sha256_digest(buffer.get(), length) == manifest.leaves[chunk];
+        }
+    };
+
+    // Outlives this call: a helper may be dequeued after the caller returns.
+    struct Join {
+        std::mutex mutex;
+        std::condition_variable idle;
+        bool closed = false;
+        unsigned active = 0;
+    };
+    auto join = std::make_shared<Join>();
+    size_t helper_count = std::clamp<size_t>(threads, 1, std::max<size_t>(1, manifest.chunk_count())) - 1;
+    for (size_t i = 0; i < helper_count; ++i) {
+        boost::asio::post(ota_verify_pool(), [join, &worker]() {
+            {
+                std::lock_guard<std::mutex> lock(join->mutex);
+                if (join->closed) return;
+                ++join->active;
+            }
+            worker();
+            std::lock_guard<std::mutex> lock(join->mutex);
+            if (--join->active == 0) join->idle.notify_all();
+        });
+    }
+    worker();
+    {
+        std::unique_lock<std::mutex> lock(join->mutex);
+        join->closed = true;
+        join->idle.wait(lock, [&]() { return join->active == 0; });
+    }
+    ::close(fd);
+    return valid;
+}
+
+// Which chunks of a manifest download have been written and verified, kept
+// in a file next to update.bin so a download survives the tester (or the
+// ECU) going away. Layout: magic, version, image_size, chunk_size,
+// chunk_count, root[32], then one byte per chunk (1 = done). A chunk's byte
+// is written after its data, without a sync; after a restart the chunks
+// marked done are hashed again before they are trusted.
+class OtaDownloadProgress {
+public:
+    static constexpr uint32_t MAGIC = 0x41544F56; // "VOTA"
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t HEADER_SIZE = 20 + SHA256_DIGEST_LENGTH;
+
+    ~OtaDownloadProgress() { close(); }
+
+    // Picks up the download recorded at `progress_path` if it is for the same
+    // manifest, keeping only chunks of `image_path` that still verify, or
+    // starts a fresh one. Returns false if the progress file cannot be written.
+    bool open(const std::string& progress_path, const std::string& image_path, const OtaManifest& manifest) {
+        close();
+        m_path = progress_path;
+        m_manifest = manifest;
+        m_root = manifest.root();
+        m_done.assign(manifest.chunk_count(), 0);
+
+        std::vector<uint8_t> marked;
+        if (read_existing(marked)) {
+            bool any = std::any_of(marked.begin(), marked.end(), [](uint8_t done) { return done != 0; });
+            if (any) m_done = verify_ota_chunks(image_path, manifest, marked);
+        }
+
+        m_fd = ::open(progress_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (m_fd < 0) return false;
+        std::vector<uint8_t> contents(HEADER_SIZE);
+        put_u32(&contents[0], MAGIC);
+        put_u32(&contents[4], VERSION);
+        put_u32(&contents[8], manifest.image_size);
+        put_u32(&contents[12], manifest.chunk_size);
+        put_u32(&contents[16], static_cast<uint32_t>(manifest.chunk_count()));
+        std::memcpy(&contents[20], m_root.data(), m_root.size());
+        contents.insert(contents.end(), m_done.begin(), m_done.end());
+        return ::ftruncate(m_fd, 0) == 0 && ::pwrite(m_fd, contents.data(), contents.size(), 0) == static_cast<ssize_t>(contents.size());
+    }
+
+    void mark_done(size_t chunk) {
+        if (chunk >= m_done.size() || m_done[chunk]) return;
+        m_done[chunk] = 1;
+        uint8_t done = 1;
+        if (m_fd >= 0) (void)::pwrite(m_fd, &done, 1, static_cast<off_t>(HEADER_SIZE + chunk));
+    }
+
+    bool is_done(size_t chunk) const { return chunk < m_done.size() && m_done[chunk]; }
+
+    // Index of the first chunk still to be sent; chunk_count() when complete.
+    size_t first_missing() const {
+        return static_cast<size_t>(std::find(m_done.begin(), m_done.end(), 0) - m_done.begin());
+    }
+
+    bool complete() const { return first_missing() == m_done.size(); }
+
+    const OtaManifest& manifest() const { return m_manifest; }
+    const Sha256Digest& root() const { return m_root; }
+
+    void close() {
+        if (m_fd >= 0) ::close(m_fd);
+        m_fd = -1;
+    }
+
+    // Forgets the download once its image has been consumed.
+    void remove() {
+        close();
+        if (!m_path.empty()) std::remove(m_path.c_str());
+        m_done.clear();
+    }
+
+private:
+    bool read_existing(std::vector<uint8_t>& marked) const {
+        int fd = ::open(m_path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        std::vector<uint8_t> contents(HEADER_SIZE + m_done.size());
+        ssize_t n = ::pread(fd, contents.data(), contents.size(), 0);
+        ::close(fd);
+        if (n != static_cast<ssize_t>(contents.size())) return false;
+        if (get_u32(&contents[0]) != MAGIC || get_u32(&contents[4]) != VERSION ||
+            get_u32(&contents[8]) != m_manifest.image_size || get_u32(&contents[12]) != m_manifest.chunk_size ||
+            get_u32(&contents[16]) != m_done.size() || std::memcmp(&contents[20], m_root.data(), m_root.size()) != 0) {
+            return false;
+        }
+        marked.assign(contents.begin() + HEADER_SIZE, contents.end());
+        return true;
+    }
+
+    static void put_u32(uint8_t* out, uint32_t value) {
+        for (int i = 0; i < 4; ++i) out[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+
+    static uint32_t get_u32(const uint8_t* in) {
+        return uint32_t(in[0]) | (uint32_t(in[1]) << 8) | (uint32_t(in[2]) << 16) | (uint32_t(in[3]) << 24);
+    }
+
+    std::string m_path;
+    OtaManifest m_manifest;
+    Sha256Digest m_root{};
+    std::vector<uint8_t> m_done;
+    int m_fd = -1;
+};
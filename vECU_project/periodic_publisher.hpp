@@ -0,0 +1,130 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "did_bindings.hpp"
+
+// --- ReadDataByPeriodicIdentifier transmission modes ---
+const uint8_t PERIODIC_MODE_SLOW = 0x01;
+const uint8_t PERIODIC_MODE_MEDIUM = 0x02;
+const uint8_t PERIODIC_MODE_FAST = 0x03;
+const uint8_t PERIODIC_MODE_STOP = 0x04;
+
+// Control cycles between samples for each rate (10 ms cycles: 1 s, 100 ms, 10 ms).
+inline uint64_t periodic_mode_cycles(uint8_t mode) {
+    switch (mode) {
+        case PERIODIC_MODE_SLOW:   return 100;
+        case PERIODIC_MODE_MEDIUM: return 10;
+        case PERIODIC_MODE_FAST:   return 1;
+        default:                   return 0;
+    }
+}
+
+// Every periodic DID's encoded value as of one control cycle. Values sit in
+// PERIODIC_DIDS order; each one is at most four bytes.
+struct PeriodicSnapshot {
+    uint64_t cycle = 0;
+    std::array<std::array<uint8_t, 4>, PERIODIC_DIDS.size()> values{};
+    std::array<uint8_t, PERIODIC_DIDS.size()> lengths{};
+};
+
+// Receives a call after each published cycle. Called on the control loop
+// thread, so implementations should only hand off to their own executor.
+class PeriodicSubscriber {
+public:
+    virtual ~PeriodicSubscriber() = default;
+    virtual void on_periodic_snapshot(uint64_t cycle) = 0;
+};
+
+// Encodes the periodic DIDs once per control cycle and lets any number of
+// subscribers copy that one snapshot. The snapshot is guarded by a sequence
+// lock, so the control loop never waits on a reader.
+class PeriodicPublisher {
+public:
+    // Called by the control loop after each cycle.
+    void publish(const NVRAMManager& nvram) {
+        uint64_t cycle = m_cycle.load(std::memory_order_relaxed) + 1;
+        if (m_subscriber_count.load(std::memory_order_acquire) == 0) {
+            m_cycle.store(cycle, std::memory_order_relaxed);
+            return;
+        }
+
+        m_sequence.fetch_add(1, std::memory_order_relaxed); // Odd: write in progress
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < PERIODIC_DIDS.size(); ++i) {
+            auto binding = find_did_binding(PERIODIC_DIDS[i].data_id);
+            uint8_t bytes[4] = {};
+            encode_did_value(binding->format, read_did_value(nvram, *binding), bytes);
+            uint32_t word;
+            std::memcpy(&word, bytes, sizeof(word));
+            m_values[i].store(word, std::memory_order_relaxed);
+        }
+        m_cycle.store(cycle, std::memory_order_relaxed);
+        m_sequence.fetch_add(1, std::memory_order_release);
+
+        std::lock_guard<std::mutex> lock(m_subscribers_mutex);
+        for (size_t i = 0; i < m_subscribers.size();) {
+            if (auto subscriber = m_subscribers[i].lock()) {
+                subscriber->on_periodic_snapshot(cycle);
+                ++i;
+            } else {
+                m_subscribers[i] = std::move(m_subscribers.back());
+                m_subscribers.pop_back();
+                m_subscriber_count.fetch_sub(1, std::memory_order_release);
+            }
+        }
+    }
+
+    // Copies the most recent snapshot. Safe from any thread.
+    void read(PeriodicSnapshot& out) const {
+        uint32_t words[PERIODIC_DIDS.size()];
+        uint64_t before, after;
+        do {
+            before = m_sequence.load(std::memory_order_acquire);
+            for (size_t i = 0; i < PERIODIC_DIDS.size(); ++i) {
+                words[i] = m_values[i].load(std::memory_order_relaxed);
+            }
+            out.cycle = m_cycle.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = m_sequence.load(std::memory_order_relaxed);
+        } while ((before & 1) != 0 || before != after);
+
+        for (size_t i = 0; i < PERIODIC_DIDS.size(); ++i) {
+            std::memcpy(out.values[i].data(), &words[i], sizeof(words[i]));
+            out.lengths[i] = static_cast<uint8_t>(did_data_length(find_did_binding(PERIODIC_DIDS[i].data_id)->format.encoding));
+        }
+    }
+
+    void subscribe(const std::shared_ptr<PeriodicSubscriber>& subscriber) {
+        std::lock_guard<std::mutex> lock(m_subscribers_mutex);
+        m_subscribers.push_back(subscriber);
+        m_subscriber_count.fetch_add(1, std::memory_order_release);
+    }
+
+    void unsubscribe(const PeriodicSubscriber* subscriber) {
+        std::lock_guard<std::mutex> lock(m_subscribers_mutex);
+        for (size_t i = 0; i < m_subscribers.size(); ++i) {
+            auto current = m_subscribers[i].lock();
+            if (!current || current.get() == subscriber) {
+                m_subscribers[i] = std::move(m_subscribers.back());
+                m_subscribers.pop_back();
+                m_subscriber_count.fetch_sub(1, std::memory_order_release);
+                --i;
+            }
+        }
+    }
+
+private:
+    std::atomic<uint64_t> m_sequence{0};
+    std::atomic<uint64_t> m_cycle{0};
+    std::array<std::atomic<uint32_t>, PERIODIC_DIDS.size()> m_values{};
+    std::atomic<size_t> m_subscriber_count{0};
+    std::mutex m_subscribers_mutex;
+    std::vector<std::weak_ptr<PeriodicSubscriber>> m_subscribers;
+};
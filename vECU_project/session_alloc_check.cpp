@@ -0,0 +1,107 @@
+// session_alloc_check: asserts that the DoIP session's steady-state
+// request/response path makes no heap allocations. Every global operator new
+// is counted (alloc_counter.hpp); after a warm-up that sizes the session's
+// buffers and handler slots, a run of vehicle identification,
+// ReadDataByIdentifier, WriteDataByIdentifier and rejected requests over
+// loopback must leave the count unchanged. Exits non-zero otherwise.
+#include <iostream>
+#include <array>
+#include <vector>
+#include <thread>
+#include <cstdlib>
+#include <filesystem>
+#include <unistd.h>
+#include <boost/asio.hpp>
+
+#include "alloc_counter.hpp"
+#include "doip_server.hpp"
+
+using boost::asio::ip::tcp;
+
+// --- Globals the platform headers expect from main.cpp ---
+EcuLogger g_logger;
+EcuMetrics g_metrics;
+
+// The ECU behind the server. It is never stepped.
+AccImageCache g_acc_images(nullptr);
+EcuInstance g_ecu(0, "", g_acc_images);
+
+const int WARMUP_ROUNDS = 1000;
+const int CHECKED_ROUNDS = 10000;
+
+// One request as a fixed two-buffer sequence, so the tester side of the
+// loopback does not allocate either.
+struct CheckRequest {
+    const char* name;
+    DoIPHeader header;
+    std::vector<uint8_t> payload;
+    uint16_t expected_type;
+};
+
+CheckRequest make_check_request(const char* name, uint16_t type, std::vector<uint8_t> payload, uint16_t expected_type) {
+    return {name, make_doip_header(type, static_cast<uint32_t>(payload.size())), std::move(payload), expected_type};
+}
+
+int main() {
+    // The ECU's NVRAM image goes to a scratch directory.
+    char scratch[] = "/tmp/vecu_alloc_check.XXXXXX";
+    if (!::mkdtemp(scratch) || ::chdir(scratch) != 0) {
+        std::cerr << "[ALLOC] Could not create a scratch directory." << std::endl;
+        return 1;
+    }
+    g_ecu.nvram().load();
+
+    boost::asio::io_context server_context;
+    DoIPServer server(server_context);
+    server.listen(g_ecu, 0);
+    std::thread server_thread([&]() { server.run(); });
+
+    boost::asio::io_context client_context;
+    tcp::socket socket(client_context);
+    socket.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), server.port()));
+    socket.set_option(tcp::no_delay(true));
+
+    const std::vector<CheckRequest> requests = {
+        make_check_request("identify", 0x0004, {}, 0x0005),
+        make_check_request("read_did", 0x8001, {UDS_READ_DATA_BY_IDENTIFIER, DID_OWN_VEHICLE_SPEED >> 8, DID_OWN_VEHICLE_SPEED & 0xFF}, 0x8001),
+        make_check_request("read_dids", 0x8001, {UDS_READ_DATA_BY_IDENTIFIER, DID_LEAD_VEHICLE_SPEED >> 8, DID_LEAD_VEHICLE_SPEED & 0xFF,
+                                                 DID_ACC_GAP_SETTING >> 8, DID_ACC_GAP_SETTING & 0xFF, DID_ACC_KP >> 8, DID_ACC_KP & 0xFF}, 0x8001),
+        make_check_request("write_did", 0x8001, {UDS_WRITE_DATA_BY_IDENTIFIER, DID_ACC_GAP_SETTING >> 8, DID_ACC_GAP_SETTING & 0xFF, 0x00, 0x03}, 0x8001),
+        make_check_request("unknown_did", 0x8001, {UDS_READ_DATA_BY_IDENTIFIER, 0x12, 0x34}, 0x8002),
+    };
+
+    DoIPHeader response_header;
+    std::array<uint8_t, 256> response_payload;
+    bool ok = true;
+    auto round_trip = [&](const CheckRequest& request) {
+        const std::array<boost::asio::const_buffer, 2> buffers = {
+            boost::asio::buffer(&request.header, sizeof(request.header)), boost::asio::buffer(request.payload)};
+        boost::asio::write(socket, buffers);
+        boost::asio::read(socket, boost::asio::buffer(&response_header, sizeof(response_header)));
+        size_t length = ntohl(response_header.payload_length);
+        if (length > response_payload.size() || ntohs(response_header.payload_type) != request.expected_type) ok = false;
+        boost::asio::read(socket, boost::asio::buffer(response_payload, std::min(length, response_payload.size())));
+    };
+
+    for (int i = 0; i < WARMUP_ROUNDS; ++i) {
+        for (const CheckRequest& request : requests) round_trip(request);
+    }
+    bool allocation_free = true;
+    for (const CheckRequest& request : requests) {
+        uint64_t before = g_allocations.load(std::memory_order_relaxed);
+        for (int i = 0; i < CHECKED_ROUNDS; ++i) round_trip(request);
+        uint64_t allocations = g_allocations.load(std::memory_order_relaxed) - before;
+        std::cout << "[ALLOC] " << request.name << ": " << allocations << " allocation(s) in " << CHECKED_ROUNDS << " round trips" << std::endl;
+        allocation_free = allocation_free && allocations == 0;
+    }
+
+    socket.close();
+    server.stop();
+    server_thread.join();
+    std::error_code ignored;
+    std::filesystem::remove_all(scratch, ignored);
+
+    if (!ok) std::cerr << "[ALLOC] FAIL: unexpected response." << std::endl;
+    if (!allocation_free) std::cerr << "[ALLOC] FAIL: the session allocated after warm-up." << std::endl;
+    return ok && allocation_free ? 0 : 1;
+}
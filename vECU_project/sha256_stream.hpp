@@ -0,0 +1,103 @@
+#pragma once
+
+#include <iostream>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <openssl/evp.h>
+
+// Buffer size and alignment used when hashing whole files. Large reads keep
+// the syscall count down; page alignment lets the kernel copy straight in.
+constexpr size_t SHA256_FILE_BUFFER_SIZE = 1024 * 1024;
+constexpr size_t SHA256_FILE_BUFFER_ALIGNMENT = 4096;
+
+struct AlignedBufferDeleter {
+    void operator()(uint8_t* buffer) const { std::free(buffer); }
+};
+using AlignedBuffer = std::unique_ptr<uint8_t[], AlignedBufferDeleter>;
+
+inline AlignedBuffer make_aligned_buffer(size_t size, size_t alignment = SHA256_FILE_BUFFER_ALIGNMENT) {
+    return AlignedBuffer(static_cast<uint8_t*>(std::aligned_alloc(alignment, size)));
+}
+
+// Incremental SHA-256 over data fed in as it arrives, so a transfer can be
+// verified without reading the result back from disk.
+class Sha256Stream {
+public:
+    Sha256Stream() : m_context(EVP_MD_CTX_new()) {
+        reset();
+    }
+
+    ~Sha256Stream() {
+        EVP_MD_CTX_free(m_context);
+    }
+
+    Sha256Stream(const Sha256Stream&) = delete;
+    Sha256Stream& operator=(const Sha256Stream&) = delete;
+
+    // Starts a new digest, discarding anything fed in so far.
+    void reset() {
+        m_ok = m_context && EVP_DigestInit_ex(m_context, EVP_sha256(), nullptr) == 1;
+    }
+
+    void update(const void* data, size_t length) {
+        if (m_ok && length > 0) {
+            m_ok = EVP_DigestUpdate(m_context, data, length) == 1;
+        }
+    }
+
+    // Returns the lowercase hex digest, or nullopt if any step failed. The
+    // stream must be reset() before it is fed again.
+    std::optional<std::string> finish_hex() {
+        unsigned char hash[EVP_MAX_MD_SIZE];
+        unsigned int hash_len = 0;
+        if (!m_ok || EVP_DigestFinal_ex(m_context, hash, &hash_len) != 1) {
+            m_ok = false;
+            return std::nullopt;
+        }
+        m_ok = false;
+        static const char digits[] = "0123456789abcdef";
+        std::string hex(hash_len * 2, '0');
+        for (unsigned int i = 0; i < hash_len; ++i) {
+            hex[2 * i] = digits[hash[i] >> 4];
+            hex[2 * i + 1] = digits[hash[i] & 0x0F];
+        }
+        return hex;
+    }
+
+private:
+    EVP_MD_CTX* m_context;
+    bool m_ok = false;
+};
+
+// Hashes a whole file with large aligned reads.
+inline std::optional<std::string> sha256_file_hex(const std::string& file_path) {
+    int fd = ::open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "[HASH] ERROR: Could not open file: " << file_path << std::endl;
+        return std::nullopt;
+    }
+#if defined(POSIX_FADV_SEQUENTIAL)
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    AlignedBuffer buffer = make_aligned_buffer(SHA256_FILE_BUFFER_SIZE);
+    Sha256Stream digest;
+    ssize_t n = 0;
+    while (buffer && (n = ::read(fd, buffer.get(), SHA256_FILE_BUFFER_SIZE)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        digest.update(buffer.get(), static_cast<size_t>(n));
+    }
+    ::close(fd);
+    if (!buffer || n < 0) return std::nullopt;
+    return digest.finish_hex();
+}
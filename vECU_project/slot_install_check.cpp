@@ -0,0 +1,97 @@
+// slot_install_check: asserts that a rejected update never touches the
+// inactive ACC slot, which holds the image a restart falls back to. Installs
+// an update with the wrong hash and one that is not a loadable library, and
+// checks that the slot file stays byte-identical and no staging file is left
+// behind; then checks that a good update does replace the slot.
+//
+// Usage: slot_install_check <libacc_app.so>
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <filesystem>
+#include <unistd.h>
+
+#include "ecu_instance.hpp"
+
+// --- Globals the platform headers expect from main.cpp ---
+EcuLogger g_logger;
+EcuMetrics g_metrics;
+
+static std::vector<char> read_file(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static bool write_file(const std::string& path, const std::vector<char>& contents) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+    return static_cast<bool>(file);
+}
+
+static std::string sha256_of(const std::vector<char>& contents) {
+    return sha256_digest_hex(sha256_digest(reinterpret_cast<const uint8_t*>(contents.data()), contents.size()));
+}
+
+int main(int argc, char* argv[]) {
+    if (argc == 5 && std::strcmp(argv[1], ACC_PROBE_OPTION) == 0) {
+        // Child started by probe_acc_library() to vet an update.
+        return run_acc_probe(argv[2], argv[3], std::strcmp(argv[4], "1") == 0);
+    }
+    if (argc != 2) {
+        std::cerr << "Usage: slot_install_check <libacc_app.so>" << std::endl;
+        return 1;
+    }
+    std::vector<char> library = read_file(argv[1]);
+    if (library.empty()) {
+        std::cerr << "[SLOT] Cannot read " << argv[1] << std::endl;
+        return 1;
+    }
+
+    char scratch[] = "/tmp/vecu_slot_check.XXXXXX";
+    if (!::mkdtemp(scratch) || ::chdir(scratch) != 0 || !write_file(ACC_LIBRARY_NAME, library)) {
+        std::cerr << "[SLOT] Could not create a scratch directory." << std::endl;
+        return 1;
+    }
+
+    bool passed = true;
+    {
+        AccImageCache images(nullptr);
+        EcuInstance ecu(0, "ecu0", images);
+        ecu.nvram().load();
+        const std::string slot_b = "ecu0/" + ACC_LIBRARY_NAME_B; // Inactive while slot A is active
+        const std::vector<char> known_good = {'k', 'n', 'o', 'w', 'n', '-', 'g', 'o', 'o', 'd'};
+        write_file(slot_b, known_good);
+
+        std::vector<char> not_a_library(4096, 'x');
+        struct Case {
+            const char* name;
+            std::vector<char> update;
+            std::string hash;
+            bool accepted;
+        };
+        const Case cases[] = {
+            {"wrong_hash", library, std::string(64, '0'), false},
+            {"not_a_library", not_a_library, sha256_of(not_a_library), false},
+            {"good_update", library, sha256_of(library), true},
+        };
+        for (const Case& c : cases) {
+            write_file(ecu.update_path(), c.update);
+            bool accepted = ecu.apply_update(c.hash);
+            std::vector<char> slot = read_file(slot_b);
+            bool slot_ok = c.accepted ? slot == library : slot == known_good;
+            bool clean = ::access((slot_b + ".incoming").c_str(), F_OK) != 0;
+            bool ok = accepted == c.accepted && slot_ok && clean;
+            std::cout << "[SLOT] " << c.name << ": " << (accepted ? "accepted" : "rejected")
+                      << (slot_ok ? ", slot as expected" : ", slot CHANGED") << (clean ? "" : ", staging file LEFT") << std::endl;
+            passed = passed && ok;
+        }
+    }
+
+    std::error_code ignored;
+    std::filesystem::remove_all(scratch, ignored);
+    if (!passed) std::cerr << "[SLOT] FAIL: an update did not leave the slots as expected." << std::endl;
+    return passed ? 0 : 1;
+}
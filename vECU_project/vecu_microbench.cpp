@@ -0,0 +1,391 @@
+// vecu_microbench: timings for the ECU's hot paths (NVRAM access and
+// persistence, OTA image hashing and chunk manifest verification, one ACC control cycle, DoIP header
+// handling, ReadDataByIdentifier/WriteDataByIdentifier dispatch, and a full
+// DoIP round trip through the real server). Each benchmark also counts heap
+// allocations; the round trip must stay allocation-free after warm-up, and
+// the run fails if it does not.
+//
+// Results can be written as JSON and compared against an earlier run with
+// --compare, so a change's effect can be shown commit to commit.
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <map>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <cstring>
+#include <new>
+#include <cstdarg>
+#include <unistd.h>
+#include <boost/asio.hpp>
+
+#include "alloc_counter.hpp" // Counts every allocation in g_allocations
+#include "doip_server.hpp"
+#include "sha256_stream.hpp"
+#include "Adaptive_Cruise_Control/acc_controller.hpp"
+
+// --- Globals the platform headers expect from main.cpp ---
+EcuLogger g_logger;
+EcuMetrics g_metrics;
+
+// The ECU behind the benchmarked server. It is never stepped; the benchmarks
+// drive its parameter store directly.
+AccImageCache g_acc_images(nullptr);
+EcuInstance g_ecu(0, "", g_acc_images);
+NVRAMManager& g_nvram = g_ecu.nvram();
+
+// --- Harness ---
+using MicroClock = std::chrono::steady_clock;
+
+struct MicrobenchOptions {
+    std::string filter;
+    std::string json_path;    // "-" = stdout
+    std::string compare_path; // Earlier --json output to diff against
+    double min_time_ms = 200; // Measured time per benchmark, split across repetitions
+    unsigned repetitions = 5;
+};
+
+struct MicrobenchResult {
+    std::string name;
+    uint64_t iterations = 0;   // Per repetition
+    double ns_per_op = 0;      // Median over repetitions
+    double min_ns_per_op = 0;
+    double allocs_per_op = 0;  // Over every measured iteration
+};
+
+// Keeps the optimizer from discarding a benchmark's result.
+template <typename T>
+inline void do_not_optimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+class Microbench {
+public:
+    explicit Microbench(const MicrobenchOptions& options) : m_options(options) {}
+
+    // Runs `fn` in batches sized so each repetition takes about
+    // min_time_ms / repetitions, and records ns/op and allocations/op.
+    template <typename Fn>
+    void run(const std::string& name, Fn&& fn) {
+        if (!m_options.filter.empty() && name.find(m_options.filter) == std::string::npos) return;
+        for (int i = 0; i < 3; ++i) fn(); // Warm caches and lazily sized buffers
+
+        const double target_ns = m_options.min_time_ms * 1e6 / m_options.repetitions;
+        uint64_t iterations = 1;
+        while (true) {
+            double elapsed = time_batch(fn, iterations);
+            if (elapsed >= target_ns || iterations >= (uint64_t(1) << 30)) break;
+            double scale = elapsed > 0 ? target_ns / elapsed : 100.0;
+            iterations = std::max<uint64_t>(iterations + 1, static_cast<uint64_t>(iterations * std::min(scale * 1.1, 100.0)));
+        }
+
+        std::vector<double> per_op;
+        per_op.reserve(m_options.repetitions); // Keep the harness out of the allocation count
+        uint64_t allocations_before = g_allocations.load(std::memory_order_relaxed);
+        for (unsigned r = 0; r < m_options.repetitions; ++r) {
+            per_op.push_back(time_batch(fn, iterations) / iterations);
+        }
+        uint64_t allocations = g_allocations.load(std::memory_order_relaxed) - allocations_before;
+        std::sort(per_op.begin(), per_op.end());
+
+        MicrobenchResult result;
+        result.name = name;
+        result.iterations = iterations;
+        result.ns_per_op = per_op[per_op.size() / 2];
+        result.min_ns_per_op = per_op.front();
+        result.allocs_per_op = static_cast<double>(allocations) / (iterations * m_options.repetitions);
+        std::cerr << "[MICROBENCH] " << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(14) << result.ns_per_op << " ns/op" << std::setw(12) << result.min_ns_per_op << " min"
+                  << std::setprecision(2) << std::setw(10) << result.allocs_per_op << " allocs/op"
+                  << std::defaultfloat << std::setprecision(6) << std::endl;
+        m_results.push_back(result);
+    }
+
+    const std::vector<MicrobenchResult>& results() const { return m_results; }
+
+private:
+    template <typename Fn>
+    static double time_batch(Fn& fn, uint64_t iterations) {
+        auto start = MicroClock::now();
+        for (uint64_t i = 0; i < iterations; ++i) fn();
+        return std::chrono::duration<double, std::nano>(MicroClock::now() - start).count();
+    }
+
+    MicrobenchOptions m_options;
+    std::vector<MicrobenchResult> m_results;
+};
+
+// Routes the ACC library's messages through g_logger, as the platform does.
+static void bench_acc_log(int level, const char* tag, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    g_logger.vlog(static_cast<LogLevel>(level), tag, format, args);
+    va_end(args);
+}
+
+// --- Benchmarks ---
+void bench_nvram(Microbench& bench) {
+    NVRAMManager nvram("bench_nvram.img");
+    nvram.load();
+    float value = 40.0f;
+    auto next_value = [&]() { return value = value == 40.0f ? 41.0f : 40.0f; }; // save() skips clean stores
+    bench.run("nvram/get_float", [&]() { do_not_optimize(nvram.get_float(NvramParam::ACC_KP)); });
+    bench.run("nvram/get_string", [&]() { do_not_optimize(nvram.get_string("ACC_KP")); });
+    bench.run("nvram/set_string", [&]() { nvram.set_string("ACC_KP", "0.45"); });
+    bench.run("nvram/save", [&]() {
+        nvram.set_float(NvramParam::LEAD_VEHICLE_SPEED, next_value());
+        nvram.save();
+    });
+    bench.run("nvram/load", [&]() { nvram.load(); });
+
+    NVRAMManager journaled("bench_journal.img");
+    journaled.enable_journal(NvramJournalConfig{});
+    journaled.load();
+    bench.run("nvram/save_journal", [&]() {
+        journaled.set_float(NvramParam::LEAD_VEHICLE_SPEED, next_value());
+        journaled.save();
+    });
+}
+
+// calculate_file_hash() in main.cpp is a thin wrapper over sha256_file_hex().
+void bench_file_hash(Microbench& bench) {
+    const std::pair<const char*, size_t> sizes[] = {{"4KiB", 4 << 10}, {"1MiB", 1 << 20}, {"16MiB", 16 << 20}};
+    for (const auto& [label, size] : sizes) {
+        std::string path = std::string("bench_hash_") + label + ".bin";
+        {
+            std::vector<char> data(size);
+            for (size_t i = 0; i < size; ++i) data[i] = static_cast<char>(i * 2654435761u >> 24);
+            std::ofstream(path, std::ios::binary).write(data.data(), data.size());
+        }
+        bench.run(std::string("sha256/file_") + label, [&]() { do_not_optimize(sha256_file_hex(path)); });
+    }
+
+    // Final check of a manifest download: the same 16 MiB, chunk by chunk, single-threaded and on every core.
+    std::vector<uint8_t> image(16 << 20);
+    std::ifstream("bench_hash_16MiB.bin", std::ios::binary).read(reinterpret_cast<char*>(image.data()), image.size());
+    OtaManifest manifest = OtaManifest::build(image.data(), static_cast<uint32_t>(image.size()), OTA_DEFAULT_CHUNK_SIZE);
+    bench.run("manifest/verify_16MiB_1thread", [&]() { do_not_optimize(verify_ota_chunks("bench_hash_16MiB.bin", manifest, {}, 1)); });
+    bench.run("manifest/verify_16MiB", [&]() { do_not_optimize(verify_ota_chunks("bench_hash_16MiB.bin", manifest)); });
+}
+
+// The entry point the platform calls for each hosted ECU.
+void bench_acc_cycle(Microbench& bench) {
+    AccInstanceState state{};
+    acc_attach_logger(bench_acc_log); // The per-cycle trace is below g_logger's level
+    bench.run("acc/run_cycle", [&]() {
+        g_nvram.set_float(NvramParam::OWN_VEHICLE_SPEED, 60.0f); // Keep the controller away from its limits
+        run_acc_instance(&g_nvram, &state);
+    });
+}
+
+void bench_doip_header(Microbench& bench) {
+    uint8_t wire[sizeof(DoIPHeader)];
+    uint32_t length = 0;
+    bench.run("doip/header_serialize", [&]() {
+        DoIPHeader header = make_doip_header(0x8001, ++length);
+        std::memcpy(wire, &header, sizeof(header));
+        do_not_optimize(wire);
+    });
+    bench.run("doip/header_parse", [&]() {
+        DoIPHeader header;
+        std::memcpy(&header, wire, sizeof(header));
+        uint16_t type = ntohs(header.payload_type);
+        uint32_t payload_length = ntohl(header.payload_length);
+        do_not_optimize(type);
+        do_not_optimize(payload_length);
+    });
+}
+
+// Recording has to stay cheap enough to leave on in production.
+void bench_metrics(Microbench& bench) {
+    uint64_t duration = 0;
+    bench.run("metrics/counter_add", []() { g_metrics.uds_requests.add(UDS_READ_DATA_BY_IDENTIFIER); });
+    bench.run("metrics/histogram_record", [&]() { g_metrics.request_duration.record(0, duration += 997); });
+    bench.run("metrics/prometheus_text", []() { do_not_optimize(metrics_prometheus_text(g_metrics)); });
+}
+
+void bench_uds_dispatch(Microbench& bench) {
+    std::vector<uint8_t> response;
+    response.reserve(256);
+    std::vector<uint8_t> read_one = {UDS_READ_DATA_BY_IDENTIFIER, DID_OWN_VEHICLE_SPEED >> 8, DID_OWN_VEHICLE_SPEED & 0xFF};
+    std::vector<uint8_t> read_all = {UDS_READ_DATA_BY_IDENTIFIER};
+    for (uint16_t did : {DID_LEAD_VEHICLE_SPEED, DID_OWN_VEHICLE_SPEED, DID_ACC_GAP_SETTING, DID_ACC_KP,
+                         DID_ACC_KI, DID_ACC_MAX_ACCEL, DID_ACC_MAX_DECEL}) {
+        read_all.push_back(static_cast<uint8_t>(did >> 8));
+        read_all.push_back(static_cast<uint8_t>(did));
+    }
+    std::vector<uint8_t> write_kp = {UDS_WRITE_DATA_BY_IDENTIFIER, DID_ACC_KP >> 8, DID_ACC_KP & 0xFF, 0, 0, 0, 0};
+    encode_did_value({DidEncoding::FLOAT32, 1.0f}, 0.4f, &write_kp[3]);
+
+    bench.run("uds/read_1_did", [&]() { do_not_optimize(read_data_by_identifier(g_nvram, read_one, response)); });
+    bench.run("uds/read_7_dids", [&]() { do_not_optimize(read_data_by_identifier(g_nvram, read_all, response)); });
+    bench.run("uds/write_did", [&]() { do_not_optimize(write_data_by_identifier(g_nvram, write_kp, response)); });
+}
+
+// One ReadDataByIdentifier round trip over loopback through DoIPServer.
+// The client side uses fixed buffers, so every allocation counted here
+// comes from the ECU's request path.
+bool bench_session_roundtrip(Microbench& bench) {
+    boost::asio::io_context server_context;
+    DoIPServer server(server_context);
+    server.listen(g_ecu, 0);
+    std::thread server_thread([&]() { server.run(); });
+
+    boost::asio::io_context client_context;
+    tcp::socket socket(client_context);
+    socket.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), server.port()));
+    socket.set_option(tcp::no_delay(true));
+
+    const uint8_t request_payload[] = {UDS_READ_DATA_BY_IDENTIFIER, DID_OWN_VEHICLE_SPEED >> 8, DID_OWN_VEHICLE_SPEED & 0xFF};
+    const DoIPHeader request_header = make_doip_header(0x8001, sizeof(request_payload));
+    const std::array<boost::asio::const_buffer, 2> request = {
+        boost::asio::buffer(&request_header, sizeof(request_header)), boost::asio::buffer(request_payload)};
+    DoIPHeader response_header;
+    std::array<uint8_t, 64> response_payload;
+    bool ok = true;
+    auto round_trip = [&]() {
+        boost::asio::write(socket, request);
+        boost::asio::read(socket, boost::asio::buffer(&response_header, sizeof(response_header)));
+        size_t length = ntohl(response_header.payload_length);
+        if (length > response_payload.size()) ok = false;
+        boost::asio::read(socket, boost::asio::buffer(response_payload, std::min(length, response_payload.size())));
+    };
+    for (int i = 0; i < 1000; ++i) round_trip(); // Warm the session's buffers and handler slots
+
+    size_t before = bench.results().size();
+    bench.run("session/read_roundtrip", round_trip);
+    bool allocation_free = true;
+    if (bench.results().size() > before && bench.results().back().allocs_per_op > 0) {
+        std::cerr << "[MICROBENCH] FAIL: session/read_roundtrip allocated " << bench.results().back().allocs_per_op
+                  << " times per request after warm-up." << std::endl;
+        allocation_free = false;
+    }
+
+    socket.close();
+    server.stop();
+    server_thread.join();
+    return ok && allocation_free;
+}
+
+// --- Reporting ---
+void write_json(std::ostream& out, const std::vector<MicrobenchResult>& results) {
+    out << std::defaultfloat << std::setprecision(9) << "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const MicrobenchResult& r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"iterations\": " << r.iterations << ", \"ns_per_op\": " << r.ns_per_op
+            << ", \"min_ns_per_op\": " << r.min_ns_per_op << ", \"allocs_per_op\": " << r.allocs_per_op << "}"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}" << std::endl;
+}
+
+// Reads the name -> ns_per_op pairs back out of a file written by write_json().
+std::map<std::string, double> read_baseline(const std::string& path) {
+    std::map<std::string, double> baseline;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t name_at = line.find("\"name\": \"");
+        size_t ns_at = line.find("\"ns_per_op\": ");
+        if (name_at == std::string::npos || ns_at == std::string::npos) continue;
+        name_at += 9;
+        std::string name = line.substr(name_at, line.find('"', name_at) - name_at);
+        baseline[name] = std::strtod(line.c_str() + ns_at + 13, nullptr);
+    }
+    return baseline;
+}
+
+void print_comparison(const std::vector<MicrobenchResult>& results, const std::map<std::string, double>& baseline) {
+    std::cerr << "[MICROBENCH] Compared with baseline (negative = faster):" << std::endl;
+    for (const MicrobenchResult& r : results) {
+        auto it = baseline.find(r.name);
+        if (it == baseline.end() || it->second <= 0) continue;
+        double change = (r.ns_per_op - it->second) / it->second * 100.0;
+        std::cerr << "[MICROBENCH] " << std::left << std::setw(28) << r.name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(14) << it->second << " -> " << std::setw(12) << r.ns_per_op << " ns/op  "
+                  << std::showpos << change << "%" << std::noshowpos << std::defaultfloat << std::setprecision(6) << std::endl;
+    }
+}
+
+bool parse_command_line(int argc, char* argv[], MicrobenchOptions& options) {
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string option = argv[i];
+            if (i + 1 >= argc) option.clear();
+            if (option == "--filter") options.filter = argv[++i];
+            else if (option == "--json") options.json_path = argv[++i];
+            else if (option == "--compare") options.compare_path = argv[++i];
+            else if (option == "--min-time-ms") options.min_time_ms = std::max(1.0, std::stod(argv[++i]));
+            else if (option == "--repetitions") options.repetitions = std::max(1, std::stoi(argv[++i]));
+            else {
+                std::cerr << "Usage: vecu_microbench [--filter <substring>] [--json <file|->] [--compare <baseline.json>]"
+                          << " [--min-time-ms <ms>] [--repetitions <n>]" << std::endl;
+                return false;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "[MICROBENCH] Invalid argument: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    MicrobenchOptions options;
+    if (!parse_command_line(argc, argv, options)) return 1;
+    std::map<std::string, double> baseline;
+    if (!options.compare_path.empty()) baseline = read_baseline(options.compare_path);
+    std::string json_path = options.json_path;
+    if (!json_path.empty() && json_path != "-" && json_path[0] != '/') {
+        char cwd[4096];
+        if (::getcwd(cwd, sizeof(cwd))) json_path = std::string(cwd) + "/" + json_path;
+    }
+
+    // NVRAM images and hash inputs go to a scratch directory.
+    char scratch[] = "/tmp/vecu_microbench.XXXXXX";
+    if (!::mkdtemp(scratch) || ::chdir(scratch) != 0) {
+        std::cerr << "[MICROBENCH] Could not create a scratch directory." << std::endl;
+        return 1;
+    }
+    // Only warnings and errors, so log output neither mixes with the results
+    // nor costs more than the level check on the measured paths.
+    g_logger.set_level(LogLevel::WARN);
+    g_nvram.enable_journal(NvramJournalConfig{}); // As configured by the ECU's boot sequence
+    g_nvram.load();
+
+    Microbench bench(options);
+    bench_nvram(bench);
+    bench_file_hash(bench);
+    bench_acc_cycle(bench);
+    bench_doip_header(bench);
+    bench_metrics(bench);
+    bench_uds_dispatch(bench);
+    bool passed = true;
+    if (options.filter.empty() || std::string("session/read_roundtrip").find(options.filter) != std::string::npos) {
+        passed = bench_session_roundtrip(bench);
+    }
+
+    std::error_code ignored;
+    std::filesystem::remove_all(scratch, ignored);
+
+    if (!baseline.empty()) print_comparison(bench.results(), baseline);
+    if (json_path == "-") {
+        write_json(std::cout, bench.results());
+    } else if (!json_path.empty()) {
+        std::ofstream json(json_path);
+        write_json(json, bench.results());
+        if (!json) {
+            std::cerr << "[MICROBENCH] Could not write " << json_path << std::endl;
+            return 1;
+        }
+    }
+    return passed ? 0 : 2;
+}
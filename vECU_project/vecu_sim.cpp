@@ -0,0 +1,380 @@
+// vecu_sim: headless closed-loop simulation of the ACC controller against a
+// longitudinal vehicle model (vehicle_sim.hpp). Time is virtual: every step
+// is one control cycle, with no sleeps, no platform and no NVRAM, so hours of
+// driving take seconds. Each combination of the given lead profiles, gap
+// settings and gains is one scenario, and the controller steps all of them at
+// once through run_acc_batch(). Scenarios with the same profile see exactly
+// the same lead vehicle, so tunings can be compared like for like, and a run
+// is bit-for-bit repeatable: the digest printed at the end only changes when
+// the controller's behaviour does. Per-scenario results are printed as text
+// and, optionally, JSON; a compact binary trace can be recorded and dumped
+// as CSV.
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+
+#include "vehicle_sim.hpp"
+#include "Adaptive_Cruise_Control/acc_controller.hpp"
+
+using SimClock = std::chrono::steady_clock;
+
+struct SimOptions {
+    double hours = 1;
+    double cycle_ms = 10; // TargetECU's default cycle
+    uint64_t seed = 1;
+    std::vector<LeadProfile> profiles = {LeadProfile::HIGHWAY};
+    std::vector<int> gaps = {3};
+    // Defaults as in NVRAM_PARAMS (nvram_manager.hpp).
+    std::vector<float> kps = {0.4f};
+    std::vector<float> kis = {0.1f};
+    float max_accel = 2.0f;
+    float max_decel = 3.0f;
+    float set_speed_mph = 70;
+    float lag_s = PlantParams{}.actuator_tau;
+    std::string trace_path;
+    uint32_t trace_every = 10; // Cycles per trace sample
+    std::string json_path;     // "-" = stdout
+    std::string dump_path;
+};
+
+struct ScenarioMetrics {
+    float min_gap = std::numeric_limits<float>::infinity();      // m
+    float min_time_gap = std::numeric_limits<float>::infinity(); // s, above walking pace only
+    double gap_error_sq = 0;                                     // Summed while a lead is in range
+    uint64_t gap_samples = 0;
+    float max_brake = 0; // m/s^2
+    uint32_t collisions = 0;
+    double distance = 0; // m
+
+    double rms_gap_error() const { return gap_samples ? std::sqrt(gap_error_sq / gap_samples) : 0.0; }
+};
+
+// Every scenario's state, laid out as arrays so one run_acc_batch() call
+// steps the controller for all of them.
+struct SimFleet {
+    std::vector<SimTraceScenario> scenarios;
+    std::vector<LeadVehicle> leads;
+    std::vector<float> reference;  // Controller input (LEAD_VEHICLE_SPEED), mph
+    std::vector<float> command;    // Controller own speed in, commanded speed out, mph
+    std::vector<float> kp, ki, integral_error, max_accel, max_decel;
+    std::vector<float> speed, accel, gap; // Follower, SI units
+    std::vector<ScenarioMetrics> metrics;
+
+    AccBatch batch() {
+        return {scenarios.size(), reference.data(), command.data(), kp.data(), ki.data(), integral_error.data(),
+                max_accel.data(), max_decel.data()};
+    }
+};
+
+// Walking pace; below it the time gap is meaningless.
+const float SIM_MIN_TIME_GAP_SPEED = 2.0f;
+
+void print_usage() {
+    std::cerr << "Usage: vecu_sim [options]" << std::endl;
+    std::cerr << "  --hours <h>                 Simulated driving time (default 1)" << std::endl;
+    std::cerr << "  --cycle-ms <ms>             Control cycle (default 10, as TargetECU)" << std::endl;
+    std::cerr << "  --profile <name>[,...]      Lead vehicle: steady, highway, stop-and-go, hard-brake (default highway)" << std::endl;
+    std::cerr << "  --gap <n>[,...]             ACC_GAP_SETTING 1-4, a 1.0-2.5 s time gap (default 3)" << std::endl;
+    std::cerr << "  --kp <gain>[,...]           Proportional gains to try (default 0.4)" << std::endl;
+    std::cerr << "  --ki <gain>[,...]           Integral gains to try (default 0.1)" << std::endl;
+    std::cerr << "  --max-accel <mph>           Largest speed increase per cycle (default 2.0)" << std::endl;
+    std::cerr << "  --max-decel <mph>           Largest speed decrease per cycle (default 3.0)" << std::endl;
+    std::cerr << "  --set-speed <mph>           Driver's set speed (default 70)" << std::endl;
+    std::cerr << "  --lag <s>                   Powertrain/brake response lag; 0 follows every command at once (default 0.3)" << std::endl;
+    std::cerr << "  --seed <n>                  Seed for the lead vehicles' manoeuvres (default 1)" << std::endl;
+    std::cerr << "  --trace <file>              Record a binary trace of every scenario" << std::endl;
+    std::cerr << "  --trace-every <n>           Cycles per trace sample (default 10)" << std::endl;
+    std::cerr << "  --json <file|->             Also write the per-scenario results as JSON" << std::endl;
+    std::cerr << "  --dump <file>               Print a recorded trace as CSV and exit" << std::endl;
+}
+
+template <typename T, typename Parse>
+bool parse_list(const std::string& text, std::vector<T>& values, Parse parse) {
+    values.clear();
+    std::stringstream list(text);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        if (item.empty()) continue;
+        std::optional<T> value = parse(item);
+        if (!value) return false;
+        values.push_back(*value);
+    }
+    return !values.empty();
+}
+
+bool parse_command_line(int argc, char* argv[], SimOptions& options) {
+    auto parse_float = [](const std::string& item) { return std::optional<float>(std::stof(item)); };
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string option = argv[i];
+            if (i + 1 >= argc) { print_usage(); return false; }
+            std::string value = argv[++i];
+            bool valid = true;
+            if (option == "--hours") options.hours = std::stod(value);
+            else if (option == "--cycle-ms") options.cycle_ms = std::stod(value);
+            else if (option == "--seed") options.seed = std::stoull(value);
+            else if (option == "--profile") valid = parse_list(value, options.profiles, lead_profile_from_name);
+            else if (option == "--gap") {
+                valid = parse_list(value, options.gaps, [](const std::string& item) {
+                    int gap = std::stoi(item);
+                    return gap >= 1 && gap <= 4 ? std::optional<int>(gap) : std::nullopt;
+                });
+            }
+            else if (option == "--kp") valid = parse_list(value, options.kps, parse_float);
+            else if (option == "--ki") valid = parse_list(value, options.kis, parse_float);
+            else if (option == "--max-accel") options.max_accel = std::stof(value);
+            else if (option == "--max-decel") options.max_decel = std::stof(value);
+            else if (option == "--set-speed") options.set_speed_mph = std::stof(value);
+            else if (option == "--lag") options.lag_s = std::max(0.0f, std::stof(value));
+            else if (option == "--trace") options.trace_path = value;
+            else if (option == "--trace-every") options.trace_every = static_cast<uint32_t>(std::max(1, std::stoi(value)));
+            else if (option == "--json") options.json_path = value;
+            else if (option == "--dump") options.dump_path = value;
+            else { print_usage(); return false; }
+            if (!valid) {
+                std::cerr << "[SIM] Invalid " << option << ": " << value << std::endl;
+                return false;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "[SIM] Invalid argument: " << e.what() << std::endl;
+        return false;
+    }
+    if (!(options.hours > 0) || !(options.cycle_ms > 0) || !(options.set_speed_mph > 0)) {
+        print_usage();
+        return false;
+    }
+    return true;
+}
+
+// Every profile x gap x Kp x Ki combination, each starting at the desired
+// gap behind its lead and at the lead's speed.
+void build_fleet(const SimOptions& options, const PlantParams& plant, SimFleet& fleet) {
+    for (LeadProfile profile : options.profiles) {
+        for (int gap_setting : options.gaps) {
+            for (float kp : options.kps) {
+                for (float ki : options.kis) {
+                    fleet.scenarios.push_back({kp, ki, options.max_accel, options.max_decel, static_cast<uint8_t>(gap_setting), profile});
+                    // Seeded by profile only, so every tuning faces the same traffic.
+                    fleet.leads.emplace_back(profile, options.seed + static_cast<uint64_t>(profile) * 0x9E3779B97F4A7C15ull);
+                    float speed = fleet.leads.back().speed();
+                    fleet.kp.push_back(kp);
+                    fleet.ki.push_back(ki);
+                    fleet.max_accel.push_back(options.max_accel);
+                    fleet.max_decel.push_back(options.max_decel);
+                    fleet.integral_error.push_back(0.0f);
+                    fleet.speed.push_back(speed);
+                    fleet.accel.push_back(0.0f);
+                    fleet.gap.push_back(sim_desired_gap(plant, gap_setting, speed));
+                }
+            }
+        }
+    }
+    size_t count = fleet.scenarios.size();
+    fleet.reference.assign(count, 0.0f);
+    fleet.command.assign(count, 0.0f);
+    fleet.metrics.assign(count, ScenarioMetrics{});
+}
+
+// One control cycle for every scenario: sense, control, move.
+void step_fleet(SimFleet& fleet, const PlantParams& plant, float dt, std::vector<float>& lead_speed) {
+    const size_t count = fleet.scenarios.size();
+    for (size_t i = 0; i < count; ++i) {
+        fleet.leads[i].step(dt);
+        lead_speed[i] = fleet.leads[i].speed();
+        fleet.reference[i] = sim_reference_speed(plant, fleet.scenarios[i].gap_setting, lead_speed[i], fleet.speed[i], fleet.gap[i]) * SIM_MPH_PER_MPS;
+        fleet.command[i] = fleet.speed[i] * SIM_MPH_PER_MPS;
+    }
+    AccBatch batch = fleet.batch();
+    run_acc_batch(&batch);
+    for (size_t i = 0; i < count; ++i) {
+        float& speed = fleet.speed[i];
+        float& gap = fleet.gap[i];
+        ScenarioMetrics& m = fleet.metrics[i];
+        sim_plant_step(plant, dt, fleet.command[i] * SIM_MPS_PER_MPH, speed, fleet.accel[i]);
+        gap += (lead_speed[i] - speed) * dt;
+        m.distance += speed * dt;
+        if (gap <= 0.0f) {
+            // Counted, then the follower is put back behind the lead so the run can go on.
+            ++m.collisions;
+            speed = lead_speed[i];
+            fleet.accel[i] = 0.0f;
+            gap = sim_desired_gap(plant, fleet.scenarios[i].gap_setting, speed);
+        }
+        m.min_gap = std::min(m.min_gap, gap);
+        if (speed > SIM_MIN_TIME_GAP_SPEED) m.min_time_gap = std::min(m.min_time_gap, gap / speed);
+        if (gap <= plant.sensor_range) {
+            float error = gap - sim_desired_gap(plant, fleet.scenarios[i].gap_setting, speed);
+            m.gap_error_sq += double(error) * error;
+            ++m.gap_samples;
+        }
+        m.max_brake = std::max(m.max_brake, -fleet.accel[i]);
+    }
+}
+
+// FNV-1a over the final state and results, to tell at a glance whether two
+// runs behaved identically.
+uint64_t fleet_digest(const SimFleet& fleet) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+    auto mix = [&hash](const void* data, size_t length) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < length; ++i) hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+    };
+    for (const std::vector<float>* values : {&fleet.speed, &fleet.accel, &fleet.gap, &fleet.integral_error}) {
+        mix(values->data(), values->size() * sizeof(float));
+    }
+    for (const ScenarioMetrics& m : fleet.metrics) {
+        mix(&m.min_gap, sizeof(m.min_gap));
+        mix(&m.collisions, sizeof(m.collisions));
+        mix(&m.distance, sizeof(m.distance));
+    }
+    return hash;
+}
+
+std::string digest_hex(uint64_t digest) {
+    std::ostringstream text;
+    text << std::hex << std::setw(16) << std::setfill('0') << digest;
+    return text.str();
+}
+
+void print_text_report(const SimFleet& fleet) {
+    std::cout << std::left << std::setw(13) << "profile" << std::right << std::setw(4) << "gap" << std::setw(8) << "kp"
+              << std::setw(8) << "ki" << std::setw(11) << "min gap m" << std::setw(12) << "min tgap s" << std::setw(12)
+              << "rms err m" << std::setw(12) << "max brake" << std::setw(11) << "collisions" << std::endl;
+    for (size_t i = 0; i < fleet.scenarios.size(); ++i) {
+        const SimTraceScenario& scenario = fleet.scenarios[i];
+        const ScenarioMetrics& m = fleet.metrics[i];
+        std::cout << std::left << std::setw(13) << LEAD_PROFILE_NAMES[static_cast<size_t>(scenario.profile)] << std::right
+                  << std::setw(4) << int(scenario.gap_setting) << std::setw(8) << scenario.kp << std::setw(8) << scenario.ki
+                  << std::fixed << std::setprecision(2) << std::setw(11) << m.min_gap << std::setw(12) << m.min_time_gap
+                  << std::setw(12) << m.rms_gap_error() << std::setw(12) << m.max_brake << std::setw(11) << m.collisions
+                  << std::defaultfloat << std::setprecision(6) << std::endl;
+    }
+}
+
+void write_json_report(std::ostream& out, const SimOptions& options, const SimFleet& fleet, uint64_t cycles,
+                       double elapsed_s, uint64_t digest) {
+    out << std::defaultfloat << std::setprecision(9);
+    out << "{\n  \"simulated_s\": " << cycles * options.cycle_ms / 1000.0 << ",\n  \"cycle_ms\": " << options.cycle_ms
+        << ",\n  \"cycles\": " << cycles << ",\n  \"seed\": " << options.seed << ",\n  \"elapsed_s\": " << elapsed_s
+        << ",\n  \"digest\": \"" << digest_hex(digest) << "\",\n  \"scenarios\": [\n";
+    for (size_t i = 0; i < fleet.scenarios.size(); ++i) {
+        const SimTraceScenario& scenario = fleet.scenarios[i];
+        const ScenarioMetrics& m = fleet.metrics[i];
+        out << "    {\"profile\": \"" << LEAD_PROFILE_NAMES[static_cast<size_t>(scenario.profile)] << "\", \"gap_setting\": "
+            << int(scenario.gap_setting) << ", \"kp\": " << scenario.kp << ", \"ki\": " << scenario.ki
+            << ", \"min_gap_m\": " << m.min_gap << ", \"min_time_gap_s\": "
+            << (std::isfinite(m.min_time_gap) ? m.min_time_gap : -1.0f) << ", \"rms_gap_error_m\": " << m.rms_gap_error()
+            << ", \"max_brake_mps2\": " << m.max_brake << ", \"collisions\": " << m.collisions
+            << ", \"distance_km\": " << m.distance / 1000.0 << "}" << (i + 1 < fleet.scenarios.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}" << std::endl;
+}
+
+int dump_trace(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    SimTraceInfo info;
+    size_t offset = file ? sim_decode_trace_header(data.data(), data.size(), info) : 0;
+    if (offset == 0) {
+        std::cerr << "[SIM] Not a readable trace: " << path << std::endl;
+        return 1;
+    }
+    const size_t count = info.scenarios.size();
+    const double sample_s = info.cycle_us * 1e-6 * info.decimation;
+    std::cout << std::fixed << "time_s,scenario,own_speed_mps,lead_speed_mps,gap_m,accel_mps2\n";
+    for (size_t sample = 0; offset + count * SIM_TRACE_RECORD_SIZE <= data.size(); ++sample) {
+        for (size_t i = 0; i < count; ++i, offset += SIM_TRACE_RECORD_SIZE) {
+            SimTraceSample s = sim_decode_trace_record(data.data() + offset);
+            std::cout << std::setprecision(3) << sample * sample_s << ',' << i << ',' << std::setprecision(2) << s.own_speed
+                      << ',' << s.lead_speed << ',' << s.gap << ',' << std::setprecision(3) << s.accel << '\n';
+        }
+    }
+    std::cout.flush();
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    SimOptions options;
+    if (!parse_command_line(argc, argv, options)) return 1;
+    if (!options.dump_path.empty()) return dump_trace(options.dump_path);
+
+    PlantParams plant;
+    plant.set_speed = options.set_speed_mph * SIM_MPS_PER_MPH;
+    plant.actuator_tau = options.lag_s;
+    SimFleet fleet;
+    build_fleet(options, plant, fleet);
+    const size_t count = fleet.scenarios.size();
+    const float dt = static_cast<float>(options.cycle_ms / 1000.0);
+    const uint64_t cycles = static_cast<uint64_t>(std::llround(options.hours * 3600.0 * 1000.0 / options.cycle_ms));
+
+    std::ofstream trace;
+    std::vector<uint8_t> trace_buffer;
+    if (!options.trace_path.empty()) {
+        trace.open(options.trace_path, std::ios::binary | std::ios::trunc);
+        sim_encode_trace_header(trace_buffer, fleet.scenarios, static_cast<uint32_t>(std::lround(options.cycle_ms * 1000.0)),
+                                options.trace_every);
+        if (!trace.is_open()) {
+            std::cerr << "[SIM] Could not write " << options.trace_path << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "[SIM] " << count << " scenario(s), " << options.hours << " h of driving in " << cycles << " cycles of "
+              << options.cycle_ms << " ms." << std::endl;
+    std::vector<float> lead_speed(count);
+    auto start = SimClock::now();
+    for (uint64_t cycle = 0; cycle < cycles; ++cycle) {
+        step_fleet(fleet, plant, dt, lead_speed);
+        if (trace.is_open() && cycle % options.trace_every == 0) {
+            size_t offset = trace_buffer.size();
+            trace_buffer.resize(offset + count * SIM_TRACE_RECORD_SIZE);
+            for (size_t i = 0; i < count; ++i) {
+                sim_encode_trace_record(trace_buffer.data() + offset + i * SIM_TRACE_RECORD_SIZE,
+                                        {fleet.speed[i], lead_speed[i], fleet.gap[i], fleet.accel[i]});
+            }
+            if (trace_buffer.size() >= (1u << 20)) {
+                trace.write(reinterpret_cast<const char*>(trace_buffer.data()), trace_buffer.size());
+                trace_buffer.clear();
+            }
+        }
+    }
+    double elapsed_s = std::chrono::duration<double>(SimClock::now() - start).count();
+    if (trace.is_open()) {
+        trace.write(reinterpret_cast<const char*>(trace_buffer.data()), trace_buffer.size());
+        trace.close();
+        if (!trace) {
+            std::cerr << "[SIM] Could not write " << options.trace_path << std::endl;
+            return 1;
+        }
+    }
+
+    uint64_t digest = fleet_digest(fleet);
+    double simulated_s = cycles * options.cycle_ms / 1000.0;
+    print_text_report(fleet);
+    std::cout << "[SIM] Simulated " << std::fixed << std::setprecision(2) << simulated_s / 3600.0 << " h in " << std::setprecision(3)
+              << elapsed_s << " s: " << std::setprecision(1) << (elapsed_s > 0 ? cycles * count / elapsed_s / 1e6 : 0.0)
+              << " M vehicle-cycles/s, " << std::setprecision(0) << (elapsed_s > 0 ? simulated_s / elapsed_s : 0.0)
+              << "x real time. Digest " << digest_hex(digest) << "." << std::defaultfloat << std::setprecision(6) << std::endl;
+
+    if (options.json_path == "-") {
+        write_json_report(std::cout, options, fleet, cycles, elapsed_s, digest);
+    } else if (!options.json_path.empty()) {
+        std::ofstream json(options.json_path);
+        write_json_report(json, options, fleet, cycles, elapsed_s, digest);
+        if (!json) {
+            std::cerr << "[SIM] Could not write " << options.json_path << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <vector>
+
+// --- Longitudinal vehicle simulation ---
+// Everything vecu_sim needs to close the loop around the ACC controller
+// without the platform: a lead vehicle that follows a seeded manoeuvre
+// profile, a follower with a simple powertrain/brake model, the time-gap
+// policy behind ACC_GAP_SETTING, and a compact binary trace format. Time is
+// virtual and advances one control cycle per step, so runs are deterministic
+// and as fast as the CPU allows.
+//
+// The controller works in mph and commands a new own speed each cycle; the
+// plant works in SI units and decides how much of that command the vehicle
+// can actually follow.
+
+constexpr float SIM_MPS_PER_MPH = 0.44704f;
+constexpr float SIM_MPH_PER_MPS = 1.0f / SIM_MPS_PER_MPH;
+
+// Time gap in seconds for ACC_GAP_SETTING 1..4; other values are clamped.
+inline constexpr float SIM_TIME_GAP_S[] = {1.0f, 1.5f, 2.0f, 2.5f};
+
+inline float sim_time_gap(int gap_setting) {
+    return SIM_TIME_GAP_S[std::clamp(gap_setting, 1, 4) - 1];
+}
+
+struct PlantParams {
+    float max_accel = 2.5f;       // m/s^2 the powertrain can deliver
+    float max_brake = 8.0f;       // m/s^2 the brakes can deliver
+    float actuator_tau = 0.3f;    // s, first-order lag from command to acceleration; 0 = none
+    float rolling = 0.1f;         // m/s^2 of rolling resistance while moving
+    float drag = 0.0004f;         // 1/m; aerodynamic drag is drag * v^2 m/s^2
+    float standstill_gap = 5.0f;  // m kept to a stopped lead vehicle
+    float gap_gain = 0.25f;       // 1/s, speed reference per metre of gap error
+    float sensor_range = 150.0f;  // m; a lead vehicle farther away is ignored
+    float set_speed = 70.0f * SIM_MPS_PER_MPH; // m/s the driver has set
+};
+
+// Gap the follower should keep at `speed` (m/s) with the given setting.
+inline float sim_desired_gap(const PlantParams& plant, int gap_setting, float speed) {
+    return plant.standstill_gap + sim_time_gap(gap_setting) * speed;
+}
+
+// The speed fed to the controller as its target (the ECU's
+// LEAD_VEHICLE_SPEED). The controller itself only tracks a speed, so the gap
+// policy lives here: the lead's speed, corrected by how far the gap is from
+// the desired one, capped at the set speed. With no lead in range the
+// follower cruises at the set speed.
+inline float sim_reference_speed(const PlantParams& plant, int gap_setting, float lead_speed, float own_speed, float gap) {
+    if (gap > plant.sensor_range) return plant.set_speed;
+    float reference = lead_speed + plant.gap_gain * (gap - sim_desired_gap(plant, gap_setting, own_speed));
+    return std::clamp(reference, 0.0f, plant.set_speed);
+}
+
+// Advances the follower by `dt` seconds towards `commanded_speed` (m/s).
+// The command is limited to what the powertrain and brakes can do and
+// reaches the wheels through a first-order lag; road load acts on top.
+inline void sim_plant_step(const PlantParams& plant, float dt, float commanded_speed, float& speed, float& accel) {
+    float wanted = std::clamp((commanded_speed - speed) / dt, -plant.max_brake, plant.max_accel);
+    accel += (wanted - accel) * (plant.actuator_tau > 0.0f ? std::min(1.0f, dt / plant.actuator_tau) : 1.0f);
+    float road_load = speed > 0.0f ? plant.rolling + plant.drag * speed * speed : 0.0f;
+    speed = std::max(0.0f, speed + (accel - road_load) * dt);
+}
+
+// --- Lead vehicle ---
+enum class LeadProfile : uint8_t {
+    STEADY,      // Constant 65 mph
+    HIGHWAY,     // 55-75 mph with gentle speed changes
+    STOP_AND_GO, // Queues: 0-30 mph with stops
+    HARD_BRAKE,  // 65 mph cruising broken up by emergency stops to 20 mph
+    COUNT
+};
+
+inline constexpr const char* LEAD_PROFILE_NAMES[] = {"steady", "highway", "stop-and-go", "hard-brake"};
+static_assert(std::size(LEAD_PROFILE_NAMES) == static_cast<size_t>(LeadProfile::COUNT), "One name per profile");
+
+inline std::optional<LeadProfile> lead_profile_from_name(const std::string& name) {
+    for (size_t i = 0; i < std::size(LEAD_PROFILE_NAMES); ++i) {
+        if (name == LEAD_PROFILE_NAMES[i]) return static_cast<LeadProfile>(i);
+    }
+    return std::nullopt;
+}
+
+// SplitMix64: small, fast, and the same sequence on every platform, unlike
+// the standard library's distributions.
+class SimRandom {
+public:
+    explicit SimRandom(uint64_t seed) : m_state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (m_state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    float uniform(float low, float high) {
+        return low + (high - low) * static_cast<float>(next() >> 40) * (1.0f / 16777216.0f);
+    }
+
+private:
+    uint64_t m_state;
+};
+
+// A lead vehicle working through random manoeuvres: ramp to a target speed
+// at some rate, hold it for a while, pick the next one. Two lead vehicles
+// with the same profile and seed drive exactly the same trajectory.
+class LeadVehicle {
+public:
+    LeadVehicle(LeadProfile profile, uint64_t seed) : m_profile(profile), m_random(seed) {
+        m_speed = (profile == LeadProfile::STOP_AND_GO ? 20.0f : 65.0f) * SIM_MPS_PER_MPH;
+        m_target = m_speed;
+        m_hold = m_random.uniform(5.0f, 20.0f);
+    }
+
+    float speed() const { return m_speed; }
+
+    void step(float dt) {
+        if (m_speed != m_target) {
+            float change = m_rate * dt;
+            m_speed = m_speed < m_target ? std::min(m_target, m_speed + change) : std::max(m_target, m_speed - change);
+            return;
+        }
+        m_hold -= dt;
+        if (m_hold <= 0.0f) next_manoeuvre();
+    }
+
+private:
+    void next_manoeuvre() {
+        switch (m_profile) {
+            case LeadProfile::STEADY:
+                m_hold = 3600.0f;
+                return;
+            case LeadProfile::HIGHWAY:
+                m_target = m_random.uniform(55.0f, 75.0f) * SIM_MPS_PER_MPH;
+                m_rate = m_random.uniform(0.3f, 1.5f);
+                m_hold = m_random.uniform(20.0f, 120.0f);
+                return;
+            case LeadProfile::STOP_AND_GO:
+                // Every other manoeuvre is a stop.
+                m_stopping = !m_stopping;
+                m_target = m_stopping ? 0.0f : m_random.uniform(10.0f, 30.0f) * SIM_MPS_PER_MPH;
+                m_rate = m_random.uniform(1.0f, 3.0f);
+                m_hold = m_stopping ? m_random.uniform(5.0f, 20.0f) : m_random.uniform(5.0f, 30.0f);
+                return;
+            case LeadProfile::HARD_BRAKE:
+                m_stopping = !m_stopping;
+                m_target = (m_stopping ? 20.0f : 65.0f) * SIM_MPS_PER_MPH;
+                m_rate = m_stopping ? m_random.uniform(6.0f, 8.0f) : m_random.uniform(1.0f, 2.0f);
+                m_hold = m_stopping ? m_random.uniform(2.0f, 5.0f) : m_random.uniform(60.0f, 180.0f);
+                return;
+            case LeadProfile::COUNT:
+                break;
+        }
+    }
+
+    LeadProfile m_profile;
+    SimRandom m_random;
+    float m_speed;
+    float m_target;
+    float m_rate = 1.0f; // m/s^2
+    float m_hold;        // s left at the current target
+    bool m_stopping = false;
+};
+
+// --- Binary trace ---
+// Little-endian throughout.
+//
+//   header:   magic "VSIM", version:u16, record_size:u16, scenario_count:u32,
+//             cycle_us:u32, decimation:u32, reserved:u32
+//   scenario: kp:f32, ki:f32, max_accel:f32, max_decel:f32, gap_setting:u8,
+//             profile:u8, reserved[2]                     (once per scenario)
+//   samples:  one record per scenario, every `decimation` cycles:
+//             own_speed:u16 (0.01 m/s), lead_speed:u16 (0.01 m/s),
+//             gap:u16 (0.01 m, saturating), accel:i16 (0.001 m/s^2)
+constexpr uint32_t SIM_TRACE_MAGIC = 0x4D495356; // "VSIM"
+constexpr uint16_t SIM_TRACE_VERSION = 1;
+constexpr size_t SIM_TRACE_HEADER_SIZE = 24;
+constexpr size_t SIM_TRACE_SCENARIO_SIZE = 20;
+constexpr size_t SIM_TRACE_RECORD_SIZE = 8;
+
+struct SimTraceScenario {
+    float kp;
+    float ki;
+    float max_accel;
+    float max_decel;
+    uint8_t gap_setting;
+    LeadProfile profile;
+};
+
+struct SimTraceSample {
+    float own_speed;  // m/s
+    float lead_speed; // m/s
+    float gap;        // m
+    float accel;      // m/s^2
+};
+
+inline void sim_put_le(std::vector<uint8_t>& out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+inline uint64_t sim_get_le(const uint8_t* in, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) value |= uint64_t(in[i]) << (8 * i);
+    return value;
+}
+
+inline void sim_put_f32(std::vector<uint8_t>& out, float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    sim_put_le(out, bits, 4);
+}
+
+inline float sim_get_f32(const uint8_t* in) {
+    uint32_t bits = static_cast<uint32_t>(sim_get_le(in, 4));
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+inline void sim_encode_trace_header(std::vector<uint8_t>& out, const std::vector<SimTraceScenario>& scenarios,
+                                    uint32_t cycle_us, uint32_t decimation) {
+    sim_put_le(out, SIM_TRACE_MAGIC, 4);
+    sim_put_le(out, SIM_TRACE_VERSION, 2);
+    sim_put_le(out, SIM_TRACE_RECORD_SIZE, 2);
+    sim_put_le(out, scenarios.size(), 4);
+    sim_put_le(out, cycle_us, 4);
+    sim_put_le(out, decimation, 4);
+    sim_put_le(out, 0, 4);
+    for (const SimTraceScenario& scenario : scenarios) {
+        sim_put_f32(out, scenario.kp);
+        sim_put_f32(out, scenario.ki);
+        sim_put_f32(out, scenario.max_accel);
+        sim_put_f32(out, scenario.max_decel);
+        out.push_back(scenario.gap_setting);
+        out.push_back(static_cast<uint8_t>(scenario.profile));
+        sim_put_le(out, 0, 2);
+    }
+}
+
+inline void sim_encode_trace_record(uint8_t* out, const SimTraceSample& sample) {
+    auto quantize = [](float value, float scale, long low, long high) {
+        return static_cast<uint64_t>(std::clamp(std::lround(value * scale), low, high));
+    };
+    uint8_t* p = out;
+    for (uint64_t field : {quantize(sample.own_speed, 100.0f, 0, 65535), quantize(sample.lead_speed, 100.0f, 0, 65535),
+                           quantize(sample.gap, 100.0f, 0, 65535), quantize(sample.accel, 1000.0f, -32768, 32767)}) {
+        p[0] = static_cast<uint8_t>(field);
+        p[1] = static_cast<uint8_t>(field >> 8);
+        p += 2;
+    }
+}
+
+inline SimTraceSample sim_decode_trace_record(const uint8_t* in) {
+    return {static_cast<uint16_t>(sim_get_le(in, 2)) / 100.0f, static_cast<uint16_t>(sim_get_le(in + 2, 2)) / 100.0f,
+            static_cast<uint16_t>(sim_get_le(in + 4, 2)) / 100.0f, static_cast<int16_t>(sim_get_le(in + 6, 2)) / 1000.0f};
+}
+
+struct SimTraceInfo {
+    uint32_t cycle_us = 0;
+    uint32_t decimation = 0;
+    std::vector<SimTraceScenario> scenarios;
+};
+
+// Parses the header and scenario table; returns the offset of the first
+// sample, or 0 if `data` is not a trace this version understands.
+inline size_t sim_decode_trace_header(const uint8_t* data, size_t length, SimTraceInfo& info) {
+    if (length < SIM_TRACE_HEADER_SIZE || sim_get_le(data, 4) != SIM_TRACE_MAGIC ||
+        sim_get_le(data + 4, 2) != SIM_TRACE_VERSION || sim_get_le(data + 6, 2) != SIM_TRACE_RECORD_SIZE) {
+        return 0;
+    }
+    size_t count = sim_get_le(data + 8, 4);
+    info.cycle_us = static_cast<uint32_t>(sim_get_le(data + 12, 4));
+    info.decimation = static_cast<uint32_t>(sim_get_le(data + 16, 4));
+    size_t offset = SIM_TRACE_HEADER_SIZE;
+    if (count == 0 || (length - offset) / SIM_TRACE_SCENARIO_SIZE < count) return 0;
+    info.scenarios.clear();
+    for (size_t i = 0; i < count; ++i, offset += SIM_TRACE_SCENARIO_SIZE) {
+        const uint8_t* p = data + offset;
+        if (p[17] >= static_cast<uint8_t>(LeadProfile::COUNT)) return 0;
+        info.scenarios.push_back({sim_get_f32(p), sim_get_f32(p + 4), sim_get_f32(p + 8), sim_get_f32(p + 12), p[16],
+                                  static_cast<LeadProfile>(p[17])});
+    }
+    return offset;
+}